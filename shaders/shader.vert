@@ -1,23 +1,24 @@
 #version 450
 
-// We need to pass the per-vertex colors to the fragment shader so it can output the interpolated values
-layout(location = 0) out vec3 fragColor;
+// What each vertex of the vertex buffer holds (the locations must match vertex::getAttributeDescriptions in mesh.hpp)
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// What each instance holds, each coming from its own tightly packed buffer (the locations must match instanceData::getAttributeDescriptions in mesh.hpp)
+layout(location = 2) in vec2 instancePosition;
+layout(location = 3) in vec3 instanceColor;
+layout(location = 4) in vec4 instanceTransform; // A column-major 2x2 matrix, since matrix attributes would take up one location per column
 
-// The hassle of creating a vertex buffer with Vulkan ain't worth it for now so we just put it directly in the shader instead for now
-vec2 positions[3] = vec2[](
-     vec2(.0, -.5),
-     vec2(.5, .5),
-     vec2(-.5, .5)
-);
+// Everything gets scaled around the center of the screen (which culling has to account for, see cull.comp)
+layout(push_constant) uniform viewParameters {
+    float zoom;
+} view;
 
-// We want to specify a distinct color for each of the 3 vertices
-vec3 colors[3] = vec3[](
-     vec3(1., 0., 0.),
-     vec3(0., 1., 0.),
-     vec3(0., 0., 1.)
-);
+// We need to pass the per-vertex colors to the fragment shader so it can output the interpolated values
+layout(location = 0) out vec3 fragColor;
 
 void main() {
-     gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-     fragColor = colors[gl_VertexIndex];
+     mat2 transform = mat2(instanceTransform.xy, instanceTransform.zw);
+     gl_Position = vec4((instancePosition + transform * inPosition) * view.zoom, 0.0, 1.0);
+     fragColor = inColor * instanceColor;
 }
\ No newline at end of file
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <array>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+
+// How we'd like frames to be presented, which is mostly a trade-off between latency, tearing and wasted work
+enum class presentModePreference {
+    immediate, // Shown right away, tearing and all
+    mailbox, // Shown on the next vertical blank, with newer frames replacing ones that are still waiting
+    fifo, // Shown on vertical blanks, in order (the only one every surface supports)
+    fifoRelaxed, // Like fifo, except that late frames are shown right away (and might tear)
+};
+
+// How the instances are laid out
+enum class sceneKind {
+    grid, // Side by side over the whole screen (a single instance is just the mesh as it is)
+    layers, // Each one covering the whole screen, on top of each other
+};
+
+// What captured frames are written as
+enum class frameCaptureFormat {
+    raw, // The pixels exactly as the GPU copied them out (tightly packed rows, in the image format's channel order), which costs nothing to write
+    qoi, // https://qoiformat.org, lossless and about as fast to encode as it gets while still being something image viewers open
+};
+
+// How what we draw gets combined with what's already there
+// There's no alpha blending, since the fragment shader writes an alpha of 1 everywhere, which would make it look exactly like opaque
+enum class pipelineBlendMode : std::uint8_t {
+    opaque, // Replaces it
+    additive, // Adds up, which makes overdraw show up as brighter
+    count, // Not an actual mode, just how many of them there are
+};
+
+inline const char *getPipelineBlendModeName(pipelineBlendMode mode)
+{
+    static constexpr std::array<const char *, static_cast<std::size_t>(pipelineBlendMode::count)> names = { { "opaque", "additive" } };
+    return names.at(static_cast<std::size_t>(mode));
+}
+
+// Everything about the app that can be tweaked at runtime
+// Every option can be given on the command line, and most can also be given through the environment (which is handy on machines where we don't control the command line, like the render farm nodes)
+struct applicationOptions {
+    bool headless = false; // Render into offscreen images instead of a window's swap chain, so that we don't need a display (or GLFW, or even a GPU if we use something like Mesa's lavapipe)
+    std::uint32_t headlessFrameCount = 1000; // There is no window to close when running headless, so we just stop after rendering this many frames
+    bool profile = false; // Time every frame (on both the CPU and the GPU) and print percentiles on exit, or when pressing P
+    std::string physicalDevice; // Which GPU to use, as an index in enumeration order or a UUID (both of which get printed on startup), instead of the one we'd rank the highest (empty means we pick)
+    std::string deviceCachePath = "device_cache.txt"; // Where what we learnt about each GPU is kept between launches, so that we don't have to ask every one of them again (empty means we don't persist it at all)
+    std::string pipelineCachePath = "pipeline_cache.bin"; // Where the pipeline cache is loaded from on startup and saved to on exit (empty means we don't persist it at all)
+    std::uint32_t framesInFlight = 2; // We don't want the CPU to get *too* far ahead of the GPU by default (putting 3 or more frames in flight might add a significant amount of latency...)
+    std::uint32_t swapChainImageCount = 0; // 0 means we pick for ourselves (one more than the minimum the surface wants)
+    std::string shaderDirectory; // Load .spv files from here instead of using the ones embedded in the binary (empty means we use the embedded ones), so that shaders can be iterated on without rebuilding
+    std::string watchShaderDirectory; // Recompile the GLSL sources in this directory whenever they change and swap the results in while running (empty means we don't watch anything)
+    std::uint32_t stagingBufferMegabytes = 16; // Size of the host-visible ring that everything uploaded to device-local memory goes through (uploads bigger than that are fine, they just have to wait for the GPU to catch up)
+    std::uint32_t instanceCount = 1; // How many copies of the mesh to draw (all in a single instanced draw call), which is how we stress the GPU with lots of small objects
+    sceneKind scene = sceneKind::grid;
+    pipelineBlendMode blendMode = pipelineBlendMode::opaque; // What we start with, as it can be switched with B while running
+    std::uint32_t drawCount = 1; // How many draw calls the instances are split into, to get a draw list big enough for recording it to cost something
+    std::uint32_t recordThreadCount = 0; // How many worker threads record the draw list into secondary command buffers (0 means the main thread records everything itself)
+    std::uint32_t uploadBenchmarkMegabytes = 0; // Upload a mesh this big instead of rendering anything, and report the throughput (0 means we render as usual)
+    presentModePreference presentMode = presentModePreference::mailbox; // Falls back to fifo when the surface doesn't support it
+    bool framePacing = false; // Start each frame as late as we can get away with instead of as early as possible, which trades frame rate headroom for less input latency
+    bool gpuCulling = false; // Cull instances in a compute shader and draw the survivors with a single indirect draw, instead of drawing every instance of the draw list
+    bool cpuCulling = false; // Update and cull instances on the CPU every frame (see sceneUpdate.hpp), and draw the survivors with one indirect draw per entry of the draw list
+    std::uint32_t zoom = 1; // Scales the view around the center of the screen, so that most instances end up off-screen (which is what makes culling worth it)
+    bool onDemand = false; // Only render when something changed (input, resizes, timers), and sleep otherwise, instead of rendering as fast as the present mode lets us
+    std::uint32_t redrawIntervalMilliseconds = 0; // With onDemand, also redraw this often even when nothing else asks for it, like an animation would (0 means never)
+    std::uint32_t headlessResizeInterval = 0; // Resize the headless render targets every this many frames, cycling through a fixed list of sizes, which is what a window being dragged around does to the swap chain (0 means never)
+    std::string reportJsonPath; // Where to write the results of a headless run as JSON, for tools to pick up (empty means we don't)
+    std::string goldenImagePath; // A QOI image that the last headless frame must match (empty means we don't check)
+    std::uint32_t goldenTolerance = 2; // How far off (out of 255) a channel can be before its pixel counts as different, since rasterization and blending aren't bit-exact between drivers
+    bool updateGoldenImage = false; // Write the last headless frame to goldenImagePath instead of comparing against it
+    std::string captureDirectory; // Write every frame we render to this directory (empty means we don't capture anything)
+    frameCaptureFormat captureFormat = frameCaptureFormat::qoi;
+    std::uint32_t captureRingSize = 0; // How many frames can be on their way to disk at once before we start dropping them (0 means two more than there are frames in flight)
+    bool recordEveryFrame = false; // Re-record command buffers every frame even when nothing they depend on changed, which is what we used to do (and what recording benchmarks want to measure)
+};
+
+[[nodiscard]] inline std::uint32_t parseApplicationOptionUint(std::string_view optionName, std::string_view value)
+{
+    std::size_t parsedLength = 0;
+    unsigned long result;
+    try {
+        result = std::stoul(std::string(value), &parsedLength);
+    } catch (const std::exception &) {
+        parsedLength = 0;
+    }
+
+    if (parsedLength != value.size() || parsedLength == 0 || result > UINT32_MAX)
+        throw std::runtime_error("Invalid value for " + std::string(optionName) + ": '" + std::string(value) + "' (expected an unsigned integer)");
+    return static_cast<std::uint32_t>(result);
+}
+
+[[nodiscard]] inline bool parseApplicationOptionBool(std::string_view value)
+{
+    return !(value.empty() || value == "0" || value == "false" || value == "no" || value == "off");
+}
+
+[[nodiscard]] inline presentModePreference parseApplicationOptionPresentMode(std::string_view optionName, std::string_view value)
+{
+    if (value == "immediate")
+        return presentModePreference::immediate;
+    if (value == "mailbox")
+        return presentModePreference::mailbox;
+    if (value == "fifo")
+        return presentModePreference::fifo;
+    if (value == "fifo_relaxed")
+        return presentModePreference::fifoRelaxed;
+    throw std::runtime_error("Invalid value for " + std::string(optionName) + ": '" + std::string(value) + "' (expected immediate, mailbox, fifo or fifo_relaxed)");
+}
+
+[[nodiscard]] inline frameCaptureFormat parseApplicationOptionCaptureFormat(std::string_view optionName, std::string_view value)
+{
+    if (value == "raw")
+        return frameCaptureFormat::raw;
+    if (value == "qoi")
+        return frameCaptureFormat::qoi;
+    throw std::runtime_error("Invalid value for " + std::string(optionName) + ": '" + std::string(value) + "' (expected raw or qoi)");
+}
+
+[[nodiscard]] inline sceneKind parseApplicationOptionScene(std::string_view optionName, std::string_view value)
+{
+    if (value == "grid")
+        return sceneKind::grid;
+    if (value == "layers")
+        return sceneKind::layers;
+    throw std::runtime_error("Invalid value for " + std::string(optionName) + ": '" + std::string(value) + "' (expected grid or layers)");
+}
+
+[[nodiscard]] inline pipelineBlendMode parseApplicationOptionBlendMode(std::string_view optionName, std::string_view value)
+{
+    for (std::size_t i = 0; i < static_cast<std::size_t>(pipelineBlendMode::count); ++i)
+        if (value == getPipelineBlendModeName(static_cast<pipelineBlendMode>(i)))
+            return static_cast<pipelineBlendMode>(i);
+    throw std::runtime_error("Invalid value for " + std::string(optionName) + ": '" + std::string(value) + "' (expected opaque or additive)");
+}
+
+inline void printApplicationOptionsUsage(const char *programName)
+{
+    std::cout << "Usage: " << programName << " [options]\n"
+        "Options:\n"
+        "\t--headless              Render offscreen without a window or swap chain (env: VULKAN_TEST_HEADLESS)\n"
+        "\t--frames <count>        Number of frames to render before exiting when headless (env: VULKAN_TEST_FRAMES)\n"
+        "\t--profile               Collect frame timings and report them on exit, or when pressing P (env: VULKAN_TEST_PROFILE)\n"
+        "\t--device <index|uuid>   Use that GPU instead of the best one we find (env: VULKAN_TEST_DEVICE)\n"
+        "\t--device-cache <path>   Where to persist what we learn about GPUs, default device_cache.txt (env: VULKAN_TEST_DEVICE_CACHE)\n"
+        "\t--no-device-cache       Query every GPU on every launch\n"
+        "\t--pipeline-cache <path> Where to persist the pipeline cache, default pipeline_cache.bin (env: VULKAN_TEST_PIPELINE_CACHE)\n"
+        "\t--no-pipeline-cache     Don't load or save the pipeline cache\n"
+        "\t--frames-in-flight <n>  How many frames the CPU can get ahead of the GPU, 1 to 16, default 2 (env: VULKAN_TEST_FRAMES_IN_FLIGHT)\n"
+        "\t--swapchain-images <n>  How many swap chain images to ask for, default is one more than the minimum (env: VULKAN_TEST_SWAPCHAIN_IMAGES)\n"
+        "\t--shader-dir <path>     Load .spv files from there instead of using the embedded ones, e.g. shaders (env: VULKAN_TEST_SHADER_DIR)\n"
+        "\t--watch-shaders <path>  Recompile shaders there when they change and use them right away, e.g. shaders (env: VULKAN_TEST_WATCH_SHADERS)\n"
+        "\t--staging-size <MB>     Size of the staging ring used for uploads, default 16 (env: VULKAN_TEST_STAGING_SIZE)\n"
+        "\t--instances <count>     How many instances of the mesh to draw, default 1 (env: VULKAN_TEST_INSTANCES)\n"
+        "\t--scene <kind>          grid, or layers of fullscreen instances for overdraw, default grid (env: VULKAN_TEST_SCENE)\n"
+        "\t--blend <mode>          opaque or additive, default opaque, B switches while running (env: VULKAN_TEST_BLEND)\n"
+        "\t--draws <count>         How many draw calls the instances are split into, default 1 (env: VULKAN_TEST_DRAWS)\n"
+        "\t--record-threads <n>    How many threads record draw calls, default 0 which records on the main thread (env: VULKAN_TEST_RECORD_THREADS)\n"
+        "\t--upload-benchmark <MB> Upload meshes of that size and report the throughput instead of rendering (env: VULKAN_TEST_UPLOAD_BENCHMARK)\n"
+        "\t--present-mode <mode>   immediate, mailbox, fifo or fifo_relaxed, default mailbox (env: VULKAN_TEST_PRESENT_MODE)\n"
+        "\t--frame-pacing          Delay each frame to just before it's needed, for lower input latency (env: VULKAN_TEST_FRAME_PACING)\n"
+        "\t--gpu-culling           Cull instances on the GPU and only draw the visible ones (env: VULKAN_TEST_GPU_CULLING)\n"
+        "\t--cpu-culling           Update and cull instances on the CPU every frame, with the widest SIMD it has (env: VULKAN_TEST_CPU_CULLING)\n"
+        "\t--zoom <factor>         Zoom into the center of the screen, 1 to 1024, default 1 (env: VULKAN_TEST_ZOOM)\n"
+        "\t--on-demand             Only render when something changed, for less power usage (env: VULKAN_TEST_ON_DEMAND)\n"
+        "\t--redraw-interval <ms>  With --on-demand, also redraw this often, default 0 which never does (env: VULKAN_TEST_REDRAW_INTERVAL)\n"
+        "\t--resize-every <n>      Resize the render targets every n frames when headless, default 0 which never does (env: VULKAN_TEST_RESIZE_EVERY)\n"
+        "\t--report-json <path>    Write the results of a headless run to that file as JSON (env: VULKAN_TEST_REPORT_JSON)\n"
+        "\t--golden <path>         Check that the last headless frame matches that QOI image, and fail otherwise (env: VULKAN_TEST_GOLDEN)\n"
+        "\t--golden-tolerance <n>  How much each channel can differ from the golden image, 0 to 255, default 2 (env: VULKAN_TEST_GOLDEN_TOLERANCE)\n"
+        "\t--update-golden         Write the last headless frame as the golden image instead of checking it (env: VULKAN_TEST_UPDATE_GOLDEN)\n"
+        "\t--capture <dir>         Write every rendered frame to that directory, dropping frames if writing falls behind (env: VULKAN_TEST_CAPTURE)\n"
+        "\t--capture-format <fmt>  raw or qoi, default qoi (env: VULKAN_TEST_CAPTURE_FORMAT)\n"
+        "\t--capture-ring <n>      How many captured frames can wait to be written, default frames in flight + 2 (env: VULKAN_TEST_CAPTURE_RING)\n"
+        "\t--record-every-frame    Don't reuse command buffers across frames (env: VULKAN_TEST_RECORD_EVERY_FRAME)\n"
+        "\t--help                  Print this message and exit\n";
+}
+
+// The environment is read first so that the command line can override it
+[[nodiscard]] inline applicationOptions parseApplicationOptions(int argc, char **argv)
+{
+    applicationOptions result;
+
+    if (const char *value = std::getenv("VULKAN_TEST_HEADLESS"))
+        result.headless = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_FRAMES"))
+        result.headlessFrameCount = parseApplicationOptionUint("VULKAN_TEST_FRAMES", value);
+    if (const char *value = std::getenv("VULKAN_TEST_PROFILE"))
+        result.profile = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_DEVICE"))
+        result.physicalDevice = value;
+    if (const char *value = std::getenv("VULKAN_TEST_DEVICE_CACHE"))
+        result.deviceCachePath = value;
+    if (const char *value = std::getenv("VULKAN_TEST_PIPELINE_CACHE"))
+        result.pipelineCachePath = value;
+    if (const char *value = std::getenv("VULKAN_TEST_FRAMES_IN_FLIGHT"))
+        result.framesInFlight = parseApplicationOptionUint("VULKAN_TEST_FRAMES_IN_FLIGHT", value);
+    if (const char *value = std::getenv("VULKAN_TEST_SWAPCHAIN_IMAGES"))
+        result.swapChainImageCount = parseApplicationOptionUint("VULKAN_TEST_SWAPCHAIN_IMAGES", value);
+    if (const char *value = std::getenv("VULKAN_TEST_SHADER_DIR"))
+        result.shaderDirectory = value;
+    if (const char *value = std::getenv("VULKAN_TEST_WATCH_SHADERS"))
+        result.watchShaderDirectory = value;
+    if (const char *value = std::getenv("VULKAN_TEST_STAGING_SIZE"))
+        result.stagingBufferMegabytes = parseApplicationOptionUint("VULKAN_TEST_STAGING_SIZE", value);
+    if (const char *value = std::getenv("VULKAN_TEST_INSTANCES"))
+        result.instanceCount = parseApplicationOptionUint("VULKAN_TEST_INSTANCES", value);
+    if (const char *value = std::getenv("VULKAN_TEST_SCENE"))
+        result.scene = parseApplicationOptionScene("VULKAN_TEST_SCENE", value);
+    if (const char *value = std::getenv("VULKAN_TEST_BLEND"))
+        result.blendMode = parseApplicationOptionBlendMode("VULKAN_TEST_BLEND", value);
+    if (const char *value = std::getenv("VULKAN_TEST_DRAWS"))
+        result.drawCount = parseApplicationOptionUint("VULKAN_TEST_DRAWS", value);
+    if (const char *value = std::getenv("VULKAN_TEST_RECORD_THREADS"))
+        result.recordThreadCount = parseApplicationOptionUint("VULKAN_TEST_RECORD_THREADS", value);
+    if (const char *value = std::getenv("VULKAN_TEST_UPLOAD_BENCHMARK"))
+        result.uploadBenchmarkMegabytes = parseApplicationOptionUint("VULKAN_TEST_UPLOAD_BENCHMARK", value);
+    if (const char *value = std::getenv("VULKAN_TEST_PRESENT_MODE"))
+        result.presentMode = parseApplicationOptionPresentMode("VULKAN_TEST_PRESENT_MODE", value);
+    if (const char *value = std::getenv("VULKAN_TEST_FRAME_PACING"))
+        result.framePacing = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_GPU_CULLING"))
+        result.gpuCulling = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_CPU_CULLING"))
+        result.cpuCulling = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_ZOOM"))
+        result.zoom = parseApplicationOptionUint("VULKAN_TEST_ZOOM", value);
+    if (const char *value = std::getenv("VULKAN_TEST_ON_DEMAND"))
+        result.onDemand = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_REDRAW_INTERVAL"))
+        result.redrawIntervalMilliseconds = parseApplicationOptionUint("VULKAN_TEST_REDRAW_INTERVAL", value);
+    if (const char *value = std::getenv("VULKAN_TEST_RESIZE_EVERY"))
+        result.headlessResizeInterval = parseApplicationOptionUint("VULKAN_TEST_RESIZE_EVERY", value);
+    if (const char *value = std::getenv("VULKAN_TEST_REPORT_JSON"))
+        result.reportJsonPath = value;
+    if (const char *value = std::getenv("VULKAN_TEST_GOLDEN"))
+        result.goldenImagePath = value;
+    if (const char *value = std::getenv("VULKAN_TEST_GOLDEN_TOLERANCE"))
+        result.goldenTolerance = parseApplicationOptionUint("VULKAN_TEST_GOLDEN_TOLERANCE", value);
+    if (const char *value = std::getenv("VULKAN_TEST_UPDATE_GOLDEN"))
+        result.updateGoldenImage = parseApplicationOptionBool(value);
+    if (const char *value = std::getenv("VULKAN_TEST_CAPTURE"))
+        result.captureDirectory = value;
+    if (const char *value = std::getenv("VULKAN_TEST_CAPTURE_FORMAT"))
+        result.captureFormat = parseApplicationOptionCaptureFormat("VULKAN_TEST_CAPTURE_FORMAT", value);
+    if (const char *value = std::getenv("VULKAN_TEST_CAPTURE_RING"))
+        result.captureRingSize = parseApplicationOptionUint("VULKAN_TEST_CAPTURE_RING", value);
+    if (const char *value = std::getenv("VULKAN_TEST_RECORD_EVERY_FRAME"))
+        result.recordEveryFrame = parseApplicationOptionBool(value);
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view argument = argv[i];
+
+        // Fetches the value for options that take one, complaining if there isn't any
+        auto nextValue = [&]() -> std::string_view {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string(argument));
+            return argv[++i];
+        };
+
+        if (argument == "--headless")
+            result.headless = true;
+        else if (argument == "--frames")
+            result.headlessFrameCount = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--profile")
+            result.profile = true;
+        else if (argument == "--device")
+            result.physicalDevice = nextValue();
+        else if (argument == "--device-cache")
+            result.deviceCachePath = nextValue();
+        else if (argument == "--no-device-cache")
+            result.deviceCachePath.clear();
+        else if (argument == "--pipeline-cache")
+            result.pipelineCachePath = nextValue();
+        else if (argument == "--no-pipeline-cache")
+            result.pipelineCachePath.clear();
+        else if (argument == "--frames-in-flight")
+            result.framesInFlight = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--swapchain-images")
+            result.swapChainImageCount = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--shader-dir")
+            result.shaderDirectory = nextValue();
+        else if (argument == "--watch-shaders")
+            result.watchShaderDirectory = nextValue();
+        else if (argument == "--staging-size")
+            result.stagingBufferMegabytes = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--instances")
+            result.instanceCount = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--scene")
+            result.scene = parseApplicationOptionScene(argument, nextValue());
+        else if (argument == "--blend")
+            result.blendMode = parseApplicationOptionBlendMode(argument, nextValue());
+        else if (argument == "--draws")
+            result.drawCount = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--record-threads")
+            result.recordThreadCount = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--upload-benchmark")
+            result.uploadBenchmarkMegabytes = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--present-mode")
+            result.presentMode = parseApplicationOptionPresentMode(argument, nextValue());
+        else if (argument == "--frame-pacing")
+            result.framePacing = true;
+        else if (argument == "--gpu-culling")
+            result.gpuCulling = true;
+        else if (argument == "--cpu-culling")
+            result.cpuCulling = true;
+        else if (argument == "--zoom")
+            result.zoom = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--on-demand")
+            result.onDemand = true;
+        else if (argument == "--redraw-interval")
+            result.redrawIntervalMilliseconds = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--resize-every")
+            result.headlessResizeInterval = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--report-json")
+            result.reportJsonPath = nextValue();
+        else if (argument == "--golden")
+            result.goldenImagePath = nextValue();
+        else if (argument == "--golden-tolerance")
+            result.goldenTolerance = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--update-golden")
+            result.updateGoldenImage = true;
+        else if (argument == "--capture")
+            result.captureDirectory = nextValue();
+        else if (argument == "--capture-format")
+            result.captureFormat = parseApplicationOptionCaptureFormat(argument, nextValue());
+        else if (argument == "--capture-ring")
+            result.captureRingSize = parseApplicationOptionUint(argument, nextValue());
+        else if (argument == "--record-every-frame")
+            result.recordEveryFrame = true;
+        else if (argument == "--help" || argument == "-h") {
+            printApplicationOptionsUsage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else
+            throw std::runtime_error("Unknown option '" + std::string(argument) + "' (see --help)");
+    }
+
+    if (result.headless && result.headlessFrameCount == 0)
+        throw std::runtime_error("Rendering 0 frames headless doesn't make much sense");
+
+    // Past a handful of frames in flight, all we'd get is more latency (and more memory used)
+    if (result.framesInFlight < 1 || result.framesInFlight > 16)
+        throw std::runtime_error("The number of frames in flight must be between 1 and 16");
+
+    if (result.instanceCount == 0)
+        throw std::runtime_error("Drawing 0 instances doesn't make much sense");
+
+    if (result.drawCount == 0 || result.drawCount > result.instanceCount)
+        throw std::runtime_error("The number of draws must be between 1 and the number of instances");
+
+    // More threads than that would just fight over the cores
+    if (result.recordThreadCount > 64)
+        throw std::runtime_error("The number of recording threads must be between 0 and 64");
+
+    // The whole draw list becomes a single indirect draw, so there's nothing left to split over threads
+    if (result.gpuCulling && result.recordThreadCount != 0)
+        throw std::runtime_error("GPU culling can't be combined with recording threads");
+    if (result.gpuCulling && result.cpuCulling)
+        throw std::runtime_error("Instances can be culled on the CPU or on the GPU, but not both");
+
+    if (result.zoom < 1 || result.zoom > 1024)
+        throw std::runtime_error("The zoom factor must be between 1 and 1024");
+
+    // There's nothing asking for redraws without a window, and the pacer would take the time we spend idle for frames taking forever
+    if (result.onDemand && result.headless)
+        throw std::runtime_error("On-demand rendering needs a window");
+    if (result.onDemand && result.framePacing)
+        throw std::runtime_error("On-demand rendering can't be combined with frame pacing");
+    if (result.redrawIntervalMilliseconds != 0 && !result.onDemand)
+        throw std::runtime_error("The redraw interval only applies to on-demand rendering");
+
+    // There's only ever a last frame to check, and a run to report on, when rendering a set number of frames
+    if (!result.headless && (result.headlessResizeInterval != 0 || !result.reportJsonPath.empty() || !result.goldenImagePath.empty()))
+        throw std::runtime_error("Resizing every few frames, JSON reports and golden images need --headless");
+    if (result.updateGoldenImage && result.goldenImagePath.empty())
+        throw std::runtime_error("Updating the golden image needs a path for it (see --golden)");
+    if (result.goldenTolerance > 255)
+        throw std::runtime_error("The golden image tolerance must be between 0 and 255");
+
+    if (result.captureRingSize > 64)
+        throw std::runtime_error("The capture ring size must be between 1 and 64 (or 0 to pick one)");
+
+    // The ring gets split into a few segments, each of which needs to hold something
+    if (result.stagingBufferMegabytes < 1 || result.stagingBufferMegabytes > 1024)
+        throw std::runtime_error("The staging buffer size must be between 1 and 1024 MB");
+
+    return result;
+}
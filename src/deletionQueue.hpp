@@ -0,0 +1,54 @@
+#pragma once
+
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+// Holds on to the destruction of Vulkan objects until the GPU is guaranteed to be done with them, so that we can replace things (swap chains, pipelines, buffers, ...) while frames are still in flight instead of waiting for the whole device to go idle
+// Deletions are tagged with the timeline value of the last work that might still be using the object (usually the last submission when they were queued), and run once the GPU's timeline is known to have reached it
+class deletionQueue {
+    struct pendingDeletion {
+        std::uint64_t lastUsingTimelineValue;
+        std::function<void()> destroy;
+    };
+
+    // Kept sorted by timeline value (deletions that must wait for more than the last submission can come in out of order), so that we only ever need to look at the front
+    std::deque<pendingDeletion> pendingDeletions;
+
+public:
+    deletionQueue() = default;
+
+    deletionQueue(const deletionQueue &) = delete;
+    deletionQueue &operator=(const deletionQueue &) = delete;
+
+    void push(std::uint64_t lastUsingTimelineValue, std::function<void()> destroy)
+    {
+        // Usually the value only goes up and this is the end, but after anything with the same value, so that those still run in the order they were queued
+        auto position = std::upper_bound(this->pendingDeletions.begin(), this->pendingDeletions.end(), lastUsingTimelineValue, [](std::uint64_t value, const pendingDeletion &deletion) { return value < deletion.lastUsingTimelineValue; });
+        this->pendingDeletions.insert(position, { lastUsingTimelineValue, std::move(destroy) });
+    }
+
+    // Destroys everything that only work up to completedTimelineValue could have been using, in the order it was queued
+    void flush(std::uint64_t completedTimelineValue)
+    {
+        while (!this->pendingDeletions.empty() && this->pendingDeletions.front().lastUsingTimelineValue <= completedTimelineValue) {
+            // Popping before calling means a throwing destroy function doesn't get called again on the next flush
+            auto destroy = std::move(this->pendingDeletions.front().destroy);
+            this->pendingDeletions.pop_front();
+            destroy();
+        }
+    }
+
+    // Only to be called once the device is idle (e.g. on shutdown)
+    void flushAll()
+    {
+        this->flush(UINT64_MAX);
+    }
+
+    bool empty() const
+    {
+        return this->pendingDeletions.empty();
+    }
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "spirvBlob.hpp"
+
+#include <string>
+#include <array>
+#include <iterator>
+#include <stdexcept>
+#include <cstdint>
+
+// The SPIR-V for all of our shaders, baked right into the binary so that we neither have to read files on startup nor care about which directory we're launched from
+// The .spv.inc files are made by the Makefile with glslc -mfmt=num, which outputs the code as a comma-separated list of 32-bit words (and using std::uint32_t arrays means we get the alignment Vulkan wants for free)
+inline constexpr std::uint32_t embeddedVertShaderWords[] = {
+#include "../shaders/vert.spv.inc"
+};
+
+inline constexpr std::uint32_t embeddedFragShaderWords[] = {
+#include "../shaders/frag.spv.inc"
+};
+
+inline constexpr std::uint32_t embeddedCullShaderWords[] = {
+#include "../shaders/cull.spv.inc"
+};
+
+struct embeddedShader {
+    const char *fileName; // What the shader is called when it's a file, so that it can be looked up by the same name either way
+    spirvCodeView code;
+};
+
+inline constexpr std::array<embeddedShader, 3> embeddedShaders = {
+    {
+        { "vert.spv", { embeddedVertShaderWords, std::size(embeddedVertShaderWords) } },
+        { "frag.spv", { embeddedFragShaderWords, std::size(embeddedFragShaderWords) } },
+        { "cull.spv", { embeddedCullShaderWords, std::size(embeddedCullShaderWords) } },
+    }
+};
+
+[[nodiscard]] inline spirvCodeView findEmbeddedShaderCode(const std::string &fileName)
+{
+    for (const auto &shader : embeddedShaders)
+        if (fileName == shader.fileName) {
+            validateSpirvCode(shader.code, "Embedded " + fileName);
+            return shader.code;
+        }
+
+    throw std::runtime_error("No embedded shader called " + fileName);
+}
@@ -0,0 +1,513 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include "gpuMemoryAllocator.hpp"
+#include "applicationOptions.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <array>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+// Encodes 8-bit, 4-channel pixels (tightly packed rows) as a QOI image, swapping the red and blue channels on the way if they're stored as BGRA
+// The pixels are written as they are, so for _SRGB formats that's sRGB, which is what the header says (QOI has no way to say anything more specific anyway)
+[[nodiscard]] inline std::string encodeQoiImage(const std::byte *pixels, std::uint32_t width, std::uint32_t height, bool isBgra)
+{
+    struct rgba {
+        std::uint8_t r, g, b, a;
+
+        bool operator==(const rgba &other) const
+        {
+            return this->r == other.r && this->g == other.g && this->b == other.b && this->a == other.a;
+        }
+    };
+
+    std::string result;
+    result.reserve(14 + std::size_t(width) * height * 5 / 4 + 8); // Most frames compress well, and the worst case (every pixel as QOI_OP_RGBA) just grows it
+
+    auto writeUint32 = [&](std::uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            result += static_cast<char>((value >> shift) & 0xff);
+    };
+    result += "qoif";
+    writeUint32(width);
+    writeUint32(height);
+    result += static_cast<char>(4); // Channels
+    result += static_cast<char>(0); // sRGB with linear alpha
+
+    std::array<rgba, 64> seenPixels = {};
+    rgba previousPixel = { 0, 0, 0, 255 };
+    std::uint32_t runLength = 0;
+    std::size_t pixelCount = std::size_t(width) * height;
+
+    for (std::size_t i = 0; i < pixelCount; ++i) {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(pixels + i * 4);
+        rgba pixel = { bytes[isBgra ? 2 : 0], bytes[1], bytes[isBgra ? 0 : 2], bytes[3] };
+
+        if (pixel == previousPixel) {
+            ++runLength;
+            if (runLength == 62 || i + 1 == pixelCount) {
+                result += static_cast<char>(0xc0 | (runLength - 1)); // QOI_OP_RUN
+                runLength = 0;
+            }
+            continue;
+        }
+
+        if (runLength != 0) {
+            result += static_cast<char>(0xc0 | (runLength - 1));
+            runLength = 0;
+        }
+
+        auto hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+        if (seenPixels.at(hash) == pixel)
+            result += static_cast<char>(hash); // QOI_OP_INDEX
+        else {
+            seenPixels.at(hash) = pixel;
+
+            // The differences wrap around, so they're computed on bytes
+            auto redDifference = static_cast<std::int8_t>(pixel.r - previousPixel.r);
+            auto greenDifference = static_cast<std::int8_t>(pixel.g - previousPixel.g);
+            auto blueDifference = static_cast<std::int8_t>(pixel.b - previousPixel.b);
+            auto redGreenDifference = static_cast<std::int8_t>(redDifference - greenDifference);
+            auto blueGreenDifference = static_cast<std::int8_t>(blueDifference - greenDifference);
+
+            if (pixel.a != previousPixel.a) {
+                result += static_cast<char>(0xff); // QOI_OP_RGBA
+                result += static_cast<char>(pixel.r);
+                result += static_cast<char>(pixel.g);
+                result += static_cast<char>(pixel.b);
+                result += static_cast<char>(pixel.a);
+            } else if (redDifference >= -2 && redDifference <= 1 && greenDifference >= -2 && greenDifference <= 1 && blueDifference >= -2 && blueDifference <= 1)
+                result += static_cast<char>(0x40 | (redDifference + 2) << 4 | (greenDifference + 2) << 2 | (blueDifference + 2)); // QOI_OP_DIFF
+            else if (greenDifference >= -32 && greenDifference <= 31 && redGreenDifference >= -8 && redGreenDifference <= 7 && blueGreenDifference >= -8 && blueGreenDifference <= 7) {
+                result += static_cast<char>(0x80 | (greenDifference + 32)); // QOI_OP_LUMA
+                result += static_cast<char>((redGreenDifference + 8) << 4 | (blueGreenDifference + 8));
+            } else {
+                result += static_cast<char>(0xfe); // QOI_OP_RGB
+                result += static_cast<char>(pixel.r);
+                result += static_cast<char>(pixel.g);
+                result += static_cast<char>(pixel.b);
+            }
+        }
+        previousPixel = pixel;
+    }
+
+    result.append(7, '\0');
+    result += static_cast<char>(1);
+    return result;
+}
+
+struct decodedImage {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::vector<std::uint8_t> pixels; // RGBA, tightly packed rows
+};
+
+// The other way around, for reading back what we (or any other QOI encoder) wrote, and nothing if the data isn't a valid 4-channel QOI image
+[[nodiscard]] inline std::optional<decodedImage> decodeQoiImage(std::string_view data)
+{
+    if (data.size() < 22 || data.substr(0, 4) != "qoif")
+        return std::nullopt;
+
+    auto readUint32 = [&](std::size_t offset) {
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+            value = value << 8 | static_cast<std::uint8_t>(data.at(offset + i));
+        return value;
+    };
+
+    decodedImage result;
+    result.width = readUint32(4);
+    result.height = readUint32(8);
+    std::size_t pixelCount = std::size_t(result.width) * result.height;
+    if (result.width == 0 || result.height == 0 || pixelCount > (std::size_t(1) << 28)) // Anything bigger than that is much more likely to be garbage than a frame of ours
+        return std::nullopt;
+    result.pixels.reserve(pixelCount * 4);
+
+    std::array<std::array<std::uint8_t, 4>, 64> seenPixels = {};
+    std::array<std::uint8_t, 4> pixel = { 0, 0, 0, 255 };
+    std::size_t position = 14;
+    auto nextByte = [&]() -> std::uint8_t { return position < data.size() ? static_cast<std::uint8_t>(data.at(position++)) : 0; };
+
+    while (result.pixels.size() < pixelCount * 4) {
+        if (position >= data.size())
+            return std::nullopt;
+
+        std::uint8_t tag = nextByte();
+        std::uint32_t repeatCount = 1;
+        if (tag == 0xfe) {
+            for (std::size_t i = 0; i < 3; ++i)
+                pixel.at(i) = nextByte();
+        } else if (tag == 0xff) {
+            for (std::size_t i = 0; i < 4; ++i)
+                pixel.at(i) = nextByte();
+        } else if ((tag >> 6) == 0)
+            pixel = seenPixels.at(tag);
+        else if ((tag >> 6) == 1) {
+            pixel.at(0) += ((tag >> 4) & 3) - 2;
+            pixel.at(1) += ((tag >> 2) & 3) - 2;
+            pixel.at(2) += (tag & 3) - 2;
+        } else if ((tag >> 6) == 2) {
+            int greenDifference = (tag & 63) - 32;
+            std::uint8_t otherDifferences = nextByte();
+            pixel.at(0) += greenDifference + (otherDifferences >> 4) - 8;
+            pixel.at(1) += greenDifference;
+            pixel.at(2) += greenDifference + (otherDifferences & 15) - 8;
+        } else
+            repeatCount = (tag & 63) + 1u;
+
+        seenPixels.at((pixel.at(0) * 3 + pixel.at(1) * 5 + pixel.at(2) * 7 + pixel.at(3) * 11) % 64) = pixel;
+        for (std::uint32_t i = 0; i < repeatCount && result.pixels.size() < pixelCount * 4; ++i)
+            result.pixels.insert(result.pixels.end(), pixel.begin(), pixel.end());
+    }
+
+    return result;
+}
+
+struct imageDifference {
+    std::size_t differingPixelCount = 0; // Pixels with at least one channel that's off by more than the tolerance
+    std::uint32_t maxChannelDifference = 0;
+};
+
+// Compares 8-bit, 4-channel pixels (tightly packed rows, RGBA or BGRA) against a reference of the same size
+[[nodiscard]] inline imageDifference compareImages(const std::byte *pixels, bool isBgra, const decodedImage &reference, std::uint32_t tolerance)
+{
+    imageDifference result;
+    std::size_t pixelCount = std::size_t(reference.width) * reference.height;
+    for (std::size_t i = 0; i < pixelCount; ++i) {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(pixels + i * 4);
+        std::array<std::uint8_t, 4> pixel = { { bytes[isBgra ? 2 : 0], bytes[1], bytes[isBgra ? 0 : 2], bytes[3] } };
+
+        std::uint32_t pixelDifference = 0;
+        for (std::size_t channel = 0; channel < 4; ++channel)
+            pixelDifference = std::max<std::uint32_t>(pixelDifference, std::abs(int(pixel.at(channel)) - int(reference.pixels.at(i * 4 + channel))));
+        result.maxChannelDifference = std::max(result.maxChannelDifference, pixelDifference);
+        if (pixelDifference > tolerance)
+            ++result.differingPixelCount;
+    }
+    return result;
+}
+
+// Records a copy of a color image into a buffer (as tightly packed rows) that the host can read once the commands are done, for an image that has come out of a render pass in currentLayout (and is left in it)
+inline void recordImageReadback(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout currentLayout, VkExtent2D extent, VkBuffer buffer)
+{
+    VkImageMemoryBarrier imageMemoryBarrier = {};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = image;
+    imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // An image that ends the frame ready to be copied from has already been made visible to transfers by the render pass, anything else (i.e. swap chain images about to be presented) needs to go through TRANSFER_SRC and back
+    // The render pass transitions to the final layout at the bottom of the pipe, which is what we chain with, and the color attachment writes are what we need to see
+    bool needsTransition = currentLayout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    if (needsTransition) {
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageMemoryBarrier.oldLayout = currentLayout;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+    }
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // Tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { extent.width, extent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+    // Reads don't need making visible to anything, and presentation waits on a semaphore that comes after all of this anyway
+    if (needsTransition) {
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = 0;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageMemoryBarrier.newLayout = currentLayout;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+    }
+
+    // Signalling a semaphore or a fence doesn't make anything visible to the host by itself
+    VkBufferMemoryBarrier bufferMemoryBarrier = {};
+    bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferMemoryBarrier.buffer = buffer;
+    bufferMemoryBarrier.offset = 0;
+    bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+}
+
+// Copies rendered frames into a ring of host-visible buffers and has a background thread write them to disk, so that capturing never makes a frame wait on anything
+// Each slot of the ring goes free -> in flight (the GPU is copying into it) -> queued -> being written -> free again, and a frame that finds no free slot simply doesn't get captured, which is what happens when the writer can't keep up
+// Everything but the writer thread itself must be used from a single thread
+class frameCapture {
+    enum class slotState {
+        free,
+        inFlight,
+        queued,
+        writing,
+    };
+
+    struct slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        gpuAllocation allocation;
+        VkDeviceSize capacity = 0;
+        VkExtent2D extent = {};
+        std::uint64_t frameNumber = 0;
+        std::uint64_t timelineValue = 0; // What the graphics timeline reaches once the copy is done
+        slotState state = slotState::free;
+    };
+
+    VkDevice vulkanDevice = VK_NULL_HANDLE;
+    gpuMemoryAllocator *allocator = nullptr;
+    bool isBgra;
+    std::string directory;
+    frameCaptureFormat format;
+
+    std::vector<slot> slots;
+    std::uint64_t nextFrameNumber = 0; // Counts dropped frames too, so that they show up as gaps in the file names
+    std::uint64_t droppedFrameCount = 0;
+    bool hasReportedDroppedFrames = false;
+
+    // Shared with the writer thread
+    std::mutex mutex;
+    std::condition_variable writerCondition; // Something got queued, or we're stopping
+    std::condition_variable idleCondition; // The writer finished a slot
+    std::deque<std::size_t> writeQueue;
+    bool isStopping = false;
+    std::uint64_t writtenFrameCount = 0;
+    std::uint64_t failedFrameCount = 0;
+    std::chrono::steady_clock::duration writeTime = std::chrono::steady_clock::duration::zero();
+
+    std::thread writerThread; // Last, so that everything it uses is there before it starts
+
+    static constexpr std::array<const char *, 2> formatExtensions = { { "raw", "qoi" } };
+
+    void writeSlot(const slot &capturedSlot)
+    {
+        std::array<char, 32> fileName;
+        std::snprintf(fileName.data(), fileName.size(), "frame_%06llu.%s", static_cast<unsigned long long>(capturedSlot.frameNumber), formatExtensions.at(static_cast<std::size_t>(this->format)));
+
+        auto size = std::size_t(capturedSlot.extent.width) * capturedSlot.extent.height * 4;
+        std::string_view contents(reinterpret_cast<const char *>(capturedSlot.allocation.mappedData), size);
+        std::string encodedContents;
+        if (this->format == frameCaptureFormat::qoi) {
+            encodedContents = encodeQoiImage(capturedSlot.allocation.mappedData, capturedSlot.extent.width, capturedSlot.extent.height, this->isBgra);
+            contents = encodedContents;
+        }
+
+        auto path = std::filesystem::path(this->directory) / fileName.data();
+        std::ofstream fileStream(path, std::ios::binary | std::ios::trunc);
+        fileStream.write(contents.data(), contents.size());
+        if (fileStream.fail())
+            throw std::runtime_error("Failure to write to " + path.string());
+    }
+
+    void runWriter()
+    {
+        std::unique_lock lock(this->mutex);
+        for (;;) {
+            this->writerCondition.wait(lock, [&]() { return !this->writeQueue.empty() || this->isStopping; });
+            if (this->writeQueue.empty())
+                return; // Only once everything queued has been written, so that stopping never loses frames we already have
+
+            auto slotIndex = this->writeQueue.front();
+            this->writeQueue.pop_front();
+            auto &capturedSlot = this->slots.at(slotIndex);
+            capturedSlot.state = slotState::writing;
+            lock.unlock();
+
+            // The main thread leaves slots alone while we're writing them, so this doesn't need the lock
+            auto startTime = std::chrono::steady_clock::now();
+            bool hasFailed = false;
+            try {
+                this->writeSlot(capturedSlot);
+            } catch (const std::exception &exception) {
+                std::cerr << "Frame capture: " << exception.what() << '\n';
+                hasFailed = true;
+            }
+            auto elapsedTime = std::chrono::steady_clock::now() - startTime;
+
+            lock.lock();
+            capturedSlot.state = slotState::free;
+            this->writeTime += elapsedTime;
+            ++(hasFailed ? this->failedFrameCount : this->writtenFrameCount);
+            this->idleCondition.notify_all();
+        }
+    }
+
+    // Slots start out empty and grow to whatever the frame they capture needs, which also takes care of the swap chain getting resized
+    void ensureSlotCapacity(slot &freeSlot, VkDeviceSize size)
+    {
+        if (freeSlot.capacity >= size)
+            return;
+
+        if (freeSlot.buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(this->vulkanDevice, freeSlot.buffer, nullptr);
+            this->allocator->free(freeSlot.allocation);
+        }
+
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(this->vulkanDevice, &bufferCreateInfo, nullptr, &freeSlot.buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create frame capture buffer");
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(this->vulkanDevice, freeSlot.buffer, &memoryRequirements);
+
+        // Reading from uncached memory (which is what host-visible memory usually is, since it's meant for the CPU to write to) is painfully slow, so we want cached memory if there's any
+        // Either way we ask for coherent memory, so that there's nothing to invalidate before reading (cached memory that isn't coherent is pretty much unheard of)
+        VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (this->allocator->hasMemoryType(memoryRequirements.memoryTypeBits, memoryProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+            memoryProperties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+        freeSlot.allocation = this->allocator->allocate(memoryRequirements, memoryProperties, gpuResourceKind::linear);
+        vkBindBufferMemory(this->vulkanDevice, freeSlot.buffer, freeSlot.allocation.memory, freeSlot.allocation.offset);
+        freeSlot.capacity = size;
+    }
+
+public:
+    // Only 8-bit, 4-channel formats can be captured, which covers everything we'd pick for the swap chain in practice
+    static bool isFormatSupported(VkFormat format)
+    {
+        return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    frameCapture(VkDevice device, gpuMemoryAllocator &allocator, VkFormat imageFormat, std::uint32_t slotCount, std::string directory, frameCaptureFormat format)
+        : vulkanDevice(device), allocator(&allocator), isBgra(imageFormat == VK_FORMAT_B8G8R8A8_SRGB || imageFormat == VK_FORMAT_B8G8R8A8_UNORM), directory(std::move(directory)), format(format), slots(slotCount)
+    {
+        if (!isFormatSupported(imageFormat))
+            throw std::runtime_error("Frame capture only supports 8-bit RGBA and BGRA images");
+
+        std::filesystem::create_directories(this->directory);
+        this->writerThread = std::thread([this]() { this->runWriter(); });
+    }
+
+    // Whatever is still queued gets written first, but frames the GPU might still be copying are the caller's to wait for (see finish)
+    ~frameCapture()
+    {
+        {
+            std::lock_guard lock(this->mutex);
+            this->isStopping = true;
+        }
+        this->writerCondition.notify_one();
+        this->writerThread.join();
+
+        for (auto &capturedSlot : this->slots)
+            if (capturedSlot.buffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(this->vulkanDevice, capturedSlot.buffer, nullptr);
+                this->allocator->free(capturedSlot.allocation);
+            }
+    }
+
+    frameCapture(const frameCapture &) = delete;
+    frameCapture &operator=(const frameCapture &) = delete;
+
+    // Called for every frame, and returns the slot it gets captured into (nothing if the ring is full, in which case the frame is dropped)
+    // The slot is only taken once markSubmitted is called, so the frame must be submitted before the next one begins its capture
+    std::optional<std::size_t> beginCapture(VkExtent2D extent)
+    {
+        auto frameNumber = this->nextFrameNumber++;
+
+        std::optional<std::size_t> freeSlotIndex;
+        {
+            std::lock_guard lock(this->mutex);
+            for (std::size_t i = 0; i < this->slots.size() && !freeSlotIndex.has_value(); ++i)
+                if (this->slots.at(i).state == slotState::free)
+                    freeSlotIndex = i;
+        }
+
+        if (!freeSlotIndex.has_value()) {
+            ++this->droppedFrameCount;
+            if (!this->hasReportedDroppedFrames) {
+                std::cerr << "Frame capture can't keep up, dropping frames (see the report on exit for how many)\n";
+                this->hasReportedDroppedFrames = true;
+            }
+            return std::nullopt;
+        }
+
+        // Free slots are ours alone until they're queued again, so the writer can't be looking at this one
+        auto &freeSlot = this->slots.at(freeSlotIndex.value());
+        this->ensureSlotCapacity(freeSlot, VkDeviceSize(extent.width) * extent.height * 4);
+        freeSlot.extent = extent;
+        freeSlot.frameNumber = frameNumber;
+        return freeSlotIndex;
+    }
+
+    // Copies the image into the slot once everything recorded before is done rendering to it
+    // The image is expected to have come out of the render pass in currentLayout, and is left in it
+    void recordCopy(VkCommandBuffer commandBuffer, std::size_t slotIndex, VkImage image, VkImageLayout currentLayout)
+    {
+        const auto &capturedSlot = this->slots.at(slotIndex);
+        recordImageReadback(commandBuffer, image, currentLayout, capturedSlot.extent, capturedSlot.buffer);
+    }
+
+    void markSubmitted(std::size_t slotIndex, std::uint64_t timelineValue)
+    {
+        auto &capturedSlot = this->slots.at(slotIndex);
+        capturedSlot.timelineValue = timelineValue;
+
+        std::lock_guard lock(this->mutex);
+        capturedSlot.state = slotState::inFlight;
+    }
+
+    // Hands every slot the GPU is done copying into over to the writer, without waiting on anything
+    void collect(std::uint64_t completedTimelineValue)
+    {
+        bool hasQueuedAny = false;
+        {
+            std::lock_guard lock(this->mutex);
+            for (std::size_t i = 0; i < this->slots.size(); ++i) {
+                auto &capturedSlot = this->slots.at(i);
+                if (capturedSlot.state == slotState::inFlight && capturedSlot.timelineValue <= completedTimelineValue) {
+                    capturedSlot.state = slotState::queued;
+                    this->writeQueue.push_back(i);
+                    hasQueuedAny = true;
+                }
+            }
+        }
+        if (hasQueuedAny)
+            this->writerCondition.notify_one();
+    }
+
+    // For when we're about to stop: the GPU must be done with everything (i.e. completedTimelineValue is the last value submitted), and we wait for all of it to be on disk
+    void finish(std::uint64_t completedTimelineValue)
+    {
+        this->collect(completedTimelineValue);
+
+        std::unique_lock lock(this->mutex);
+        this->idleCondition.wait(lock, [&]() { return std::none_of(this->slots.begin(), this->slots.end(), [](const slot &capturedSlot) { return capturedSlot.state == slotState::queued || capturedSlot.state == slotState::writing; }); });
+    }
+
+    void printStats(std::ostream &stream)
+    {
+        std::lock_guard lock(this->mutex);
+        auto averageWriteTime = std::chrono::duration<double, std::milli>(this->writeTime).count() / std::max<std::uint64_t>(this->writtenFrameCount + this->failedFrameCount, 1);
+        stream << "Frame capture: " << this->writtenFrameCount << " frames written to " << this->directory << " as " << formatExtensions.at(static_cast<std::size_t>(this->format)) << " (" << std::fixed << std::setprecision(2) << averageWriteTime << "ms each on average), "
+               << this->droppedFrameCount << " dropped because the writer fell behind, " << this->failedFrameCount << " failed to write\n";
+    }
+};
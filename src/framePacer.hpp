@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <thread>
+
+// Delays the start of each frame (and with it, the moment we sample input) so that the CPU work lands just before the GPU and the display need it, instead of as early as possible
+// When we're limited by the display (e.g. with FIFO), rendering as fast as we can just means frames pile up waiting for their turn to be shown, with every one of them showing input that's that much older. Sleeping before sampling input moves that wait to where it doesn't hurt
+// The caller waits for the previous frame to be done before every frame, and we learn the display's pace from how far apart those completions are and how long a frame takes us from start to completion when nothing blocks it, then sleep off the difference (minus some margin for when a frame takes longer than usual)
+class framePacer {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr double smoothing = .1; // How much each new frame moves the estimates, which smooths over the odd slow frame without taking forever to adapt
+    static constexpr std::chrono::duration<double> safetyMargin = std::chrono::milliseconds(2);
+
+    bool enabled;
+
+    std::optional<clock::time_point> previousCompletionTime;
+    std::optional<clock::time_point> frameStartTime;
+    clock::duration frameBlockedTime = clock::duration::zero(); // Time spent in the current frame waiting on something we'd rather wait on before it (like acquiring a swap chain image)
+
+    std::chrono::duration<double> intervalEstimate = std::chrono::duration<double>::zero();
+    std::chrono::duration<double> busyEstimate = std::chrono::duration<double>::zero();
+
+    static std::chrono::duration<double> updateEstimate(std::chrono::duration<double> estimate, std::chrono::duration<double> sample)
+    {
+        return estimate == std::chrono::duration<double>::zero() ? sample : estimate + (sample - estimate) * smoothing;
+    }
+
+public:
+    explicit framePacer(bool enabled)
+        : enabled(enabled)
+    {
+    }
+
+    bool isEnabled() const
+    {
+        return this->enabled;
+    }
+
+    // Must be called once the previous frame is done on the GPU, with the time it was seen done, and returns once the next frame should start
+    void waitForNextFrameStart(clock::time_point previousFrameCompletionTime)
+    {
+        if (!this->enabled)
+            return;
+
+        if (this->previousCompletionTime.has_value())
+            this->intervalEstimate = updateEstimate(this->intervalEstimate, previousFrameCompletionTime - this->previousCompletionTime.value());
+        if (this->frameStartTime.has_value())
+            this->busyEstimate = updateEstimate(this->busyEstimate, previousFrameCompletionTime - this->frameStartTime.value() - this->frameBlockedTime);
+        this->previousCompletionTime = previousFrameCompletionTime;
+
+        // Frames that take longer than the interval (i.e. we're not display-limited) just start right away
+        auto sleepTime = this->intervalEstimate - this->busyEstimate - safetyMargin;
+        if (sleepTime > std::chrono::duration<double>::zero())
+            std::this_thread::sleep_for(sleepTime);
+
+        this->frameStartTime = clock::now();
+        this->frameBlockedTime = clock::duration::zero();
+    }
+
+    void addBlockedTime(clock::duration duration)
+    {
+        this->frameBlockedTime += duration;
+    }
+};
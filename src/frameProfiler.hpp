@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+// The parts of drawFrame that we time on the CPU side
+enum class frameProfilerPhase : std::size_t {
+    frameWait,
+    sceneUpdate, // Only with CPU culling, and only the part the main thread spends on it (running it, or waiting for the workers to be done with it)
+    acquire,
+    record,
+    submit,
+    present,
+    count, // Not an actual phase, just how many of them there are
+};
+
+// Keeps track of where the time goes in each frame, both on the CPU (with high-resolution timers around each phase of drawFrame) and on the GPU (with timestamp queries around the render pass)
+// Only the last historySize frames are kept around (in ring buffers), so that we can run for as long as we want without the history growing forever
+class frameProfiler {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t phaseCount = static_cast<std::size_t>(frameProfilerPhase::count);
+    static constexpr std::array<const char *, phaseCount> phaseNames = {
+        {
+            "frame wait",
+            "scene update",
+            "acquire",
+            "record",
+            "submit",
+            "present",
+        }
+    };
+
+    struct frameSample {
+        std::array<double, phaseCount> phaseMilliseconds = {};
+        double cpuFrameMilliseconds = 0; // From the start of drawFrame to the end of it
+        double frameIntervalMilliseconds = 0; // From the start of the previous frame to the start of this one, i.e. the inverse of our frame rate
+    };
+
+    // Fixed-size history that just overwrites the oldest entry once full
+    template <typename T>
+    class ringBuffer {
+        std::vector<T> entries;
+        std::size_t nextIndex = 0;
+        std::size_t entryCount = 0;
+
+    public:
+        explicit ringBuffer(std::size_t capacity)
+            : entries(capacity)
+        {
+        }
+
+        void push(const T &entry)
+        {
+            this->entries.at(this->nextIndex) = entry;
+            this->nextIndex = (this->nextIndex + 1) % this->entries.size();
+            this->entryCount = std::min(this->entryCount + 1, this->entries.size());
+        }
+
+        // The order of the entries doesn't matter to us, since all we do with them is compute percentiles
+        template <typename Function>
+        std::vector<double> collect(Function &&function) const
+        {
+            std::vector<double> result;
+            result.reserve(this->entryCount);
+            for (std::size_t i = 0; i < this->entryCount; ++i)
+                result.push_back(function(this->entries.at(i)));
+            return result;
+        }
+
+        std::size_t size() const
+        {
+            return this->entryCount;
+        }
+    };
+
+    bool enabled = false;
+
+    ringBuffer<frameSample> frameHistory;
+    ringBuffer<double> gpuHistory; // Separate from frameHistory since GPU timings only come back frames after the CPU side is done
+    ringBuffer<double> latencyHistory; // From the start of a frame on the CPU to us seeing it reached on the timeline, which is what more frames in flight makes worse (we look at the start of every frame, so it's off by at most one frame interval)
+    ringBuffer<double> inputLatencyHistory; // From sampling input for a frame to the GPU being done rendering it (as seen from the CPU, see collectCompletedFrame), which is most of the motion-to-photon latency we control (presenting and the display add their own on top)
+    std::uint64_t totalFrameCount = 0;
+
+    frameSample currentSample;
+    clock::time_point currentFrameStart;
+    clock::time_point previousFrameStart;
+    bool hasPreviousFrame = false;
+    std::optional<clock::time_point> currentInputSampleTime;
+
+    VkDevice vulkanDevice = VK_NULL_HANDLE;
+    VkQueryPool vulkanTimestampQueryPool = VK_NULL_HANDLE; // Two timestamps (before and after the render pass) for every frame in flight
+    double timestampPeriodNanoseconds = 0;
+    std::uint64_t timestampValidMask = 0;
+    std::uint32_t framesInFlight;
+    std::vector<bool> areGpuTimestampsPending; // Whether a frame in flight has written timestamps that we haven't read back yet
+    std::vector<std::optional<clock::time_point>> submittedFrameStarts; // When each frame in flight that we haven't seen complete yet was started
+    std::vector<std::optional<clock::time_point>> submittedInputSampleTimes; // Likewise, for when their input was sampled
+
+    static double toMilliseconds(clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+public:
+    // Times a phase for as long as it's alive
+    class scopedPhaseTimer {
+        frameProfiler &profiler;
+        frameProfilerPhase phase;
+        clock::time_point startTime;
+
+    public:
+        scopedPhaseTimer(frameProfiler &profiler, frameProfilerPhase phase)
+            : profiler(profiler), phase(phase), startTime(profiler.enabled ? clock::now() : clock::time_point())
+        {
+        }
+
+        ~scopedPhaseTimer()
+        {
+            if (this->profiler.enabled)
+                this->profiler.currentSample.phaseMilliseconds.at(static_cast<std::size_t>(this->phase)) += frameProfiler::toMilliseconds(clock::now() - this->startTime);
+        }
+
+        scopedPhaseTimer(const scopedPhaseTimer &) = delete;
+        scopedPhaseTimer &operator=(const scopedPhaseTimer &) = delete;
+    };
+
+    frameProfiler(bool enabled, std::uint32_t framesInFlight, std::size_t historySize = 1024)
+        : enabled(enabled), frameHistory(historySize), gpuHistory(historySize), latencyHistory(historySize), inputLatencyHistory(historySize), framesInFlight(framesInFlight), areGpuTimestampsPending(framesInFlight, false), submittedFrameStarts(framesInFlight), submittedInputSampleTimes(framesInFlight)
+    {
+    }
+
+    ~frameProfiler()
+    {
+        this->destroyGpuTimestamps();
+    }
+
+    frameProfiler(const frameProfiler &) = delete;
+    frameProfiler &operator=(const frameProfiler &) = delete;
+
+    bool isEnabled() const
+    {
+        return this->enabled;
+    }
+
+    // GPU timestamps are optional: not every queue supports them (timestampValidBits == 0), in which case we just time the CPU side
+    void initializeGpuTimestamps(VkDevice device, const VkPhysicalDeviceLimits &limits, const VkQueueFamilyProperties &queueFamilyProperties)
+    {
+        if (!this->enabled)
+            return;
+
+        if (queueFamilyProperties.timestampValidBits == 0) {
+            std::cerr << "Frame profiler: the graphics queue doesn't support timestamps, GPU times won't be available\n";
+            return;
+        }
+
+        this->vulkanDevice = device;
+        this->timestampPeriodNanoseconds = limits.timestampPeriod;
+        this->timestampValidMask = queueFamilyProperties.timestampValidBits >= 64 ? UINT64_MAX : (std::uint64_t(1) << queueFamilyProperties.timestampValidBits) - 1;
+
+        VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCreateInfo.queryCount = this->framesInFlight * 2;
+
+        if (vkCreateQueryPool(this->vulkanDevice, &queryPoolCreateInfo, nullptr, &this->vulkanTimestampQueryPool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create timestamp query pool");
+    }
+
+    void destroyGpuTimestamps()
+    {
+        if (this->vulkanTimestampQueryPool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(this->vulkanDevice, this->vulkanTimestampQueryPool, nullptr);
+        this->vulkanTimestampQueryPool = VK_NULL_HANDLE;
+    }
+
+    void beginFrame()
+    {
+        if (!this->enabled)
+            return;
+
+        this->currentFrameStart = clock::now();
+        this->currentSample = {};
+        if (this->hasPreviousFrame)
+            this->currentSample.frameIntervalMilliseconds = toMilliseconds(this->currentFrameStart - this->previousFrameStart);
+    }
+
+    // Headless frames don't have any input, so they just never call this
+    void markInputSampled()
+    {
+        if (this->enabled)
+            this->currentInputSampleTime = clock::now();
+    }
+
+    // Frames that get abandoned halfway through (e.g. because the swap chain had to be recreated) just never call this, so they don't pollute the history
+    void endFrame(std::uint32_t frameIndex)
+    {
+        if (!this->enabled)
+            return;
+
+        this->currentSample.cpuFrameMilliseconds = toMilliseconds(clock::now() - this->currentFrameStart);
+        this->frameHistory.push(this->currentSample);
+        this->submittedFrameStarts.at(frameIndex) = this->currentFrameStart;
+        this->submittedInputSampleTimes.at(frameIndex) = std::exchange(this->currentInputSampleTime, std::nullopt);
+        this->previousFrameStart = this->currentFrameStart;
+        this->hasPreviousFrame = true;
+        ++this->totalFrameCount;
+    }
+
+    scopedPhaseTimer measurePhase(frameProfilerPhase phase)
+    {
+        return scopedPhaseTimer(*this, phase);
+    }
+
+    // Must be called outside of the render pass, since that's where both resetting the queries and writing the first timestamp must happen
+    void writeBeginTimestamp(VkCommandBuffer commandBuffer, std::uint32_t frameIndex)
+    {
+        if (this->vulkanTimestampQueryPool == VK_NULL_HANDLE)
+            return;
+
+        vkCmdResetQueryPool(commandBuffer, this->vulkanTimestampQueryPool, frameIndex * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->vulkanTimestampQueryPool, frameIndex * 2);
+    }
+
+    void writeEndTimestamp(VkCommandBuffer commandBuffer, std::uint32_t frameIndex)
+    {
+        if (this->vulkanTimestampQueryPool == VK_NULL_HANDLE)
+            return;
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->vulkanTimestampQueryPool, frameIndex * 2 + 1);
+    }
+
+    // Command buffers can get submitted many times for a single recording, so it's submitting one with the timestamps in it that means there are results to collect
+    void markTimestampsSubmitted(std::uint32_t frameIndex)
+    {
+        if (this->vulkanTimestampQueryPool != VK_NULL_HANDLE)
+            this->areGpuTimestampsPending.at(frameIndex) = true;
+    }
+
+    // Must only be called once the frame's timeline value has been reached, as otherwise the GPU results might not be there yet, and as soon as possible after that, as otherwise the latencies include however long it took us to notice
+    // Calling it again for the same frame doesn't do anything, so it's fine to call it as soon as we know a frame is done and again once its slot comes around
+    void collectCompletedFrame(std::uint32_t frameIndex)
+    {
+        if (!this->enabled)
+            return;
+
+        auto completionTime = clock::now();
+        auto &submittedFrameStart = this->submittedFrameStarts.at(frameIndex);
+        if (submittedFrameStart.has_value()) {
+            this->latencyHistory.push(toMilliseconds(completionTime - submittedFrameStart.value()));
+            submittedFrameStart.reset();
+        }
+
+        auto &submittedInputSampleTime = this->submittedInputSampleTimes.at(frameIndex);
+        if (submittedInputSampleTime.has_value()) {
+            this->inputLatencyHistory.push(toMilliseconds(completionTime - submittedInputSampleTime.value()));
+            submittedInputSampleTime.reset();
+        }
+
+        if (this->vulkanTimestampQueryPool == VK_NULL_HANDLE || !this->areGpuTimestampsPending.at(frameIndex))
+            return;
+
+        std::array<std::uint64_t, 2> timestamps;
+        if (vkGetQueryPoolResults(this->vulkanDevice, this->vulkanTimestampQueryPool, frameIndex * 2, 2, sizeof(timestamps), timestamps.data(), sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+            return;
+        this->areGpuTimestampsPending.at(frameIndex) = false;
+
+        std::uint64_t ticks = ((timestamps.at(1) & this->timestampValidMask) - (timestamps.at(0) & this->timestampValidMask)) & this->timestampValidMask;
+        this->gpuHistory.push(ticks * this->timestampPeriodNanoseconds / 1e6);
+    }
+
+    void printReport(std::ostream &stream) const
+    {
+        if (!this->enabled)
+            return;
+
+        stream << "Frame profile over the last " << this->frameHistory.size() << " frames (" << this->totalFrameCount << " in total) with " << this->framesInFlight << " frames in flight, in milliseconds:\n";
+        stream << std::left << std::setw(20) << "" << std::right << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << '\n';
+
+        for (auto &[label, values] : this->collectSeries())
+            printPercentiles(stream, label, std::move(values));
+    }
+
+    // The same as printReport, as a JSON object with one {"p50", "p95", "p99"} object per line of the report (and null when profiling is off)
+    void printJson(std::ostream &stream) const
+    {
+        if (!this->enabled) {
+            stream << "null";
+            return;
+        }
+
+        stream << "{\"frames\": " << this->frameHistory.size() << ", \"milliseconds\": {";
+        bool isFirst = true;
+        for (auto &[label, values] : this->collectSeries()) {
+            stream << (isFirst ? "" : ", ") << '"' << label << "\": {";
+            isFirst = false;
+            for (int percentile : { 50, 95, 99 })
+                stream << (percentile == 50 ? "" : ", ") << "\"p" << percentile << "\": " << computePercentile(values, percentile);
+            stream << '}';
+        }
+        stream << "}}";
+    }
+
+    // Nearest-rank percentile, which is plenty precise with the amount of samples we keep around
+    static double computePercentile(std::vector<double> &values, double percentile)
+    {
+        if (values.empty())
+            return 0;
+
+        auto rank = static_cast<std::size_t>(percentile / 100 * (values.size() - 1) + .5);
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values.at(rank);
+    }
+
+private:
+    // Every line of the report, as a label and the samples it's made of
+    std::vector<std::pair<std::string, std::vector<double>>> collectSeries() const
+    {
+        std::vector<std::pair<std::string, std::vector<double>>> result;
+        for (std::size_t i = 0; i < phaseCount; ++i)
+            result.emplace_back(std::string("cpu ") + phaseNames.at(i), this->frameHistory.collect([i](const frameSample &sample) { return sample.phaseMilliseconds.at(i); }));
+        result.emplace_back("cpu frame", this->frameHistory.collect([](const frameSample &sample) { return sample.cpuFrameMilliseconds; }));
+        result.emplace_back("frame interval", this->frameHistory.collect([](const frameSample &sample) { return sample.frameIntervalMilliseconds; }));
+        result.emplace_back("frame latency", this->latencyHistory.collect([](double milliseconds) { return milliseconds; }));
+        if (this->inputLatencyHistory.size() != 0)
+            result.emplace_back("input to gpu done", this->inputLatencyHistory.collect([](double milliseconds) { return milliseconds; }));
+        if (this->gpuHistory.size() != 0)
+            result.emplace_back("gpu render pass", this->gpuHistory.collect([](double milliseconds) { return milliseconds; }));
+        return result;
+    }
+
+    static void printPercentiles(std::ostream &stream, const std::string &label, std::vector<double> values)
+    {
+        stream << std::left << std::setw(20) << label << std::right << std::fixed << std::setprecision(3);
+        for (double percentile : { 50., 95., 99. })
+            stream << std::setw(10) << computePercentile(values, percentile);
+        stream << '\n' << std::defaultfloat;
+    }
+};
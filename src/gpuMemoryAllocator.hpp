@@ -0,0 +1,549 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+// Linear resources (buffers, linearly-tiled images) and optimally-tiled images can't be packed next to each other without respecting bufferImageGranularity, so we just never put them in the same blocks
+enum class gpuResourceKind : std::uint32_t {
+    linear,
+    optimalImage,
+    count, // Not an actual kind, just how many of them there are
+};
+
+class gpuMemoryBlock;
+
+// A piece of device memory handed out by gpuMemoryAllocator, to be bound at (memory, offset)
+struct gpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0; // What was asked for, the allocator might have reserved more than that
+    std::byte *mappedData = nullptr; // Only set for host-visible memory, which stays mapped for as long as it's allocated
+    gpuMemoryBlock *block = nullptr;
+
+    bool isValid() const
+    {
+        return this->memory != VK_NULL_HANDLE;
+    }
+};
+
+// One vkAllocateMemory worth of memory, carved up with a buddy allocator: every node is a power of two in size (and aligned to its own size, which takes care of alignment requirements for free), and freeing a node merges it back with its buddy whenever that one is free too
+// Buddy allocators waste some memory by rounding sizes up, but they're simple, fast and fragment gracefully, which is what we want for long-lived resources
+class gpuMemoryBlock {
+public:
+    static constexpr VkDeviceSize minNodeSize = 256; // Keeps the free lists short, nothing we allocate is smaller than that anyway
+
+private:
+    struct allocationRecord {
+        std::uint32_t order;
+        VkDeviceSize requestedSize;
+        void *userData;
+    };
+
+    VkDevice vulkanDevice;
+    VkDeviceMemory vulkanMemory = VK_NULL_HANDLE;
+    VkDeviceSize blockSize;
+    std::byte *mappedData = nullptr;
+    bool isDedicated; // Dedicated blocks hold exactly one allocation that takes up the whole thing, and go away with it
+
+    std::vector<std::set<VkDeviceSize>> freeOffsetsByOrder; // Node size is minNodeSize << order, sets so that we can find a node's buddy quickly when merging
+    std::unordered_map<VkDeviceSize, allocationRecord> allocationsByOffset;
+    VkDeviceSize usedSize = 0; // Sum of the requested sizes
+    VkDeviceSize reservedSize = 0; // Sum of the node sizes, i.e. usedSize plus the rounding waste
+
+    static std::uint32_t computeOrder(VkDeviceSize size)
+    {
+        std::uint32_t order = 0;
+        while ((minNodeSize << order) < size)
+            ++order;
+        return order;
+    }
+
+public:
+    gpuMemoryBlock(VkDevice device, std::uint32_t memoryTypeIndex, VkDeviceSize size, bool isHostVisible, bool isDedicated)
+        : vulkanDevice(device), blockSize(size), isDedicated(isDedicated)
+    {
+        VkMemoryAllocateInfo memoryAllocateInfo = {};
+        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocateInfo.allocationSize = size;
+        memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+        if (vkAllocateMemory(this->vulkanDevice, &memoryAllocateInfo, nullptr, &this->vulkanMemory) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate device memory block");
+
+        // Memory can only be mapped once at a time, so we do it for the whole block up front and hand out pointers into it, rather than having every user map (and unmap) its own bit
+        if (isHostVisible) {
+            void *mapping;
+            if (vkMapMemory(this->vulkanDevice, this->vulkanMemory, 0, VK_WHOLE_SIZE, 0, &mapping) != VK_SUCCESS) {
+                vkFreeMemory(this->vulkanDevice, this->vulkanMemory, nullptr);
+                throw std::runtime_error("Failed to map device memory block");
+            }
+            this->mappedData = static_cast<std::byte *>(mapping);
+        }
+
+        if (!this->isDedicated) {
+            this->freeOffsetsByOrder.resize(computeOrder(size) + 1);
+            this->freeOffsetsByOrder.back().insert(0);
+        }
+    }
+
+    // Unmapping is implicit when freeing memory
+    ~gpuMemoryBlock()
+    {
+        vkFreeMemory(this->vulkanDevice, this->vulkanMemory, nullptr);
+    }
+
+    gpuMemoryBlock(const gpuMemoryBlock &) = delete;
+    gpuMemoryBlock &operator=(const gpuMemoryBlock &) = delete;
+
+    std::optional<gpuAllocation> allocate(VkDeviceSize size, VkDeviceSize alignment, void *userData)
+    {
+        if (this->isDedicated) {
+            if (!this->allocationsByOffset.empty())
+                return std::nullopt;
+            this->allocationsByOffset.emplace(0, allocationRecord{ 0, size, userData });
+            this->usedSize = size;
+            this->reservedSize = this->blockSize;
+            return gpuAllocation{ this->vulkanMemory, 0, size, this->mappedData, this };
+        }
+
+        // Nodes are aligned to their own size, so a node at least as big as the alignment is always suitably aligned
+        std::uint32_t order = computeOrder(std::max(size, alignment));
+        if (order >= this->freeOffsetsByOrder.size())
+            return std::nullopt;
+
+        // Take the smallest free node that fits, splitting it down to the size we want
+        std::uint32_t freeOrder = order;
+        while (freeOrder < this->freeOffsetsByOrder.size() && this->freeOffsetsByOrder.at(freeOrder).empty())
+            ++freeOrder;
+        if (freeOrder == this->freeOffsetsByOrder.size())
+            return std::nullopt;
+
+        VkDeviceSize offset = *this->freeOffsetsByOrder.at(freeOrder).begin();
+        this->freeOffsetsByOrder.at(freeOrder).erase(this->freeOffsetsByOrder.at(freeOrder).begin());
+        while (freeOrder > order) {
+            --freeOrder;
+            this->freeOffsetsByOrder.at(freeOrder).insert(offset + (minNodeSize << freeOrder));
+        }
+
+        this->allocationsByOffset.emplace(offset, allocationRecord{ order, size, userData });
+        this->usedSize += size;
+        this->reservedSize += minNodeSize << order;
+        return gpuAllocation{ this->vulkanMemory, offset, size, this->mappedData != nullptr ? this->mappedData + offset : nullptr, this };
+    }
+
+    void free(VkDeviceSize offset)
+    {
+        auto allocationIterator = this->allocationsByOffset.find(offset);
+        if (allocationIterator == this->allocationsByOffset.end())
+            throw std::runtime_error("Freeing GPU memory that wasn't allocated");
+
+        auto record = allocationIterator->second;
+        this->allocationsByOffset.erase(allocationIterator);
+        this->usedSize -= record.requestedSize;
+
+        if (this->isDedicated) {
+            this->reservedSize = 0;
+            return;
+        }
+        this->reservedSize -= minNodeSize << record.order;
+
+        // Merge with our buddy for as long as it's free, going up one order every time
+        std::uint32_t order = record.order;
+        while (order + 1 < this->freeOffsetsByOrder.size()) {
+            VkDeviceSize buddyOffset = offset ^ (minNodeSize << order);
+            auto &freeOffsets = this->freeOffsetsByOrder.at(order);
+            auto buddyIterator = freeOffsets.find(buddyOffset);
+            if (buddyIterator == freeOffsets.end())
+                break;
+
+            freeOffsets.erase(buddyIterator);
+            offset = std::min(offset, buddyOffset);
+            ++order;
+        }
+        this->freeOffsetsByOrder.at(order).insert(offset);
+    }
+
+    bool isEmpty() const
+    {
+        return this->allocationsByOffset.empty();
+    }
+
+    bool isDedicatedBlock() const
+    {
+        return this->isDedicated;
+    }
+
+    VkDeviceSize getSize() const
+    {
+        return this->blockSize;
+    }
+
+    VkDeviceSize getUsedSize() const
+    {
+        return this->usedSize;
+    }
+
+    VkDeviceSize getReservedSize() const
+    {
+        return this->reservedSize;
+    }
+
+    VkDeviceSize getLargestFreeNodeSize() const
+    {
+        for (std::size_t order = this->freeOffsetsByOrder.size(); order-- > 0;)
+            if (!this->freeOffsetsByOrder.at(order).empty())
+                return minNodeSize << order;
+        return 0;
+    }
+
+    // What defragmentation needs to know to move things around: where each allocation is, how big it is (and how big its node is, which is at least as big as its alignment) and who it belongs to
+    template <typename Function>
+    void forEachAllocation(Function &&function)
+    {
+        for (const auto &[offset, record] : this->allocationsByOffset)
+            function(gpuAllocation{ this->vulkanMemory, offset, record.requestedSize, this->mappedData != nullptr ? this->mappedData + offset : nullptr, this }, minNodeSize << record.order, record.userData);
+    }
+};
+
+// Hands out device memory in pieces of big blocks instead of doing one vkAllocateMemory per resource, since drivers can be slow to allocate and some only allow a few thousand allocations in total (maxMemoryAllocationCount can be as low as 4096)
+// There's one pool of blocks per memory type and resource kind, each block being managed by a buddy allocator. Resources that are too big to share a block get a dedicated one
+class gpuMemoryAllocator {
+public:
+    static constexpr VkDeviceSize defaultBlockSize = VkDeviceSize(64) << 20;
+
+    // A proposed relocation of an allocation into a fuller block, see planDefragmentation
+    struct defragmentationMove {
+        gpuAllocation source;
+        gpuAllocation destination;
+        void *userData;
+    };
+
+private:
+    struct memoryPool {
+        std::uint32_t memoryTypeIndex;
+        VkDeviceSize blockSize;
+        std::vector<std::unique_ptr<gpuMemoryBlock>> blocks;
+    };
+
+    VkDevice vulkanDevice;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    std::uint32_t maxMemoryAllocationCount;
+    std::uint32_t memoryAllocationCount = 0;
+    VkDeviceSize allocatedSize = 0; // Across every block we got from the driver
+    VkDeviceSize peakAllocatedSize = 0;
+    std::vector<memoryPool> pools; // Indexed by memoryTypeIndex * resource kind count + resource kind
+
+    bool isHostVisible(std::uint32_t memoryTypeIndex) const
+    {
+        return this->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    }
+
+    std::unique_ptr<gpuMemoryBlock> createBlock(std::uint32_t memoryTypeIndex, VkDeviceSize size, bool isDedicated)
+    {
+        if (this->memoryAllocationCount >= this->maxMemoryAllocationCount)
+            throw std::runtime_error("Ran out of device memory allocations (maxMemoryAllocationCount reached)");
+
+        auto result = std::make_unique<gpuMemoryBlock>(this->vulkanDevice, memoryTypeIndex, size, this->isHostVisible(memoryTypeIndex), isDedicated);
+        ++this->memoryAllocationCount;
+        this->allocatedSize += size;
+        this->peakAllocatedSize = std::max(this->peakAllocatedSize, this->allocatedSize);
+        return result;
+    }
+
+    memoryPool &getPool(const gpuAllocation &allocation)
+    {
+        for (auto &pool : this->pools)
+            for (auto &block : pool.blocks)
+                if (block.get() == allocation.block)
+                    return pool;
+        throw std::runtime_error("GPU allocation doesn't belong to this allocator");
+    }
+
+public:
+    // Everything we need to know about the device's memory is queried once here, rather than every time we allocate something
+    gpuMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = defaultBlockSize)
+        : vulkanDevice(device)
+    {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+        this->maxMemoryAllocationCount = physicalDeviceProperties.limits.maxMemoryAllocationCount;
+
+        std::size_t kindCount = static_cast<std::size_t>(gpuResourceKind::count);
+        this->pools.resize(this->memoryProperties.memoryTypeCount * kindCount);
+        for (std::uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i) {
+            // Small heaps (like the 256MB of device-local host-visible memory many GPUs have) would be used up by just a few blocks, so their blocks are made smaller
+            VkDeviceSize heapSize = this->memoryProperties.memoryHeaps[this->memoryProperties.memoryTypes[i].heapIndex].size;
+            VkDeviceSize blockSize = preferredBlockSize;
+            while (blockSize > gpuMemoryBlock::minNodeSize && blockSize > heapSize / 8)
+                blockSize /= 2;
+
+            for (std::size_t kind = 0; kind < kindCount; ++kind) {
+                this->pools.at(i * kindCount + kind).memoryTypeIndex = i;
+                this->pools.at(i * kindCount + kind).blockSize = blockSize;
+            }
+        }
+    }
+
+    gpuMemoryAllocator(const gpuMemoryAllocator &) = delete;
+    gpuMemoryAllocator &operator=(const gpuMemoryAllocator &) = delete;
+
+    // Graphics cards offer different types of memory, which differ in terms of allowed operations and performance, so we need to find one that fits both the resource and what we want to do with it
+    std::uint32_t findMemoryTypeIndex(std::uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredProperties) const
+    {
+        for (std::uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i)
+            if ((memoryTypeBits & (1 << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & requiredProperties) == requiredProperties)
+                return i;
+
+        throw std::runtime_error("Failed to find a suitable memory type");
+    }
+
+    bool hasMemoryType(std::uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredProperties) const
+    {
+        for (std::uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i)
+            if ((memoryTypeBits & (1 << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & requiredProperties) == requiredProperties)
+                return true;
+        return false;
+    }
+
+    // userData is only there for whoever does defragmentation to be able to tell what an allocation is used for
+    gpuAllocation allocate(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags requiredProperties, gpuResourceKind kind, void *userData = nullptr)
+    {
+        std::uint32_t memoryTypeIndex = this->findMemoryTypeIndex(memoryRequirements.memoryTypeBits, requiredProperties);
+        auto &pool = this->pools.at(memoryTypeIndex * static_cast<std::size_t>(gpuResourceKind::count) + static_cast<std::size_t>(kind));
+
+        // Anything bigger than half a block would waste too much of it (or not fit at all), so it gets its own allocation
+        if (std::max(memoryRequirements.size, memoryRequirements.alignment) > pool.blockSize / 2) {
+            pool.blocks.push_back(this->createBlock(memoryTypeIndex, memoryRequirements.size, true));
+            return pool.blocks.back()->allocate(memoryRequirements.size, memoryRequirements.alignment, userData).value();
+        }
+
+        for (auto &block : pool.blocks)
+            if (!block->isDedicatedBlock())
+                if (auto result = block->allocate(memoryRequirements.size, memoryRequirements.alignment, userData))
+                    return result.value();
+
+        pool.blocks.push_back(this->createBlock(memoryTypeIndex, pool.blockSize, false));
+        return pool.blocks.back()->allocate(memoryRequirements.size, memoryRequirements.alignment, userData).value();
+    }
+
+    // Whoever frees an allocation must make sure the GPU is done with it first (e.g. through the deletion queue)
+    void free(gpuAllocation &allocation)
+    {
+        if (!allocation.isValid())
+            return;
+
+        auto &pool = this->getPool(allocation);
+        allocation.block->free(allocation.offset);
+
+        // Empty blocks are given back to the driver, except for one per pool so that a resource being recreated doesn't cost us a vkAllocateMemory every time
+        if (allocation.block->isEmpty()) {
+            bool isDedicated = allocation.block->isDedicatedBlock();
+            auto emptyBlockCount = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const auto &block) { return block->isEmpty() && !block->isDedicatedBlock(); });
+            if (isDedicated || emptyBlockCount > 1) {
+                this->allocatedSize -= allocation.block->getSize();
+                pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(), [&](const auto &block) { return block.get() == allocation.block; }));
+                --this->memoryAllocationCount;
+            }
+        }
+
+        allocation = {};
+    }
+
+    // Defragmentation hook: proposes moving allocations out of the emptiest blocks into fuller ones, so that the emptiest blocks end up free and can be given back
+    // The allocator can't move anything itself (it doesn't know about the resources bound to its memory), so for each move, the owner of the allocation (identified by its userData) must create a new resource bound to the destination, copy the contents over, switch to it, and then call completeDefragmentationMove once the GPU is done with the source
+    std::vector<defragmentationMove> planDefragmentation(VkDeviceSize maxBytesToMove)
+    {
+        std::vector<defragmentationMove> result;
+        VkDeviceSize bytesToMove = 0;
+
+        for (auto &pool : this->pools) {
+            std::vector<gpuMemoryBlock *> candidateBlocks;
+            for (auto &block : pool.blocks)
+                if (!block->isDedicatedBlock() && !block->isEmpty())
+                    candidateBlocks.push_back(block.get());
+            if (candidateBlocks.size() < 2)
+                continue;
+
+            // The emptiest blocks are the cheapest to vacate, and the fullest ones the best to move into
+            std::sort(candidateBlocks.begin(), candidateBlocks.end(), [](auto a, auto b) { return a->getReservedSize() < b->getReservedSize(); });
+            std::set<gpuMemoryBlock *> destinationBlocks; // Moving things out of a block we've just moved things into would only make work for the caller
+            for (std::size_t i = 0; i + 1 < candidateBlocks.size(); ++i) {
+                if (destinationBlocks.count(candidateBlocks.at(i)) != 0)
+                    continue;
+
+                struct movableAllocation {
+                    gpuAllocation allocation;
+                    VkDeviceSize nodeSize;
+                    void *userData;
+                };
+                std::vector<movableAllocation> allocations;
+                candidateBlocks.at(i)->forEachAllocation([&](const gpuAllocation &allocation, VkDeviceSize nodeSize, void *userData) { allocations.push_back({ allocation, nodeSize, userData }); });
+
+                for (auto &[allocation, nodeSize, userData] : allocations) {
+                    if (bytesToMove + allocation.size > maxBytesToMove)
+                        return result;
+
+                    // Reserving the destination right away keeps later moves from being planned into the same spot
+                    for (std::size_t j = candidateBlocks.size() - 1; j > i; --j)
+                        if (auto destination = candidateBlocks.at(j)->allocate(allocation.size, nodeSize, userData)) {
+                            result.push_back({ allocation, destination.value(), userData });
+                            destinationBlocks.insert(candidateBlocks.at(j));
+                            bytesToMove += allocation.size;
+                            break;
+                        }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    void completeDefragmentationMove(defragmentationMove &move)
+    {
+        this->free(move.source);
+    }
+
+    // Gives up on a planned move, releasing the destination that was reserved for it
+    void cancelDefragmentationMove(defragmentationMove &move)
+    {
+        this->free(move.destination);
+    }
+
+    std::uint32_t getMemoryAllocationCount() const
+    {
+        return this->memoryAllocationCount;
+    }
+
+    // The most device memory we've ever had from the driver at once, which is what actually limits what else can run alongside us
+    VkDeviceSize getPeakAllocatedSize() const
+    {
+        return this->peakAllocatedSize;
+    }
+
+    // Per heap: how much we got from the driver, how much of that is actually in use, how much is lost to rounding, and how fragmented the free space is (0% means it's all in one piece per block)
+    void printStats(std::ostream &stream) const
+    {
+        struct heapStats {
+            VkDeviceSize blockSize = 0, usedSize = 0, reservedSize = 0, largestFreeSize = 0, freeSize = 0;
+            std::size_t blockCount = 0;
+        };
+        std::vector<heapStats> statsByHeap(this->memoryProperties.memoryHeapCount);
+
+        for (const auto &pool : this->pools)
+            for (const auto &block : pool.blocks) {
+                auto &stats = statsByHeap.at(this->memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex);
+                stats.blockSize += block->getSize();
+                stats.usedSize += block->getUsedSize();
+                stats.reservedSize += block->getReservedSize();
+                stats.freeSize += block->getSize() - block->getReservedSize();
+                stats.largestFreeSize = std::max(stats.largestFreeSize, block->getLargestFreeNodeSize());
+                ++stats.blockCount;
+            }
+
+        stream << "GPU memory (" << this->memoryAllocationCount << " device memory allocations out of " << this->maxMemoryAllocationCount << " allowed):\n";
+        for (std::size_t i = 0; i < statsByHeap.size(); ++i) {
+            const auto &stats = statsByHeap.at(i);
+            if (stats.blockCount == 0)
+                continue;
+
+            double fragmentation = stats.freeSize == 0 ? 0 : 1 - double(stats.largestFreeSize) / stats.freeSize;
+            stream << "\theap " << i << ": " << stats.blockCount << " blocks, " << std::fixed << std::setprecision(2)
+                   << stats.blockSize / 1048576. << "MB allocated, " << stats.usedSize / 1048576. << "MB used, " << (stats.reservedSize - stats.usedSize) / 1048576. << "MB wasted, "
+                   << fragmentation * 100 << "% fragmented\n" << std::defaultfloat;
+        }
+    }
+};
+
+// Bump allocator for data that only lives for one frame (one of these per frame in flight), which makes allocating a pointer increment and freeing everything a single reset once the frame's fence is signalled
+// It owns a host-visible buffer, so that whatever is written through the returned pointers can be used by the GPU straight away
+class frameLinearAllocator {
+public:
+    struct linearAllocation {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        std::byte *data;
+    };
+
+private:
+    VkDevice vulkanDevice = VK_NULL_HANDLE;
+    gpuMemoryAllocator *allocator = nullptr;
+    VkBuffer vulkanBuffer = VK_NULL_HANDLE;
+    gpuAllocation allocation;
+    VkDeviceSize bufferSize;
+    VkDeviceSize usedSize = 0;
+    VkDeviceSize highWaterMark = 0; // How much of the buffer we've ever needed in one frame, to see whether its size needs tweaking
+
+public:
+    frameLinearAllocator(VkDevice device, gpuMemoryAllocator &allocator, VkDeviceSize size, VkBufferUsageFlags usage)
+        : vulkanDevice(device), allocator(&allocator), bufferSize(size)
+    {
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = usage;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(this->vulkanDevice, &bufferCreateInfo, nullptr, &this->vulkanBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create frame buffer");
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(this->vulkanDevice, this->vulkanBuffer, &memoryRequirements);
+
+        // Coherent memory means we never have to flush anything we write
+        this->allocation = this->allocator->allocate(memoryRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, gpuResourceKind::linear);
+        vkBindBufferMemory(this->vulkanDevice, this->vulkanBuffer, this->allocation.memory, this->allocation.offset);
+    }
+
+    ~frameLinearAllocator()
+    {
+        if (this->vulkanBuffer == VK_NULL_HANDLE)
+            return;
+        vkDestroyBuffer(this->vulkanDevice, this->vulkanBuffer, nullptr);
+        this->allocator->free(this->allocation);
+    }
+
+    frameLinearAllocator(frameLinearAllocator &&other) noexcept
+        : vulkanDevice(other.vulkanDevice), allocator(other.allocator), vulkanBuffer(std::exchange(other.vulkanBuffer, VK_NULL_HANDLE)), allocation(std::exchange(other.allocation, {})), bufferSize(other.bufferSize), usedSize(other.usedSize), highWaterMark(other.highWaterMark)
+    {
+    }
+
+    frameLinearAllocator(const frameLinearAllocator &) = delete;
+    frameLinearAllocator &operator=(const frameLinearAllocator &) = delete;
+
+    // Returns nothing if the frame has used up the whole buffer, in which case the caller has to do without (or the buffer needs to be made bigger)
+    std::optional<linearAllocation> allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        VkDeviceSize offset = (this->usedSize + alignment - 1) / alignment * alignment;
+        if (offset + size > this->bufferSize)
+            return std::nullopt;
+
+        this->usedSize = offset + size;
+        this->highWaterMark = std::max(this->highWaterMark, this->usedSize);
+        return linearAllocation{ this->vulkanBuffer, offset, this->allocation.mappedData + offset };
+    }
+
+    // Must only be called once the GPU is done with the frame that used this allocator
+    void reset()
+    {
+        this->usedSize = 0;
+    }
+
+    VkDeviceSize getHighWaterMark() const
+    {
+        return this->highWaterMark;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+// A Vulkan 1.2 timeline semaphore, i.e. a counter the GPU bumps as it gets through our submissions, which the CPU can read or wait on for any value it wants
+// One of them stands in for a whole pile of fences: every submission to a queue signals the next value, so "is this submission done" becomes "has the counter reached its value", and since values are handed out in submission order, reaching a value means everything submitted before it is done too
+// Values must only ever be handed out (advance) by whoever submits to the queue, but any thread can poll or wait on them
+class gpuTimeline {
+    VkDevice vulkanDevice;
+    VkSemaphore vulkanSemaphore = VK_NULL_HANDLE;
+
+    std::uint64_t lastSubmittedValue = 0;
+    std::atomic<std::uint64_t> completedValue = 0; // The last value we saw the GPU reach, so that we don't have to ask the driver when we already know the answer
+
+    void updateCompletedValue(std::uint64_t value)
+    {
+        auto previousValue = this->completedValue.load();
+        while (previousValue < value && !this->completedValue.compare_exchange_weak(previousValue, value))
+            ;
+    }
+
+public:
+    explicit gpuTimeline(VkDevice device)
+        : vulkanDevice(device)
+    {
+        VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {};
+        semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        semaphoreTypeCreateInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+        if (vkCreateSemaphore(this->vulkanDevice, &semaphoreCreateInfo, nullptr, &this->vulkanSemaphore) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create timeline semaphore");
+    }
+
+    ~gpuTimeline()
+    {
+        vkDestroySemaphore(this->vulkanDevice, this->vulkanSemaphore, nullptr);
+    }
+
+    gpuTimeline(const gpuTimeline &) = delete;
+    gpuTimeline &operator=(const gpuTimeline &) = delete;
+
+    VkSemaphore getSemaphore() const
+    {
+        return this->vulkanSemaphore;
+    }
+
+    // Hands out the value the next submission must signal (and that submission must really happen, as nothing after it ever completes otherwise)
+    std::uint64_t advance()
+    {
+        return ++this->lastSubmittedValue;
+    }
+
+    // Everything submitted so far is done once the counter reaches this
+    std::uint64_t getLastSubmittedValue() const
+    {
+        return this->lastSubmittedValue;
+    }
+
+    // Asks the driver where the GPU is at, without waiting
+    std::uint64_t getCompletedValue()
+    {
+        std::uint64_t value;
+        if (vkGetSemaphoreCounterValue(this->vulkanDevice, this->vulkanSemaphore, &value) != VK_SUCCESS)
+            throw std::runtime_error("Failed to get timeline semaphore value");
+        this->updateCompletedValue(value);
+        return this->completedValue;
+    }
+
+    bool isReached(std::uint64_t value)
+    {
+        return this->completedValue >= value || this->getCompletedValue() >= value;
+    }
+
+    void wait(std::uint64_t value)
+    {
+        if (this->completedValue >= value)
+            return;
+
+        VkSemaphoreWaitInfo semaphoreWaitInfo = {};
+        semaphoreWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        semaphoreWaitInfo.semaphoreCount = 1;
+        semaphoreWaitInfo.pSemaphores = &this->vulkanSemaphore;
+        semaphoreWaitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(this->vulkanDevice, &semaphoreWaitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("Failed to wait on timeline semaphore");
+        this->updateCompletedValue(value);
+    }
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <utility>
+#include <cstdint>
+
+// Chase-Lev work-stealing deque: its owner pushes and pops at the bottom without any locking, while other threads steal from the top, only ever contending on the last item
+// The capacity is fixed, and pushing onto a full deque fails (the caller then puts the item somewhere else), which keeps us from having to deal with growing the buffer while thieves might be reading it
+template <typename T>
+class workStealingDeque {
+    static constexpr std::int64_t capacity = 1024;
+
+    std::unique_ptr<std::atomic<T *>[]> items = std::make_unique<std::atomic<T *>[]>(capacity);
+    alignas(64) std::atomic<std::int64_t> top = 0; // Next item to steal
+    alignas(64) std::atomic<std::int64_t> bottom = 0; // Next free slot for the owner
+
+public:
+    // Owner only
+    bool push(T *item)
+    {
+        std::int64_t currentBottom = this->bottom.load(std::memory_order_relaxed);
+        if (currentBottom - this->top.load(std::memory_order_acquire) >= capacity)
+            return false;
+
+        this->items[currentBottom % capacity].store(item, std::memory_order_relaxed);
+        this->bottom.store(currentBottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner only, takes the most recently pushed item (which is the most likely to still be in cache)
+    T *pop()
+    {
+        std::int64_t currentBottom = this->bottom.load(std::memory_order_relaxed) - 1;
+        this->bottom.store(currentBottom, std::memory_order_seq_cst);
+        std::int64_t currentTop = this->top.load(std::memory_order_seq_cst);
+
+        if (currentTop > currentBottom) {
+            this->bottom.store(currentBottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T *item = this->items[currentBottom % capacity].load(std::memory_order_relaxed);
+        if (currentTop == currentBottom) {
+            // Last item, which a thief might be going for at the same time
+            if (!this->top.compare_exchange_strong(currentTop, currentTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            this->bottom.store(currentBottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread, takes the oldest item
+    T *steal()
+    {
+        std::int64_t currentTop = this->top.load(std::memory_order_seq_cst);
+        std::int64_t currentBottom = this->bottom.load(std::memory_order_seq_cst);
+        if (currentTop >= currentBottom)
+            return nullptr;
+
+        T *item = this->items[currentTop % capacity].load(std::memory_order_relaxed);
+        if (!this->top.compare_exchange_strong(currentTop, currentTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // Someone else got it first
+        return item;
+    }
+};
+
+// A set of tasks with dependencies between them (e.g. "record the draws once culling is done"), which is how we describe the CPU work of a frame
+// Tasks become ready as soon as everything they depend on is done, so independent chains of work run in parallel without anyone having to think about it
+class taskGraph {
+public:
+    using taskHandle = std::size_t;
+
+private:
+    friend class jobSystem;
+
+    struct task {
+        taskGraph *graph;
+        std::function<void(std::uint32_t)> function; // Called with the index of the worker running it
+        std::vector<task *> dependents;
+        std::uint32_t dependencyCount = 0;
+        std::atomic<std::uint32_t> remainingDependencyCount = 0;
+    };
+
+    std::deque<task> tasks; // A deque so that tasks don't move around as more get added
+
+    std::mutex mutex;
+    std::condition_variable doneCondition;
+    std::size_t remainingTaskCount = 0;
+    std::exception_ptr firstException;
+
+    taskHandle addTask(std::function<void(std::uint32_t)> function, const taskHandle *firstDependency, const taskHandle *endDependency)
+    {
+        auto &newTask = this->tasks.emplace_back();
+        newTask.graph = this;
+        newTask.function = std::move(function);
+        for (auto *dependency = firstDependency; dependency != endDependency; ++dependency) {
+            this->tasks.at(*dependency).dependents.push_back(&newTask);
+            ++newTask.dependencyCount;
+        }
+        return this->tasks.size() - 1;
+    }
+
+public:
+    taskGraph() = default;
+
+    taskGraph(const taskGraph &) = delete;
+    taskGraph &operator=(const taskGraph &) = delete;
+
+    // Dependencies must have been added before whatever depends on them, which also rules out cycles
+    taskHandle addTask(std::function<void(std::uint32_t)> function, std::initializer_list<taskHandle> dependencies = {})
+    {
+        return this->addTask(std::move(function), dependencies.begin(), dependencies.end());
+    }
+
+    // For when how many dependencies there are is only known at runtime (e.g. one per worker)
+    taskHandle addTask(std::function<void(std::uint32_t)> function, const std::vector<taskHandle> &dependencies)
+    {
+        return this->addTask(std::move(function), dependencies.data(), dependencies.data() + dependencies.size());
+    }
+
+    std::size_t size() const
+    {
+        return this->tasks.size();
+    }
+
+    // Only once the graph is done running, so that it can be rebuilt for the next frame
+    void clear()
+    {
+        this->tasks.clear();
+    }
+};
+
+// Runs task graphs on a fixed set of worker threads, each of which has its own work-stealing deque: tasks that become ready on a worker go on its own deque (so chains of work tend to stay on one core), and idle workers steal from the others
+// Workers are identified by their index, so that they can each own per-thread resources (like command pools) that must never be touched by two threads at once
+class jobSystem {
+    using clock = std::chrono::steady_clock;
+
+    // How busy each worker has been, to see how well things scale across cores (each on its own cache line, since they're updated all the time)
+    struct alignas(64) workerStatistics {
+        std::atomic<std::uint64_t> busyNanoseconds = 0;
+        std::atomic<std::uint64_t> taskCount = 0;
+        std::atomic<std::uint64_t> stolenTaskCount = 0;
+    };
+
+    std::vector<std::unique_ptr<workStealingDeque<taskGraph::task>>> workerDeques;
+    std::unique_ptr<workerStatistics[]> statistics;
+    clock::time_point statisticsStartTime = clock::now();
+
+    // Tasks that become ready outside the workers (i.e. the roots of a graph) go there, since only a deque's owner may push onto it
+    std::mutex injectedTasksMutex;
+    std::deque<taskGraph::task *> injectedTasks;
+
+    // Idle workers sleep until there's something queued, rather than spinning
+    std::mutex sleepMutex;
+    std::condition_variable workAvailableCondition;
+    std::atomic<std::size_t> queuedTaskCount = 0;
+    std::atomic<bool> isStopping = false;
+
+    std::vector<std::thread> workers; // Last, so that everything the workers use already exists when they start
+
+    void enqueue(taskGraph::task *readyTask, std::optional<std::uint32_t> workerIndex)
+    {
+        ++this->queuedTaskCount;
+        if (!workerIndex.has_value() || !this->workerDeques.at(workerIndex.value())->push(readyTask)) {
+            std::lock_guard lock(this->injectedTasksMutex);
+            this->injectedTasks.push_back(readyTask);
+        }
+
+        // Taking the lock keeps a worker from missing the notification between checking queuedTaskCount and going to sleep
+        {
+            std::lock_guard lock(this->sleepMutex);
+        }
+        this->workAvailableCondition.notify_one();
+    }
+
+    taskGraph::task *findTask(std::uint32_t workerIndex)
+    {
+        if (auto result = this->workerDeques.at(workerIndex)->pop())
+            return result;
+
+        {
+            std::lock_guard lock(this->injectedTasksMutex);
+            if (!this->injectedTasks.empty()) {
+                auto result = this->injectedTasks.front();
+                this->injectedTasks.pop_front();
+                return result;
+            }
+        }
+
+        // Starting right after ourselves spreads the thieves over the victims
+        for (std::size_t i = 1; i < this->workerDeques.size(); ++i)
+            if (auto result = this->workerDeques.at((workerIndex + i) % this->workerDeques.size())->steal()) {
+                ++this->statistics[workerIndex].stolenTaskCount;
+                return result;
+            }
+
+        return nullptr;
+    }
+
+    void runTask(taskGraph::task *currentTask, std::uint32_t workerIndex)
+    {
+        auto startTime = clock::now();
+        auto graph = currentTask->graph;
+
+        try {
+            currentTask->function(workerIndex);
+        } catch (...) {
+            std::lock_guard lock(graph->mutex);
+            if (!graph->firstException)
+                graph->firstException = std::current_exception();
+        }
+
+        // Whatever we just unblocked goes on our own deque, since it probably wants the data we just produced
+        for (auto dependent : currentTask->dependents)
+            if (--dependent->remainingDependencyCount == 0)
+                this->enqueue(dependent, workerIndex);
+
+        auto &workerStatistics = this->statistics[workerIndex];
+        workerStatistics.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - startTime).count();
+        ++workerStatistics.taskCount;
+
+        // This has to happen under the lock, as otherwise whoever is waiting on the graph could see it done (and destroy it) before we're done notifying them
+        std::lock_guard lock(graph->mutex);
+        if (--graph->remainingTaskCount == 0)
+            graph->doneCondition.notify_all();
+    }
+
+    void workerMain(std::uint32_t workerIndex)
+    {
+        while (!this->isStopping) {
+            if (auto currentTask = this->findTask(workerIndex)) {
+                --this->queuedTaskCount;
+                this->runTask(currentTask, workerIndex);
+                continue;
+            }
+
+            // Someone else might have taken the task we were told about (or we might have lost a race stealing it), so we only sleep once there's really nothing queued
+            std::unique_lock lock(this->sleepMutex);
+            this->workAvailableCondition.wait(lock, [&]() { return this->isStopping || this->queuedTaskCount != 0; });
+        }
+    }
+
+public:
+    explicit jobSystem(std::uint32_t workerCount)
+        : statistics(std::make_unique<workerStatistics[]>(workerCount))
+    {
+        for (std::uint32_t i = 0; i < workerCount; ++i)
+            this->workerDeques.push_back(std::make_unique<workStealingDeque<taskGraph::task>>());
+
+        this->workers.reserve(workerCount);
+        for (std::uint32_t i = 0; i < workerCount; ++i)
+            this->workers.emplace_back(&jobSystem::workerMain, this, i);
+    }
+
+    ~jobSystem()
+    {
+        {
+            std::lock_guard lock(this->sleepMutex);
+            this->isStopping = true;
+        }
+        this->workAvailableCondition.notify_all();
+        for (auto &worker : this->workers)
+            worker.join();
+    }
+
+    jobSystem(const jobSystem &) = delete;
+    jobSystem &operator=(const jobSystem &) = delete;
+
+    std::uint32_t getWorkerCount() const
+    {
+        return static_cast<std::uint32_t>(this->workers.size());
+    }
+
+    // Starts running the tasks of the graph (each one once all of its dependencies are done) and returns right away, so that the calling thread can get on with something else in the meantime
+    // The graph must not be touched (or destroyed) until wait has been called on it
+    void submit(taskGraph &graph)
+    {
+        graph.remainingTaskCount = graph.tasks.size();
+        graph.firstException = nullptr;
+        for (auto &graphTask : graph.tasks)
+            graphTask.remainingDependencyCount = graphTask.dependencyCount;
+
+        for (auto &graphTask : graph.tasks)
+            if (graphTask.dependencyCount == 0)
+                this->enqueue(&graphTask, std::nullopt);
+    }
+
+    // Waits for every task of a submitted graph to be done, rethrowing the first exception any of them threw
+    // This must be called from outside the workers (a worker waiting on a graph would be a worker not running its tasks)
+    void wait(taskGraph &graph)
+    {
+        std::unique_lock lock(graph.mutex);
+        graph.doneCondition.wait(lock, [&]() { return graph.remainingTaskCount == 0; });
+        if (graph.firstException)
+            std::rethrow_exception(std::exchange(graph.firstException, nullptr));
+    }
+
+    void run(taskGraph &graph)
+    {
+        this->submit(graph);
+        this->wait(graph);
+    }
+
+    // Runs function(taskIndex, workerIndex) for every taskIndex in [0, taskCount) and waits for all of them to be done
+    void parallelFor(std::uint32_t taskCount, std::function<void(std::uint32_t, std::uint32_t)> function)
+    {
+        taskGraph graph;
+        for (std::uint32_t i = 0; i < taskCount; ++i)
+            graph.addTask([&function, i](std::uint32_t workerIndex) { function(i, workerIndex); });
+        this->run(graph);
+    }
+
+    // Busy time is the time spent running tasks, so workers that are all close to 100% mean we'd need more of them, and a few busy workers next to idle ones mean the work doesn't split well
+    void printUtilisation(std::ostream &stream) const
+    {
+        double elapsedNanoseconds = std::chrono::duration<double, std::nano>(clock::now() - this->statisticsStartTime).count();
+
+        stream << "Job system utilisation over the last " << elapsedNanoseconds / 1e9 << "s:\n";
+        for (std::size_t i = 0; i < this->workers.size(); ++i) {
+            const auto &workerStatistics = this->statistics[i];
+            stream << "\tworker " << i << ": " << std::fixed << std::setprecision(1) << 100 * workerStatistics.busyNanoseconds / elapsedNanoseconds << "% busy, "
+                   << workerStatistics.taskCount << " tasks (" << workerStatistics.stolenTaskCount << " stolen)\n" << std::defaultfloat;
+        }
+    }
+
+    void resetUtilisation()
+    {
+        for (std::size_t i = 0; i < this->workers.size(); ++i) {
+            this->statistics[i].busyNanoseconds = 0;
+            this->statistics[i].taskCount = 0;
+            this->statistics[i].stolenTaskCount = 0;
+        }
+        this->statisticsStartTime = clock::now();
+    }
+};
@@ -3,10 +3,31 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "applicationOptions.hpp"
+#include "frameProfiler.hpp"
+#include "framePacer.hpp"
+#include "redrawScheduler.hpp"
+#include "spirvBlob.hpp"
+#include "embeddedShaders.hpp"
+#include "deletionQueue.hpp"
+#include "mesh.hpp"
+#include "gpuTimeline.hpp"
+#include "stagingUploader.hpp"
+#include "gpuMemoryAllocator.hpp"
+#include "jobSystem.hpp"
+#include "recordingCache.hpp"
+#include "physicalDeviceProbe.hpp"
+#include "renderGraph.hpp"
+#include "frameCapture.hpp"
+#include "shaderWatcher.hpp"
+#include "pipelineVariantCache.hpp"
+#include "sceneUpdate.hpp"
+
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <unordered_set>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -17,6 +38,13 @@
 #include <limits>
 #include <cstring>
 #include <cstdint>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <cmath>
+#include <filesystem>
+#include <type_traits>
 
 [[nodiscard]] inline std::string readFullFile(std::string_view fileName)
 {
@@ -29,6 +57,25 @@
     return fileContents;
 }
 
+// Writes to a temporary file first and then renames it over the destination, so that anyone reading the file (including us, on the next launch, if we crash halfway through writing it) either sees the old contents or the new ones, never a mix of both
+inline void writeFullFileAtomically(const std::string &fileName, std::string_view contents)
+{
+    std::string temporaryFileName = fileName + ".tmp";
+
+    {
+        std::ofstream fileStream(temporaryFileName, std::ios::binary | std::ios::trunc);
+        fileStream.write(contents.data(), contents.size());
+        fileStream.flush();
+        if (fileStream.fail())
+            throw std::runtime_error("Failure to write to " + temporaryFileName);
+    }
+
+    if (std::rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+        std::remove(temporaryFileName.c_str());
+        throw std::runtime_error("Failure to replace " + fileName);
+    }
+}
+
 static VkResult internalVkCreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pDebugMessenger)
 {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
@@ -45,11 +92,15 @@ static void internalVkDestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebug
 }
 
 class vulkanSomethingOnTheScreenApp {
-    static constexpr std::uint32_t maxFramesInFlight = 2; // We don't want the CPU to get *too* far ahead of the GPU (putting 3 or more frames in flight might add a significant amount of latency...)
     static constexpr std::uint32_t windowWidth = 800;
     static constexpr std::uint32_t windowHeight = 600;
     static constexpr const char *name = "Get something on the screen with Vulkan";
-    GLFWwindow *glfwWindow;
+    static constexpr VkFormat headlessImageFormat = VK_FORMAT_B8G8R8A8_SRGB; // Same format we'd prefer for the swap chain, so that headless rendering exercises the exact same paths. Support for it as a color attachment is mandatory anyway
+    // What --resize-every cycles through, with odd sizes in there too since that's where rounding bugs hide
+    static constexpr std::array<VkExtent2D, 5> headlessResizeExtents = { { { 1280, 720 }, { 640, 480 }, { 1023, 767 }, { 333, 1000 }, { windowWidth, windowHeight } } };
+    const applicationOptions options;
+    const std::uint32_t maxFramesInFlight; // Trades latency (fewer frames) for throughput (more frames, since the CPU and GPU get to wait on each other less), which is why it's up to whoever runs us
+    GLFWwindow *glfwWindow = nullptr;
 
     static constexpr std::array<const char *, 1> validationLayers = {
         {
@@ -74,37 +125,176 @@ class vulkanSomethingOnTheScreenApp {
 
     VkQueue vulkanGraphicsQueue = VK_NULL_HANDLE;
     VkQueue vulkanPresentQueue = VK_NULL_HANDLE;
+    VkQueue vulkanTransferQueue = VK_NULL_HANDLE; // Ideally from a transfer-only family, but that might just be the graphics queue again
+
+    std::optional<gpuMemoryAllocator> memoryAllocator; // Everything that needs device memory gets it from there, instead of through its own vkAllocateMemory
     
     VkSwapchainKHR vulkanSwapChain = VK_NULL_HANDLE;
-    std::vector<VkImage> vulkanSwapChainImages;
+    std::vector<VkImage> vulkanSwapChainImages; // When running headless, these are our own offscreen images rather than the swap chain's
+    std::vector<gpuAllocation> vulkanHeadlessImageAllocations; // Only used when running headless, since the swap chain owns the memory of its images otherwise
+    VkExtent2D headlessExtent = { windowWidth, windowHeight };
     VkFormat vulkanSwapChainImageFormat;
     VkExtent2D vulkanSwapChainExtent;
     VkPipelineLayout vulkanPipelineLayout;
 
     std::vector<VkImageView> vulkanSwapChainImageViews;
 
-    VkRenderPass vulkanRenderPass;
-    VkPipeline vulkanGraphicsPipeline;
+    // The frame as a graph of passes (see initializeRenderGraph), which owns the render pass and framebuffers and works out the barriers between passes
+    renderGraph frameRenderGraph;
+    renderGraph::resourceId swapChainImageResource = 0;
+    renderGraph::passId drawPass = 0;
 
-    std::vector<VkFramebuffer> vulkanSwapChainFramebuffers;
+    // Every graphics pipeline variant we've asked for, compiled on threads of its own (see updatePipelines)
+    std::optional<pipelineVariantCache> graphicsPipelines;
+    graphicsPipelineKey wantedGraphicsPipelineKey; // What we'd like to draw with, which can be ahead of vulkanGraphicsPipeline while it's compiling
+    VkPipeline vulkanGraphicsPipeline; // What draws get recorded with, owned by graphicsPipelines
+    std::array<std::uint64_t, 2> inUseGraphicsShaderHashes = {}; // What vulkanGraphicsPipeline was built from, vertex then fragment, which mustn't get evicted from graphicsPipelines
+    VkPipelineCache vulkanPipelineCache = VK_NULL_HANDLE; // Lets the driver skip compiling pipelines it has already compiled on a previous launch
+    bool wasPipelineCacheLoaded = false;
 
     VkCommandPool vulkanCommandPool;
-    std::array<VkCommandBuffer, vulkanSomethingOnTheScreenApp::maxFramesInFlight> vulkanCommandBuffers;
+    // One per frame in flight and swap chain image (see getCommandBufferIndex), each kept as recorded until something it depends on changes, since nothing about a frame's commands changes from one frame to the next otherwise
+    // Keying them by frame in flight too means a command buffer is only ever submitted by its own frame, which has just waited for its previous submission to be done (as well as keeping each frame's timestamp queries where the profiler expects them)
+    std::vector<VkCommandBuffer> vulkanCommandBuffers;
+    recordingCache commandBufferCache;
 
-    std::array<VkSemaphore, vulkanSomethingOnTheScreenApp::maxFramesInFlight> vulkanImageAvailableSemaphores;
-    std::array<VkSemaphore, vulkanSomethingOnTheScreenApp::maxFramesInFlight> vulkanRenderFinishedSemaphores;
-    std::array<VkFence, vulkanSomethingOnTheScreenApp::maxFramesInFlight> vulkanInFlightFences;
+    // All of these have one entry per frame in flight
+    // The swap chain only deals in binary semaphores, so these stay around for acquiring and presenting, but everything else is tracked with the timeline
+    std::vector<VkSemaphore> vulkanImageAvailableSemaphores;
+    std::vector<VkSemaphore> vulkanRenderFinishedSemaphores;
 
     // Part of the extra code for handling resizes explicitly on platforms that don't trigger VK_ERROR_OUT_OF_DATE_KHR
     bool framebufferResized = false;
 
+    bool hasReportedPresentModeFallback = false; // The swap chain gets recreated on every resize, and once is enough to know
+
     std::uint32_t currentFrame = 0;
+
+    // Every submission to the graphics queue (frames as well as upload flushes) signals the next value of this, so a single number tells us when everything submitted up to some point is done
+    std::optional<gpuTimeline> graphicsTimeline;
+    std::vector<std::uint64_t> frameSlotTimelineValues; // What the timeline reaches once each frame in flight is done, from the last time it was submitted
+
+    // Everything we put in device-local memory goes through this
+    VkBuffer vulkanStagingBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanStagingAllocation;
+    std::optional<stagingUploader> uploader;
+
+    VkBuffer vulkanVertexBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanVertexBufferAllocation;
+    VkBuffer vulkanIndexBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanIndexBufferAllocation;
+    std::uint32_t indexCount = 0;
+
+    // One buffer per instance attribute (see instanceData), bound right after the vertex buffer
+    std::array<VkBuffer, instanceData::attributeCount> vulkanInstanceBuffers = {};
+    std::array<gpuAllocation, instanceData::attributeCount> vulkanInstanceBufferAllocations;
+    std::uint32_t instanceCount = 0;
+
+    // Each draw call covers a contiguous range of instances
+    struct drawCommand {
+        std::uint32_t firstInstance;
+        std::uint32_t instanceCount;
+    };
+    std::vector<drawCommand> drawList;
+
+    // When recording on several threads, each worker gets its own command pool for each frame in flight (command pools can't be used from several threads at once, and the ones of a frame can only be reset once the GPU is done with that frame)
+    struct recordingWorkerResources {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> secondaryCommandBuffers; // Allocated as needed, and reused every time the pool is reset
+        std::size_t usedSecondaryCommandBufferCount = 0;
+    };
+    std::optional<jobSystem> recordingJobSystem;
+    std::vector<std::vector<recordingWorkerResources>> recordingWorkerResourcesByFrame; // Indexed by frame in flight, then by worker
+
+    // The CPU work of a frame, which the workers start on before we even have an image to render to, so that it overlaps with waiting on the swap chain
+    taskGraph recordingFrameGraph;
+    std::vector<std::vector<VkCommandBuffer>> recordedSecondaryCommandBuffersByFrame; // Indexed by frame in flight, then in draw list order
+    recordingCache secondaryCommandBufferCache; // One entry per frame in flight, as they're shared by all of the frame's primary command buffers
+
+    // One per frame in flight, for data that's written by the CPU every frame and thrown away once the frame is done, which only CPU culling has (so they don't exist otherwise)
+    std::vector<frameLinearAllocator> frameLinearAllocators;
+
+    // CPU culling (see sceneUpdate.hpp), only set up when enabled
+    // Every frame composes the instances' transforms with the view's and culls them, then packs the visible ones into the frame's linear allocator along with one indirect draw per entry of the draw list, which is what the draws read from
+    struct cpuSceneFrameAllocations {
+        std::array<frameLinearAllocator::linearAllocation, instanceData::attributeCount> visibleInstances; // Laid out like the instance buffers, but only holding each draw's visible instances, packed at the start of its range
+        frameLinearAllocator::linearAllocation drawCommands;
+    };
+    sceneObjects cpuSceneObjects;
+    std::vector<std::array<float, 3>> cpuSceneColors; // Not something the scene update needs, but they get packed along with the rest
+    sceneKernels cpuSceneKernels = {};
+    // Bytes per instance of each attribute, in binding order
+    static constexpr std::array<VkDeviceSize, instanceData::attributeCount> cpuSceneAttributeSizes = { { sizeof(std::array<float, 2>), sizeof(std::array<float, 3>), sizeof(std::array<float, 4>) } };
+    std::vector<cpuSceneFrameAllocations> cpuSceneFrameAllocationsByFrame; // Indexed by frame in flight, and the same from one frame to the next (see allocateCpuSceneFrame), so that recordings made against them stay valid
+
+    // GPU culling (see shaders/cull.comp), only set up when enabled
+    // Every frame culls into the same buffers: frames are all submitted to the same queue, so the barriers the render graph puts in are enough to keep one frame's culling from overwriting what the previous one is still drawing from
+    struct cullingParameters {
+        float zoom;
+        float meshBoundingRadius;
+        std::uint32_t instanceCount;
+        std::uint32_t drawCount;
+        std::uint32_t indexCount;
+        std::uint32_t pass; // 0 culls instances, 1 compacts draws
+    };
+    VkDescriptorSetLayout vulkanCullingDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout vulkanCullingPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline vulkanCullingPipeline = VK_NULL_HANDLE;
+    VkDescriptorPool vulkanCullingDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet vulkanCullingDescriptorSet = VK_NULL_HANDLE;
+    VkBuffer vulkanDrawRangeBuffer = VK_NULL_HANDLE; // The draw list, as the culling shader sees it
+    gpuAllocation vulkanDrawRangeBufferAllocation;
+    std::array<VkBuffer, instanceData::attributeCount> vulkanVisibleInstanceBuffers = {}; // What we actually draw from when culling
+    std::array<gpuAllocation, instanceData::attributeCount> vulkanVisibleInstanceBufferAllocations;
+    VkBuffer vulkanDrawVisibleCountBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanDrawVisibleCountBufferAllocation;
+    VkBuffer vulkanDrawCommandBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanDrawCommandBufferAllocation;
+    VkBuffer vulkanDrawCommandCountBuffer = VK_NULL_HANDLE;
+    gpuAllocation vulkanDrawCommandCountBufferAllocation;
+    float meshBoundingRadius = 0;
+    std::array<renderGraph::resourceId, instanceData::attributeCount> visibleInstanceResources = {};
+    renderGraph::resourceId drawVisibleCountResource = 0;
+    renderGraph::resourceId drawCommandResource = 0;
+    renderGraph::resourceId drawCommandCountResource = 0;
+
+    // Only set up when capturing, and recorded every frame (unlike the frame's own command buffers, which we'd otherwise have to re-record for every capture slot), one per frame in flight
+    std::optional<frameCapture> capture;
+    std::vector<VkCommandBuffer> vulkanCaptureCommandBuffers;
+
+    // Only set up with --watch-shaders, in which case reloaded graphics shaders go to graphicsPipelines, and culling pipelines get rebuilt on the watcher thread and wait in pendingCullingPipelineSwaps for the start of the next frame to replace the current one
+    struct pendingPipelineSwap {
+        VkPipeline pipeline;
+        std::chrono::steady_clock::time_point changeTime; // When the source changed, so that we can tell how long it took to see it on screen
+    };
+    std::optional<shaderWatcher> shaderReloader;
+    std::mutex shaderReloadMutex; // Guards what the watcher thread hands over to the main thread, i.e. everything below
+    std::vector<pendingPipelineSwap> pendingCullingPipelineSwaps;
+    std::array<std::uint64_t, 2> reloadedGraphicsShaderHashes = {}; // Vertex then fragment, 0 until first reloaded
+    std::vector<std::uint64_t> addedGraphicsShaderHashes; // Everything handed to graphicsPipelines since updatePipelines last looked, including shaders replaced again before it could
+    std::optional<std::chrono::steady_clock::time_point> graphicsShaderChangeTime; // Until a pipeline with the reloaded shaders is in use
+
+    // Anything we replace while frames might still be using it goes in there (see deferDestruction)
+    deletionQueue vulkanDeletionQueue;
+
+    frameProfiler profiler;
+    framePacer pacer;
+    redrawScheduler redraws; // Only used with options.onDemand
     
 public:
-    vulkanSomethingOnTheScreenApp()
+    vulkanSomethingOnTheScreenApp(const applicationOptions &options)
+        : options(options), maxFramesInFlight(options.framesInFlight), profiler(options.profile, options.framesInFlight), pacer(options.framePacing)
     {
-        this->initializeGlfw();
+        auto startTime = std::chrono::steady_clock::now();
+
+        // There's no window at all when running headless, which is the whole point (we don't even want to need a display)
+        if (!this->options.headless)
+            this->initializeGlfw();
         this->initializeVulkan();
+
+        // Mostly useful to compare launches with a cold pipeline cache against launches with a warm one
+        std::chrono::duration<double, std::milli> elapsedTime = std::chrono::steady_clock::now() - startTime;
+        std::cout << "Startup took " << elapsedTime.count() << "ms (" << (this->wasPipelineCacheLoaded ? "warm" : "cold") << " pipeline cache)\n";
     }
 
     void initializeGlfw()
@@ -116,29 +306,79 @@ public:
         this->glfwWindow = glfwCreateWindow(this->windowWidth, this->windowHeight, this->name, nullptr, nullptr);
         glfwSetWindowUserPointer(this->glfwWindow, this);
         glfwSetFramebufferSizeCallback(this->glfwWindow, vulkanSomethingOnTheScreenApp::framebufferResizeCallback);
+        glfwSetKeyCallback(this->glfwWindow, vulkanSomethingOnTheScreenApp::keyCallback);
+
+        // Nothing we draw reacts to the mouse yet, but these are what an on-demand app redraws for, so we might as well pay for the redraws already
+        glfwSetMouseButtonCallback(this->glfwWindow, [](GLFWwindow *window, int, int, int) { getApp(window)->redraws.requestRedraw(redrawReason::input); });
+        glfwSetCursorPosCallback(this->glfwWindow, [](GLFWwindow *window, double, double) { getApp(window)->redraws.requestRedraw(redrawReason::input); });
+        glfwSetScrollCallback(this->glfwWindow, [](GLFWwindow *window, double, double) { getApp(window)->redraws.requestRedraw(redrawReason::input); });
+        glfwSetWindowRefreshCallback(this->glfwWindow, [](GLFWwindow *window) { getApp(window)->redraws.requestRedraw(redrawReason::expose); });
+    }
+
+    static vulkanSomethingOnTheScreenApp *getApp(GLFWwindow *window)
+    {
+        return reinterpret_cast<vulkanSomethingOnTheScreenApp *>(glfwGetWindowUserPointer(window));
     }
 
     static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
     {
-        auto self = reinterpret_cast<vulkanSomethingOnTheScreenApp *>(glfwGetWindowUserPointer(window));
+        auto self = getApp(window);
         self->framebufferResized = true;
+        self->redraws.requestRedraw(redrawReason::resize);
+    }
+
+    static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+    {
+        auto self = getApp(window);
+        self->redraws.requestRedraw(redrawReason::input);
+
+        // Lets us look at the frame timings without having to quit
+        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+            self->profiler.printReport(std::cout);
+        else if (key == GLFW_KEY_M && action == GLFW_PRESS)
+            self->memoryAllocator->printStats(std::cout);
+        else if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+            // Picked up by the next frame, which keeps the current blend mode until the new one is compiled (if it isn't already)
+            auto &blendMode = self->wantedGraphicsPipelineKey.blendMode;
+            blendMode = static_cast<pipelineBlendMode>((static_cast<std::size_t>(blendMode) + 1) % static_cast<std::size_t>(pipelineBlendMode::count));
+            std::cout << "Blending: " << getPipelineBlendModeName(blendMode) << '\n';
+        }
     }
 
     void initializeVulkan()
     {
         this->initializeVulkanInstance();
         this->initializeDebugMessenger();
-        this->initializeSurface();
+        if (!this->options.headless)
+            this->initializeSurface();
         this->initializePhysicalDevice();
         this->initializeLogicalDevice();
-        this->initializeSwapChain();
+        if (this->options.headless)
+            this->initializeHeadlessRenderTargets();
+        else
+            this->initializeSwapChain();
         this->initializeSwapChainImageViews();
-        this->initializeRenderPass();
+        this->initializeRenderGraph();
+        this->initializePipelineCache();
         this->initializeGraphicsPipeline();
-        this->initializeFramebuffers();
+        if (this->options.gpuCulling)
+            this->initializeCullingPipeline();
+        this->initializeRenderTargets();
         this->initializeCommandPool();
         this->initializeCommandBuffers();
+        this->initializeRecordingWorkers();
         this->initializeSyncObjects();
+        this->initializeProfiler();
+        this->initializeUploader();
+        this->initializeMeshBuffers();
+        if (this->options.gpuCulling)
+            this->initializeCullingBuffers();
+        if (this->options.cpuCulling)
+            this->initializeFrameLinearAllocators();
+        if (!this->options.captureDirectory.empty())
+            this->initializeCapture();
+        if (!this->options.watchShaderDirectory.empty())
+            this->initializeShaderWatcher();
     }
 
     void initializeVulkanInstance()
@@ -153,7 +393,7 @@ public:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "Does not use an engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2; // For timeline semaphores
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -216,14 +456,157 @@ public:
         physicalDevices.resize(physicalDeviceCount);
         vkEnumeratePhysicalDevices(this->vulkanInstance, &physicalDeviceCount, physicalDevices.data());
 
-        for (const auto &physicalDevice : physicalDevices)
-            if (this->isVulkanPhysicalDeviceSuitableForUs(physicalDevice)) {
-                this->vulkanPhysicalDevice = physicalDevice;
-                break;
+        physicalDeviceProbeCache probeCache;
+        if (!this->options.deviceCachePath.empty()) {
+            try {
+                probeCache = physicalDeviceProbeCache::parse(readFullFile(this->options.deviceCachePath));
+            } catch (const std::exception &) {
+                // Not having a cache yet is perfectly normal on the first launch
             }
+        }
 
-        if (this->vulkanPhysicalDevice == VK_NULL_HANDLE)
+        // Some drivers take their time answering (e.g. when they have to wake up a GPU that was powered down), so we ask all of the devices we don't know yet at once
+        std::vector<std::future<physicalDeviceProbe>> probeFutures;
+        for (auto physicalDevice : physicalDevices)
+            probeFutures.push_back(std::async(std::launch::async, [this, physicalDevice, &probeCache]() {
+                auto probe = probeVulkanPhysicalDeviceIdentity(physicalDevice);
+                if (auto cachedProbe = probeCache.find(probe))
+                    return cachedProbe.value();
+                this->probeVulkanPhysicalDeviceCapabilities(physicalDevice, probe);
+                return probe;
+            }));
+
+        std::vector<physicalDeviceProbe> probes;
+        for (auto &probeFuture : probeFutures)
+            probes.push_back(probeFuture.get());
+
+        // Best first, and in enumeration order between equals, leaving out the ones that can't run us at all
+        std::vector<std::size_t> rankedDeviceIndices;
+        for (std::size_t i = 0; i < probes.size(); ++i)
+            if (probes.at(i).getUnsuitableReason(!this->options.headless, this->options.gpuCulling).empty())
+                rankedDeviceIndices.push_back(i);
+        std::stable_sort(rankedDeviceIndices.begin(), rankedDeviceIndices.end(), [&](std::size_t a, std::size_t b) { return probes.at(a).getScore() > probes.at(b).getScore(); });
+
+        std::cout << "GPUs (use --device with an index or UUID to pick one):\n";
+        for (std::size_t i = 0; i < probes.size(); ++i) {
+            const auto &probe = probes.at(i);
+            auto unsuitableReason = probe.getUnsuitableReason(!this->options.headless, this->options.gpuCulling);
+            std::cout << "\t[" << i << "] " << probe.name << " (" << probe.getDeviceTypeName() << ", " << (probe.deviceLocalHeapSize >> 20) << "MB, UUID " << probe.getUUIDString() << (probe.wasLoadedFromCache ? ", cached" : "") << "): ";
+            if (unsuitableReason.empty())
+                std::cout << "score " << probe.getScore() << '\n';
+            else
+                std::cout << "unsuitable, " << unsuitableReason << '\n';
+        }
+
+        std::optional<std::size_t> chosenDeviceIndex;
+        if (!this->options.physicalDevice.empty()) {
+            for (std::size_t i = 0; i < probes.size() && !chosenDeviceIndex.has_value(); ++i)
+                if (doesPhysicalDeviceSelectorMatch(this->options.physicalDevice, i, probes.at(i)))
+                    chosenDeviceIndex = i;
+
+            // Quietly falling back to another GPU would defeat the point of asking for one
+            if (!chosenDeviceIndex.has_value())
+                throw std::runtime_error("No GPU matches '" + this->options.physicalDevice + "'");
+            auto unsuitableReason = probes.at(chosenDeviceIndex.value()).getUnsuitableReason(!this->options.headless, this->options.gpuCulling);
+            if (unsuitableReason.empty() && !this->isVulkanPhysicalDeviceSuitableForUs(physicalDevices.at(chosenDeviceIndex.value())))
+                unsuitableReason = "can't present to our window";
+            if (!unsuitableReason.empty())
+                throw std::runtime_error("The requested GPU is unsuitable: " + unsuitableReason);
+        } else
+            for (auto i : rankedDeviceIndices)
+                if (this->isVulkanPhysicalDeviceSuitableForUs(physicalDevices.at(i))) {
+                    chosenDeviceIndex = i;
+                    break;
+                }
+
+        if (!chosenDeviceIndex.has_value())
             throw std::runtime_error("Failed to find a GPU with Vulkan support that is suitable for us");
+
+        this->vulkanPhysicalDevice = physicalDevices.at(chosenDeviceIndex.value());
+        std::cout << "Using [" << chosenDeviceIndex.value() << "] " << probes.at(chosenDeviceIndex.value()).name << " (" << (this->options.physicalDevice.empty() ? "highest score" : "picked with --device") << ")\n";
+
+        // Only worth a write when we learnt something new
+        if (!this->options.deviceCachePath.empty() && std::any_of(probes.begin(), probes.end(), [](const physicalDeviceProbe &probe) { return !probe.wasLoadedFromCache && probe.hasUUID(); })) {
+            for (const auto &probe : probes)
+                probeCache.store(probe);
+            try {
+                writeFullFileAtomically(this->options.deviceCachePath, probeCache.serialize());
+            } catch (const std::exception &exception) {
+                std::cerr << "Failed to save the GPU probe cache: " << exception.what() << '\n'; // We'll just probe again next time
+            }
+        }
+    }
+
+    // Just the properties, which is what the probe cache is keyed by
+    static physicalDeviceProbe probeVulkanPhysicalDeviceIdentity(VkPhysicalDevice physicalDevice)
+    {
+        physicalDeviceProbe result;
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+        result.name = physicalDeviceProperties.deviceName;
+        result.vendorID = physicalDeviceProperties.vendorID;
+        result.deviceID = physicalDeviceProperties.deviceID;
+        result.driverVersion = physicalDeviceProperties.driverVersion;
+        result.apiVersion = physicalDeviceProperties.apiVersion;
+        result.deviceType = physicalDeviceProperties.deviceType;
+
+        // Device UUIDs are core in 1.1, and chaining the structure for a device older than that isn't allowed
+        if (result.apiVersion >= VK_API_VERSION_1_1) {
+            VkPhysicalDeviceIDProperties physicalDeviceIDProperties = {};
+            physicalDeviceIDProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+            VkPhysicalDeviceProperties2 physicalDeviceProperties2 = {};
+            physicalDeviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            physicalDeviceProperties2.pNext = &physicalDeviceIDProperties;
+            vkGetPhysicalDeviceProperties2(physicalDevice, &physicalDeviceProperties2);
+            std::copy(std::begin(physicalDeviceIDProperties.deviceUUID), std::end(physicalDeviceIDProperties.deviceUUID), result.deviceUUID.begin());
+        }
+
+        return result;
+    }
+
+    // Everything else we rank devices by, none of which depends on our window (see isVulkanPhysicalDeviceSuitableForUs for what does)
+    void probeVulkanPhysicalDeviceCapabilities(VkPhysicalDevice physicalDevice, physicalDeviceProbe &probe)
+    {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                probe.deviceLocalHeapSize = std::max(probe.deviceLocalHeapSize, memoryProperties.memoryHeaps[i].size);
+
+        std::uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        for (const auto &queueFamily : queueFamilies) {
+            if (queueFamily.queueCount == 0)
+                continue;
+            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                probe.hasGraphicsQueue = true;
+                probe.graphicsQueueCanCompute |= (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+            } else if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
+                probe.hasAsyncComputeQueue = true;
+            else if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+                probe.hasDedicatedTransferQueue = true;
+        }
+
+        std::uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+        probe.hasSwapchainExtension = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties &extension) { return std::strcmp(extension.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+
+        // Same as for the UUID, the structure can't be chained for devices that don't know about it (and they're unsuitable anyway)
+        if (probe.apiVersion >= VK_API_VERSION_1_2) {
+            VkPhysicalDeviceVulkan12Features physicalDeviceVulkan12Features = {};
+            physicalDeviceVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            VkPhysicalDeviceFeatures2 physicalDeviceFeatures = {};
+            physicalDeviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            physicalDeviceFeatures.pNext = &physicalDeviceVulkan12Features;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &physicalDeviceFeatures);
+            probe.hasTimelineSemaphores = physicalDeviceVulkan12Features.timelineSemaphore;
+            probe.hasDrawIndirectCount = physicalDeviceVulkan12Features.drawIndirectCount;
+        }
     }
 
     void initializeLogicalDevice()
@@ -234,6 +617,7 @@ public:
         std::unordered_set<std::uint32_t> uniqueQueueFamilyIndices = {
             familyIndices.graphicsFamily.value(),
             familyIndices.presentFamily.value(),
+            familyIndices.transferFamily.value(),
         };
 
         float queuePriority = 1.f;
@@ -249,16 +633,32 @@ public:
 
         VkPhysicalDeviceFeatures physicalDeviceFeatures = {};
 
+        // Culled draws start at their range's first instance, which indirect draws can only do with this (it's there on pretty much every desktop GPU, and lavapipe)
+        if (this->options.gpuCulling || this->options.cpuCulling) {
+            VkPhysicalDeviceFeatures supportedPhysicalDeviceFeatures;
+            vkGetPhysicalDeviceFeatures(this->vulkanPhysicalDevice, &supportedPhysicalDeviceFeatures);
+            if (!supportedPhysicalDeviceFeatures.drawIndirectFirstInstance)
+                throw std::runtime_error("Culling needs drawIndirectFirstInstance, which this GPU doesn't support");
+            physicalDeviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+
+        VkPhysicalDeviceVulkan12Features physicalDeviceVulkan12Features = {};
+        physicalDeviceVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        physicalDeviceVulkan12Features.timelineSemaphore = VK_TRUE;
+        physicalDeviceVulkan12Features.drawIndirectCount = this->options.gpuCulling ? VK_TRUE : VK_FALSE;
+
         VkDeviceCreateInfo deviceCreateInfo = {};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceCreateInfo.pNext = &physicalDeviceVulkan12Features;
 
         deviceCreateInfo.queueCreateInfoCount = static_cast<std::uint32_t>(deviceQueueCreateInfos.size());
         deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos.data();
         deviceCreateInfo.pEnabledFeatures = &physicalDeviceFeatures;
 
         // Using swapchains requires us to enable the VK_KHR_swapchain extension here
-        deviceCreateInfo.enabledExtensionCount = static_cast<std::uint32_t>(this->requiredVulkanDeviceExtensions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = this->requiredVulkanDeviceExtensions.data();
+        auto requiredDeviceExtensions = this->getRequiredVulkanDeviceExtensions();
+        deviceCreateInfo.enabledExtensionCount = static_cast<std::uint32_t>(requiredDeviceExtensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
 
         deviceCreateInfo.enabledLayerCount = static_cast<std::uint32_t>(this->validationLayers.size());
         deviceCreateInfo.ppEnabledLayerNames = this->validationLayers.data();
@@ -268,6 +668,9 @@ public:
 
         vkGetDeviceQueue(this->vulkanDevice, familyIndices.graphicsFamily.value(), 0, &this->vulkanGraphicsQueue);
         vkGetDeviceQueue(this->vulkanDevice, familyIndices.presentFamily.value(), 0, &this->vulkanPresentQueue);
+        vkGetDeviceQueue(this->vulkanDevice, familyIndices.transferFamily.value(), 0, &this->vulkanTransferQueue);
+
+        this->memoryAllocator.emplace(this->vulkanPhysicalDevice, this->vulkanDevice);
     }
 
     void initializeSwapChain()
@@ -278,7 +681,13 @@ public:
         auto extent = this->chooseVulkanSwapExtent(swapChainSupport.capabilities);
 
         // Sticking to the required minimum image count might mean we'd have to wait on the driver to complete internal operations before it could acquire other images to render, so it's recommended to request at least one more image than the minimum (while making sure that doesn't exceed the maximum either (note: maxImageCount == 0 means there is no maximum))
+        // Whoever runs us can override that though, since fewer images means less latency and more images means fewer stalls
         std::uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (this->options.swapChainImageCount != 0) {
+            imageCount = std::max(this->options.swapChainImageCount, swapChainSupport.capabilities.minImageCount);
+            if (imageCount != this->options.swapChainImageCount)
+                std::cerr << "Requested " << this->options.swapChainImageCount << " swap chain images but the surface needs at least " << imageCount << ", using that instead\n";
+        }
         if (swapChainSupport.capabilities.maxImageCount != 0)
             imageCount = std::min(imageCount, swapChainSupport.capabilities.maxImageCount);
 
@@ -294,6 +703,13 @@ public:
         createInfo.imageArrayLayers = 1; // We're not developing a stereoscopic 3D application lol
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+        // Capturing copies out of the swap chain images, which not every surface allows
+        if (!this->options.captureDirectory.empty()) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+                throw std::runtime_error("Failed to create a swap chain that can be captured (its images can't be copied from)");
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+
         // VK_SHARING_MODE_EXCLUSIVE has the best performance, so use it when possible (i.e. when we have the same graphics and presenting family indices). Apparently it's also possible to do otherwise but I'm not gonna try to do EVEN MORE stuff just to handle that
         auto familyIndices = this->findVulkanQueueFamilies(this->vulkanPhysicalDevice);
         std::array<std::uint32_t, 2> queueFamilyIndices = {
@@ -322,8 +738,8 @@ public:
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE; // We don't want to read back pixels that were obscured or anything like that, so allowing clipping is fine
 
-        // We assume we'll only ever create one swap chain because handling it is otherwise a complete mess (this is also why we don't support stuff like resizing btw, and yes that'd require making a new swap chain lol)
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // When recreating the swap chain, handing over the old one lets the driver reuse its resources and lets frames that are still in flight on the old one finish presenting (it's VK_NULL_HANDLE the first time around)
+        createInfo.oldSwapchain = this->vulkanSwapChain;
 
         if (vkCreateSwapchainKHR(this->vulkanDevice, &createInfo, nullptr, &this->vulkanSwapChain) != VK_SUCCESS)
             throw std::runtime_error("Failed to create swap chain");
@@ -337,6 +753,45 @@ public:
         this->vulkanSwapChainExtent = extent;
     }
 
+    // Stands in for initializeSwapChain when running headless: we make our own device-local images to render to, so that everything from the image views onwards doesn't need to know there's no swap chain
+    void initializeHeadlessRenderTargets()
+    {
+        // Each frame in flight gets its own image, so waiting on a frame's timeline value is enough to know its image isn't in use anymore (there's no presentation engine holding onto images here)
+        this->vulkanSwapChainImages.resize(this->maxFramesInFlight);
+        this->vulkanHeadlessImageAllocations.resize(this->maxFramesInFlight);
+
+        this->vulkanSwapChainImageFormat = this->headlessImageFormat;
+        this->vulkanSwapChainExtent = this->headlessExtent;
+
+        for (std::size_t i = 0; i < this->vulkanSwapChainImages.size(); ++i) {
+            VkImageCreateInfo imageCreateInfo = {};
+            imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+
+            imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageCreateInfo.format = this->vulkanSwapChainImageFormat;
+            imageCreateInfo.extent = { this->vulkanSwapChainExtent.width, this->vulkanSwapChainExtent.height, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+
+            // We also allow copying from the images so that their contents can be read back (which is pretty much the only way to see what we rendered when headless)
+            imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Only the graphics queue ever touches these
+            imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(this->vulkanDevice, &imageCreateInfo, nullptr, &this->vulkanSwapChainImages.at(i)) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create headless render target image");
+
+            VkMemoryRequirements memoryRequirements;
+            vkGetImageMemoryRequirements(this->vulkanDevice, this->vulkanSwapChainImages.at(i), &memoryRequirements);
+
+            auto &allocation = this->vulkanHeadlessImageAllocations.at(i);
+            allocation = this->memoryAllocator->allocate(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gpuResourceKind::optimalImage);
+            vkBindImageMemory(this->vulkanDevice, this->vulkanSwapChainImages.at(i), allocation.memory, allocation.offset);
+        }
+    }
+
     void initializeSwapChainImageViews()
     {
         this->vulkanSwapChainImageViews.resize(this->vulkanSwapChainImages.size());
@@ -369,58 +824,218 @@ public:
         }
     }
 
-    void initializeRenderPass()
+    // Culling (when enabled) then drawing, with the render graph working out the render pass and every barrier from what each pass uses
+    void initializeRenderGraph()
+    {
+        // Our frame doesn't use what the graph does for transient images, so we make sure it still works on a graph that does
+        renderGraph::checkCompilation();
+
+        // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR comes from VK_KHR_swapchain which we don't enable when headless, so there we leave the images ready to be copied out instead
+        // Either way, the images are handed to us at the color attachment output stage (see submitFrame), which is where the graph first needs them
+        this->swapChainImageResource = this->frameRenderGraph.importImage("swap chain image", this->vulkanSwapChainImageFormat, this->options.headless ? renderGraphUsage::transferSource : renderGraphUsage::present);
+
+        if (this->options.gpuCulling) {
+            for (std::size_t i = 0; i < instanceData::attributeCount; ++i)
+                this->visibleInstanceResources.at(i) = this->frameRenderGraph.importBuffer("visible instances " + std::to_string(i));
+            this->drawVisibleCountResource = this->frameRenderGraph.importBuffer("draw visible counts");
+            this->drawCommandResource = this->frameRenderGraph.importBuffer("draw commands");
+            this->drawCommandCountResource = this->frameRenderGraph.importBuffer("draw command count");
+
+            auto resetPass = this->frameRenderGraph.addPass("reset culling counts", renderGraphPassKind::transfer, [this](VkCommandBuffer commandBuffer) { this->recordCullingReset(commandBuffer); });
+            this->frameRenderGraph.use(resetPass, this->drawVisibleCountResource, renderGraphUsage::transferDestination);
+            this->frameRenderGraph.use(resetPass, this->drawCommandCountResource, renderGraphUsage::transferDestination);
+
+            auto cullPass = this->frameRenderGraph.addPass("cull instances", renderGraphPassKind::compute, [this](VkCommandBuffer commandBuffer) { this->recordCullingPass(commandBuffer, 0); });
+            this->frameRenderGraph.use(cullPass, this->drawVisibleCountResource, renderGraphUsage::storageWrite);
+            for (auto resource : this->visibleInstanceResources)
+                this->frameRenderGraph.use(cullPass, resource, renderGraphUsage::storageWrite);
+
+            auto compactPass = this->frameRenderGraph.addPass("compact draws", renderGraphPassKind::compute, [this](VkCommandBuffer commandBuffer) { this->recordCullingPass(commandBuffer, 1); });
+            this->frameRenderGraph.use(compactPass, this->drawVisibleCountResource, renderGraphUsage::storageRead);
+            this->frameRenderGraph.use(compactPass, this->drawCommandResource, renderGraphUsage::storageWrite);
+            this->frameRenderGraph.use(compactPass, this->drawCommandCountResource, renderGraphUsage::storageWrite);
+        }
+
+        // With recording threads, the whole subpass is made of the secondary command buffers they record (a subpass can't mix those with inline commands)
+        this->drawPass = this->frameRenderGraph.addPass("draw", renderGraphPassKind::graphics, [this](VkCommandBuffer commandBuffer) { this->recordDrawPass(commandBuffer); }, this->options.recordThreadCount != 0 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+        // We clear the screen with completely black black
+        VkClearValue clearColor = {{{0.f, 0.f, 0.f, 1.f}}};
+        this->frameRenderGraph.use(this->drawPass, this->swapChainImageResource, renderGraphUsage::colorAttachment, clearColor);
+        if (this->options.gpuCulling) {
+            this->frameRenderGraph.use(this->drawPass, this->drawCommandResource, renderGraphUsage::indirectBuffer);
+            this->frameRenderGraph.use(this->drawPass, this->drawCommandCountResource, renderGraphUsage::indirectBuffer);
+            for (auto resource : this->visibleInstanceResources)
+                this->frameRenderGraph.use(this->drawPass, resource, renderGraphUsage::vertexBuffer);
+        }
+
+        this->frameRenderGraph.compile();
+        this->frameRenderGraph.createRenderPasses(this->vulkanDevice);
+    }
+
+    void initializePipelineCache()
+    {
+        std::string initialData;
+        if (!this->options.pipelineCachePath.empty()) {
+            try {
+                initialData = readFullFile(this->options.pipelineCachePath);
+            } catch (const std::exception &) {
+                // Not having a cache yet is perfectly normal on the first launch
+            }
+
+            if (!initialData.empty()) {
+                if (this->isPipelineCacheDataUsable(initialData))
+                    this->wasPipelineCacheLoaded = true;
+                else {
+                    std::cerr << "Ignoring pipeline cache at " << this->options.pipelineCachePath << " since it was made for another device or driver (or is corrupted)\n";
+                    initialData.clear();
+                }
+            }
+        }
+
+        VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        // We skip our own header here, the driver only wants what it gave us when we saved the cache
+        if (this->wasPipelineCacheLoaded) {
+            pipelineCacheCreateInfo.initialDataSize = initialData.size() - sizeof(pipelineCacheFileHeader);
+            pipelineCacheCreateInfo.pInitialData = initialData.data() + sizeof(pipelineCacheFileHeader);
+        }
+
+        if (vkCreatePipelineCache(this->vulkanDevice, &pipelineCacheCreateInfo, nullptr, &this->vulkanPipelineCache) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline cache");
+    }
+
+    // What we put in front of the driver's own pipeline cache data when saving it to disk
+    // The driver's data has a header of its own, but it doesn't include the driver version, and drivers are known to not always cope well with data coming from another version of themselves, so we add it in here
+    struct pipelineCacheFileHeader {
+        static constexpr std::uint32_t expectedMagic = 0x43505456; // "VTPC" when read as little-endian
+        std::uint32_t magic;
+        std::uint32_t vendorID;
+        std::uint32_t deviceID;
+        std::uint32_t driverVersion;
+        std::uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        std::uint64_t dataSize;
+    };
+
+    pipelineCacheFileHeader makePipelineCacheFileHeader(std::uint64_t dataSize)
     {
-        VkAttachmentDescription colorAttachmentDescription = {};
-        colorAttachmentDescription.format = this->vulkanSwapChainImageFormat;
-        colorAttachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(this->vulkanPhysicalDevice, &physicalDeviceProperties);
+
+        pipelineCacheFileHeader result = {};
+        result.magic = pipelineCacheFileHeader::expectedMagic;
+        result.vendorID = physicalDeviceProperties.vendorID;
+        result.deviceID = physicalDeviceProperties.deviceID;
+        result.driverVersion = physicalDeviceProperties.driverVersion;
+        std::memcpy(result.pipelineCacheUUID, physicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+        result.dataSize = dataSize;
+        return result;
+    }
 
-        colorAttachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    // Feeding the driver a cache from another device or driver version is at best useless and at worst a crash, so we check both our header and the driver's own one before using anything
+    bool isPipelineCacheDataUsable(std::string_view fileData)
+    {
+        if (fileData.size() < sizeof(pipelineCacheFileHeader) + sizeof(VkPipelineCacheHeaderVersionOne))
+            return false;
 
-        colorAttachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        pipelineCacheFileHeader fileHeader;
+        std::memcpy(&fileHeader, fileData.data(), sizeof(fileHeader));
 
-        colorAttachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachmentDescription.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        auto expectedFileHeader = this->makePipelineCacheFileHeader(fileData.size() - sizeof(pipelineCacheFileHeader));
+        if (std::memcmp(&fileHeader, &expectedFileHeader, sizeof(fileHeader)) != 0)
+            return false;
 
-        VkAttachmentReference colorAttachmentReference = {};
-        colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        VkPipelineCacheHeaderVersionOne driverHeader;
+        std::memcpy(&driverHeader, fileData.data() + sizeof(pipelineCacheFileHeader), sizeof(driverHeader));
 
-        VkSubpassDescription subpassDescription = {};
-        subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        return driverHeader.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+            driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            driverHeader.vendorID == expectedFileHeader.vendorID &&
+            driverHeader.deviceID == expectedFileHeader.deviceID &&
+            std::memcmp(driverHeader.pipelineCacheUUID, expectedFileHeader.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
 
-        subpassDescription.colorAttachmentCount = 1;
-        subpassDescription.pColorAttachments = &colorAttachmentReference;
+    void savePipelineCache()
+    {
+        if (this->options.pipelineCachePath.empty())
+            return;
 
-        VkRenderPassCreateInfo renderPassCreateInfo = {};
-        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassCreateInfo.attachmentCount = 1;
-        renderPassCreateInfo.pAttachments = &colorAttachmentDescription;
-        renderPassCreateInfo.subpassCount = 1;
-        renderPassCreateInfo.pSubpasses = &subpassDescription;
+        std::size_t dataSize = 0;
+        if (vkGetPipelineCacheData(this->vulkanDevice, this->vulkanPipelineCache, &dataSize, nullptr) != VK_SUCCESS)
+            throw std::runtime_error("Failed to get pipeline cache data size");
 
-        VkSubpassDependency subpassDependency = {};
-        subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL; // The implicit subpass before the render pass
-        subpassDependency.dstSubpass = 0; // Our pass, the first and only one
-        subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // We need to wait for the swap chain to finish reading from the image before we can access it
-        subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // Prevent the transition from happening until it's actually necessary (and allowed)
-        subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        std::string fileData(sizeof(pipelineCacheFileHeader) + dataSize, '\0');
+        if (vkGetPipelineCacheData(this->vulkanDevice, this->vulkanPipelineCache, &dataSize, fileData.data() + sizeof(pipelineCacheFileHeader)) != VK_SUCCESS)
+            throw std::runtime_error("Failed to get pipeline cache data");
+        fileData.resize(sizeof(pipelineCacheFileHeader) + dataSize);
 
-        renderPassCreateInfo.dependencyCount = 1;
-        renderPassCreateInfo.pDependencies = &subpassDependency;
+        auto fileHeader = this->makePipelineCacheFileHeader(dataSize);
+        std::memcpy(fileData.data(), &fileHeader, sizeof(fileHeader));
 
-        if (vkCreateRenderPass(this->vulkanDevice, &renderPassCreateInfo, nullptr, &this->vulkanRenderPass) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create render pass");
+        writeFullFileAtomically(this->options.pipelineCachePath, fileData);
     }
 
     void initializeGraphicsPipeline()
     {
-        auto vertShaderCode = readFullFile("./shaders/vert.spv");
-        auto fragShaderCode = readFullFile("./shaders/frag.spv");
+        // The zoom factor for the vertex shader
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(float);
+
+        VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+        layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutCreateInfo.pushConstantRangeCount = 1;
+        layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(this->vulkanDevice, &layoutCreateInfo, nullptr, &this->vulkanPipelineLayout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline layout");
+
+        // A few threads are enough to compile all of the variants we ever use at once, and more would just take cores away from recording
+        auto compileThreadCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+        this->graphicsPipelines.emplace(this->vulkanDevice, compileThreadCount, [this](const graphicsPipelineKey &key, spirvCodeView vertexCode, spirvCodeView fragmentCode) { return this->createGraphicsPipeline(key, vertexCode, fragmentCode); }, [this]() {
+            // A variant a frame had to do without is ready, and nothing else might be about to draw a frame when rendering on demand
+            this->redraws.requestRedraw(redrawReason::data);
+            if (!this->options.headless)
+                glfwPostEmptyEvent();
+        });
+
+        this->wantedGraphicsPipelineKey.vertexShaderHash = this->useShaderCode("vert.spv", [this](spirvCodeView code) { return this->graphicsPipelines->addShaderCode(code); });
+        this->wantedGraphicsPipelineKey.fragmentShaderHash = this->useShaderCode("frag.spv", [this](spirvCodeView code) { return this->graphicsPipelines->addShaderCode(code); });
+        this->wantedGraphicsPipelineKey.renderPass = this->frameRenderGraph.getRenderPass(this->drawPass);
+        this->wantedGraphicsPipelineKey.subpass = this->frameRenderGraph.getSubpass(this->drawPass);
+        this->wantedGraphicsPipelineKey.blendMode = this->options.blendMode;
+
+        auto pipelineCreationStartTime = std::chrono::steady_clock::now();
+
+        // There's nothing to fall back to yet, so this is the one time we wait for a variant to compile
+        this->vulkanGraphicsPipeline = this->graphicsPipelines->get(this->wantedGraphicsPipelineKey);
+        this->inUseGraphicsShaderHashes = { this->wantedGraphicsPipelineKey.vertexShaderHash, this->wantedGraphicsPipelineKey.fragmentShaderHash };
+
+        std::chrono::duration<double, std::milli> pipelineCreationTime = std::chrono::steady_clock::now() - pipelineCreationStartTime;
+        std::cout << "Graphics pipeline creation took " << pipelineCreationTime.count() << "ms\n";
+
+        // So that switching blend modes with B doesn't even have to wait for them
+        if (!this->options.headless)
+            for (std::size_t i = 0; i < static_cast<std::size_t>(pipelineBlendMode::count); ++i) {
+                auto key = this->wantedGraphicsPipelineKey;
+                key.blendMode = static_cast<pipelineBlendMode>(i);
+                this->graphicsPipelines->prepare(key);
+            }
+    }
 
-        auto vertShaderModule = this->createVulkanShaderModuleFromCode(vertShaderCode);
-        auto fragShaderModule = this->createVulkanShaderModuleFromCode(fragShaderCode);
+    // Called on the threads of graphicsPipelines, which is fine since it only depends on things that never change once we're up and running (the layout, the render pass and the pipeline cache, which is thread-safe)
+    VkPipeline createGraphicsPipeline(const graphicsPipelineKey &key, spirvCodeView vertexCode, spirvCodeView fragmentCode)
+    {
+        auto vertShaderModule = this->createVulkanShaderModuleFromCode(vertexCode);
+        VkShaderModule fragShaderModule;
+        try {
+            fragShaderModule = this->createVulkanShaderModuleFromCode(fragmentCode);
+        } catch (...) {
+            vkDestroyShaderModule(this->vulkanDevice, vertShaderModule, nullptr);
+            throw;
+        }
 
         VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo = {};
         vertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -448,11 +1063,25 @@ public:
         VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
         vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
+        // Per-vertex attributes come from a single interleaved vertex buffer, and per-instance ones from one buffer each
+        std::vector<VkVertexInputBindingDescription> vertexBindingDescriptions = { vertex::getBindingDescription(0) };
+        auto instanceBindingDescriptions = instanceData::getBindingDescriptions();
+        vertexBindingDescriptions.insert(vertexBindingDescriptions.end(), instanceBindingDescriptions.begin(), instanceBindingDescriptions.end());
+
+        auto perVertexAttributeDescriptions = vertex::getAttributeDescriptions(0);
+        auto instanceAttributeDescriptions = instanceData::getAttributeDescriptions();
+        std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions(perVertexAttributeDescriptions.begin(), perVertexAttributeDescriptions.end());
+        vertexAttributeDescriptions.insert(vertexAttributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+
+        vertexInputStateCreateInfo.vertexBindingDescriptionCount = static_cast<std::uint32_t>(vertexBindingDescriptions.size());
+        vertexInputStateCreateInfo.pVertexBindingDescriptions = vertexBindingDescriptions.data();
+        vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<std::uint32_t>(vertexAttributeDescriptions.size());
+        vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions.data();
+
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
         inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 
-        // We intend to draw triangles
-        inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyStateCreateInfo.topology = key.topology;
         inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
 
         VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
@@ -482,11 +1111,20 @@ public:
 
         VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {};
         colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-        colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        // Source and destination factors for color, then for alpha, in pipelineBlendMode order
+        static constexpr std::array<std::array<VkBlendFactor, 4>, static_cast<std::size_t>(pipelineBlendMode::count)> blendFactors = {
+            {
+                { VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO },
+                { VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE },
+            }
+        };
+        const auto &factors = blendFactors.at(static_cast<std::size_t>(key.blendMode));
+        colorBlendAttachmentState.blendEnable = key.blendMode != pipelineBlendMode::opaque;
+        colorBlendAttachmentState.srcColorBlendFactor = factors.at(0);
+        colorBlendAttachmentState.dstColorBlendFactor = factors.at(1);
         colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-        colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-        colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachmentState.srcAlphaBlendFactor = factors.at(2);
+        colorBlendAttachmentState.dstAlphaBlendFactor = factors.at(3);
         colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
         VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {};
@@ -508,12 +1146,6 @@ public:
         dynamicStateCreateInfo.dynamicStateCount = static_cast<std::uint32_t>(dynamicStates.size());
         dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
 
-        VkPipelineLayoutCreateInfo layoutCreateInfo = {};
-        layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-        if (vkCreatePipelineLayout(this->vulkanDevice, &layoutCreateInfo, nullptr, &this->vulkanPipelineLayout) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create pipeline layout");
-
         VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {};
         graphicsPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 
@@ -531,45 +1163,222 @@ public:
                 
         graphicsPipelineCreateInfo.layout = this->vulkanPipelineLayout;
 
-        graphicsPipelineCreateInfo.renderPass = this->vulkanRenderPass;
-        graphicsPipelineCreateInfo.subpass = 0;
+        graphicsPipelineCreateInfo.renderPass = key.renderPass;
+        graphicsPipelineCreateInfo.subpass = key.subpass;
 
         // We don't want to derive from any base pipeline
         graphicsPipelineCreateInfo.basePipelineIndex = -1;
 
-        if (vkCreateGraphicsPipelines(this->vulkanDevice, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, nullptr, &this->vulkanGraphicsPipeline) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create graphics pipeline");
-                
+        VkPipeline result;
+        auto vkCreateGraphicsPipelinesResult = vkCreateGraphicsPipelines(this->vulkanDevice, this->vulkanPipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &result);
+
         vkDestroyShaderModule(this->vulkanDevice, fragShaderModule, nullptr);
         vkDestroyShaderModule(this->vulkanDevice, vertShaderModule, nullptr);
+
+        if (vkCreateGraphicsPipelinesResult != VK_SUCCESS)
+            throw std::runtime_error("Failed to create graphics pipeline");
+        return result;
+    }
+
+    void initializeCullingPipeline()
+    {
+        // Bindings 0 to 9 of cull.comp, which are all storage buffers
+        std::array<VkDescriptorSetLayoutBinding, 10> descriptorSetLayoutBindings = {};
+        for (std::uint32_t i = 0; i < descriptorSetLayoutBindings.size(); ++i) {
+            descriptorSetLayoutBindings.at(i).binding = i;
+            descriptorSetLayoutBindings.at(i).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorSetLayoutBindings.at(i).descriptorCount = 1;
+            descriptorSetLayoutBindings.at(i).stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+        descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCreateInfo.bindingCount = static_cast<std::uint32_t>(descriptorSetLayoutBindings.size());
+        descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings.data();
+
+        if (vkCreateDescriptorSetLayout(this->vulkanDevice, &descriptorSetLayoutCreateInfo, nullptr, &this->vulkanCullingDescriptorSetLayout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling descriptor set layout");
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(cullingParameters);
+
+        VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+        layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutCreateInfo.setLayoutCount = 1;
+        layoutCreateInfo.pSetLayouts = &this->vulkanCullingDescriptorSetLayout;
+        layoutCreateInfo.pushConstantRangeCount = 1;
+        layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(this->vulkanDevice, &layoutCreateInfo, nullptr, &this->vulkanCullingPipelineLayout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling pipeline layout");
+
+        auto cullShaderModule = this->createVulkanShaderModule("cull.spv");
+        this->vulkanCullingPipeline = this->createCullingPipeline(cullShaderModule);
+        vkDestroyShaderModule(this->vulkanDevice, cullShaderModule, nullptr);
+    }
+
+    // Callable from any thread, like createGraphicsPipeline
+    VkPipeline createCullingPipeline(VkShaderModule cullShaderModule)
+    {
+        VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+        computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computePipelineCreateInfo.stage.module = cullShaderModule;
+        computePipelineCreateInfo.stage.pName = "main";
+        computePipelineCreateInfo.layout = this->vulkanCullingPipelineLayout;
+        computePipelineCreateInfo.basePipelineIndex = -1;
+
+        VkPipeline result;
+        if (vkCreateComputePipelines(this->vulkanDevice, this->vulkanPipelineCache, 1, &computePipelineCreateInfo, nullptr, &result) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling pipeline");
+        return result;
+    }
+
+    void initializeShaderWatcher()
+    {
+        std::vector<shaderWatcher::source> sources = { { "shader.vert", "vert.spv" }, { "shader.frag", "frag.spv" } };
+        if (this->options.gpuCulling)
+            sources.push_back({ "cull.comp", "cull.spv" });
+
+        this->shaderReloader.emplace(this->options.watchShaderDirectory, std::move(sources), [this](const std::string &spirvFileName, spirvCodeView code, std::chrono::steady_clock::time_point changeTime) {
+            this->rebuildPipelineForShader(spirvFileName, code, changeTime);
+        });
+        std::cout << "Watching " << this->options.watchShaderDirectory << " for shader changes\n";
+    }
+
+    // Runs on the watcher thread, so it must stay away from anything the main thread changes (the device, the pipeline layouts, the render pass and the pipeline cache are all fair game, as none of them ever change once we're running)
+    void rebuildPipelineForShader(const std::string &spirvFileName, spirvCodeView code, std::chrono::steady_clock::time_point changeTime)
+    {
+        // Graphics pipelines get compiled by graphicsPipelines as soon as a frame asks for one with the new shaders
+        // The code is added with the lock held, so that updatePipelines can't evict it between the two
+        if (spirvFileName != "cull.spv") {
+            std::lock_guard lock(this->shaderReloadMutex);
+            auto hash = this->graphicsPipelines->addShaderCode(code);
+            this->addedGraphicsShaderHashes.push_back(hash);
+            this->reloadedGraphicsShaderHashes.at(spirvFileName == "vert.spv" ? 0 : 1) = hash;
+            this->graphicsShaderChangeTime = changeTime;
+        } else {
+            auto pipelineCreationStartTime = std::chrono::steady_clock::now();
+
+            auto cullShaderModule = this->createVulkanShaderModuleFromCode(code);
+            pendingPipelineSwap swap = { VK_NULL_HANDLE, changeTime };
+            try {
+                swap.pipeline = this->createCullingPipeline(cullShaderModule);
+            } catch (...) {
+                vkDestroyShaderModule(this->vulkanDevice, cullShaderModule, nullptr);
+                throw;
+            }
+            vkDestroyShaderModule(this->vulkanDevice, cullShaderModule, nullptr);
+
+            std::chrono::duration<double, std::milli> pipelineCreationTime = std::chrono::steady_clock::now() - pipelineCreationStartTime;
+            std::cout << "Shader hot reload: rebuilt the culling pipeline in " << pipelineCreationTime.count() << "ms\n";
+
+            std::lock_guard lock(this->shaderReloadMutex);
+            this->pendingCullingPipelineSwaps.push_back(swap);
+        }
+
+        // Nothing else might be about to draw a frame when rendering on demand
+        this->redraws.requestRedraw(redrawReason::data);
+        if (!this->options.headless)
+            glfwPostEmptyEvent();
     }
 
-    void initializeFramebuffers()
+    // Puts the pipelines we want in place, before anything of this frame gets recorded with the old ones
+    // A graphics pipeline variant that isn't compiled yet doesn't hold anything up: we keep drawing with the one we have until it is
+    void updatePipelines()
     {
-        this->vulkanSwapChainFramebuffers.resize(this->vulkanSwapChainImageViews.size());
+        std::vector<pendingPipelineSwap> cullingPipelineSwaps;
+        std::optional<std::chrono::steady_clock::time_point> graphicsShaderChangeTime;
+        if (this->shaderReloader.has_value()) {
+            std::lock_guard lock(this->shaderReloadMutex);
+            cullingPipelineSwaps.swap(this->pendingCullingPipelineSwaps);
+
+            // Shaders the reloads replaced (including any replaced again before we got to see them) are no use anymore, unless we're still drawing with them
+            std::vector<std::uint64_t> supersededShaderHashes;
+            supersededShaderHashes.swap(this->addedGraphicsShaderHashes);
+            supersededShaderHashes.push_back(this->wantedGraphicsPipelineKey.vertexShaderHash);
+            supersededShaderHashes.push_back(this->wantedGraphicsPipelineKey.fragmentShaderHash);
+            if (this->reloadedGraphicsShaderHashes.at(0) != 0)
+                this->wantedGraphicsPipelineKey.vertexShaderHash = this->reloadedGraphicsShaderHashes.at(0);
+            if (this->reloadedGraphicsShaderHashes.at(1) != 0)
+                this->wantedGraphicsPipelineKey.fragmentShaderHash = this->reloadedGraphicsShaderHashes.at(1);
+            this->evictGraphicsShaders(supersededShaderHashes);
+            graphicsShaderChangeTime = this->graphicsShaderChangeTime;
+        }
+
+        auto graphicsPipeline = this->graphicsPipelines->find(this->wantedGraphicsPipelineKey);
+        bool isGraphicsPipelineChanging = graphicsPipeline != VK_NULL_HANDLE && graphicsPipeline != this->vulkanGraphicsPipeline;
+        if (!isGraphicsPipelineChanging && cullingPipelineSwaps.empty())
+            return;
+
+        // The old graphics pipeline only stays in the cache while its shaders are still wanted (like when switching blend modes, so that going back costs nothing), otherwise it's retired along with them once the GPU is done with it
+        if (isGraphicsPipelineChanging) {
+            auto outgoingShaderHashes = this->inUseGraphicsShaderHashes;
+            this->vulkanGraphicsPipeline = graphicsPipeline;
+            this->inUseGraphicsShaderHashes = { this->wantedGraphicsPipelineKey.vertexShaderHash, this->wantedGraphicsPipelineKey.fragmentShaderHash };
+            if (this->shaderReloader.has_value()) {
+                std::lock_guard lock(this->shaderReloadMutex);
+                this->evictGraphicsShaders({ outgoingShaderHashes.begin(), outgoingShaderHashes.end() });
+            }
+
+            if (graphicsShaderChangeTime.has_value()) {
+                std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - graphicsShaderChangeTime.value();
+                std::cout << "Shader hot reload: new graphics pipeline in use " << latency.count() << "ms after the change\n";
+
+                std::lock_guard lock(this->shaderReloadMutex);
+                if (this->graphicsShaderChangeTime == graphicsShaderChangeTime)
+                    this->graphicsShaderChangeTime.reset();
+            }
+        }
+
+        for (const auto &swap : cullingPipelineSwaps) {
+            this->deferDestruction([device = this->vulkanDevice, oldPipeline = this->vulkanCullingPipeline]() {
+                vkDestroyPipeline(device, oldPipeline, nullptr);
+            });
+            this->vulkanCullingPipeline = swap.pipeline;
 
-        for (std::size_t i = 0; i < this->vulkanSwapChainImageViews.size(); ++i) {
-            VkFramebufferCreateInfo framebufferCreateInfo = {};
-            framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - swap.changeTime;
+            std::cout << "Shader hot reload: new culling pipeline in use " << latency.count() << "ms after the change\n";
+        }
 
-            framebufferCreateInfo.renderPass = this->vulkanRenderPass;
-            framebufferCreateInfo.attachmentCount = 1;
-            framebufferCreateInfo.pAttachments = &this->vulkanSwapChainImageViews[i];
-            framebufferCreateInfo.width = this->vulkanSwapChainExtent.width;
-            framebufferCreateInfo.height = this->vulkanSwapChainExtent.height;
-            framebufferCreateInfo.layers = 1;
+        this->invalidateRecordings(recordingDependency::pipeline);
+    }
 
-            if (vkCreateFramebuffer(this->vulkanDevice, &framebufferCreateInfo, nullptr, &this->vulkanSwapChainFramebuffers[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to create framebuffer");
+    // Drops the shaders (and every pipeline variant built from them) that are neither wanted, in use nor about to be, so that the cache doesn't keep growing with every hot reload
+    // With shaderReloadMutex held, so that the watcher can't hand one of them over again while we're evicting it
+    void evictGraphicsShaders(const std::vector<std::uint64_t> &shaderHashes)
+    {
+        for (auto shaderHash : shaderHashes) {
+            bool isWanted = shaderHash == this->wantedGraphicsPipelineKey.vertexShaderHash || shaderHash == this->wantedGraphicsPipelineKey.fragmentShaderHash;
+            bool isInUse = shaderHash == this->inUseGraphicsShaderHashes.at(0) || shaderHash == this->inUseGraphicsShaderHashes.at(1);
+            bool isReloaded = shaderHash == this->reloadedGraphicsShaderHashes.at(0) || shaderHash == this->reloadedGraphicsShaderHashes.at(1);
+            if (isWanted || isInUse || isReloaded)
+                continue;
+
+            this->graphicsPipelines->evictShader(shaderHash, [this](VkPipeline pipeline) {
+                this->deferDestruction([device = this->vulkanDevice, pipeline]() {
+                    vkDestroyPipeline(device, pipeline, nullptr);
+                });
+            });
         }
     }
 
+    // Framebuffers (and any transient images the graph has), which depend on the swap chain
+    void initializeRenderTargets()
+    {
+        this->frameRenderGraph.bindImportedImages(this->swapChainImageResource, this->vulkanSwapChainImages, this->vulkanSwapChainImageViews);
+        this->frameRenderGraph.createTargets(this->vulkanDevice, this->memoryAllocator.value(), this->vulkanSwapChainExtent);
+    }
+
     void initializeCommandPool()
     {
         VkCommandPoolCreateInfo commandPoolCreateInfo = {};
         commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 
-        // We're recording a command buffer every frame, so we want to be able to reset and rerecord over it
+        // We re-record command buffers whenever what they draw changes, so we want to be able to reset and rerecord over them individually
         commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
         commandPoolCreateInfo.queueFamilyIndex = this->findVulkanQueueFamilies(this->vulkanPhysicalDevice).graphicsFamily.value();
@@ -584,11 +1393,56 @@ public:
         allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 
         allocateInfo.commandPool = this->vulkanCommandPool;
-        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // We're not going to use the secondary command buffer functionality
-        allocateInfo.commandBufferCount = this->vulkanCommandBuffers.size();
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // These are the ones we submit, the secondary ones recorded by worker threads (if any) come from the workers' own pools
 
-        if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, this->vulkanCommandBuffers.data()) != VK_SUCCESS)
+        // The swap chain can come back with more images when it's recreated, in which case we just allocate the extra ones (and keep the ones we have, which start out out of date anyway)
+        std::size_t commandBufferCount = std::size_t(this->maxFramesInFlight) * this->vulkanSwapChainImages.size();
+        if (commandBufferCount <= this->vulkanCommandBuffers.size())
+            return;
+
+        auto firstNewCommandBuffer = this->vulkanCommandBuffers.size();
+        this->vulkanCommandBuffers.resize(commandBufferCount);
+        allocateInfo.commandBufferCount = static_cast<std::uint32_t>(commandBufferCount - firstNewCommandBuffer);
+
+        if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, this->vulkanCommandBuffers.data() + firstNewCommandBuffer) != VK_SUCCESS)
             throw std::runtime_error("Failed to create command buffer");
+        this->commandBufferCache.resize(commandBufferCount);
+    }
+
+    // Command buffer i always belongs to frame i % maxFramesInFlight, however many swap chain images there are, so that growing the swap chain never hands a frame a command buffer another frame might still have in flight
+    std::size_t getCommandBufferIndex(std::uint32_t imageIndex) const
+    {
+        return std::size_t(imageIndex) * this->maxFramesInFlight + this->currentFrame;
+    }
+
+    // Everything recorded against the old state has to be recorded again before it's used
+    void invalidateRecordings(recordingDependency dependency)
+    {
+        this->commandBufferCache.invalidate(dependency);
+        this->secondaryCommandBufferCache.invalidate(dependency);
+    }
+
+    void initializeRecordingWorkers()
+    {
+        if (this->options.recordThreadCount == 0)
+            return;
+
+        this->recordingJobSystem.emplace(this->options.recordThreadCount);
+
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // The whole pool gets reset whenever the frame's draws are re-recorded, rather than individual command buffers
+        commandPoolCreateInfo.queueFamilyIndex = this->findVulkanQueueFamilies(this->vulkanPhysicalDevice).graphicsFamily.value();
+
+        this->recordingWorkerResourcesByFrame.resize(this->maxFramesInFlight);
+        this->recordedSecondaryCommandBuffersByFrame.resize(this->maxFramesInFlight);
+        this->secondaryCommandBufferCache.resize(this->maxFramesInFlight);
+        for (auto &frameWorkerResources : this->recordingWorkerResourcesByFrame) {
+            frameWorkerResources.resize(this->options.recordThreadCount);
+            for (auto &workerResources : frameWorkerResources)
+                if (vkCreateCommandPool(this->vulkanDevice, &commandPoolCreateInfo, nullptr, &workerResources.commandPool) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create recording worker command pool");
+        }
     }
 
     void initializeSyncObjects()
@@ -596,94 +1450,378 @@ public:
         VkSemaphoreCreateInfo semaphoreCreateInfo = {};
         semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fenceCreateInfo = {};
-        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // The fence is already in the signalled state so that we don't need special handling in drawFrame and can just wait on it even on the first frame
+        this->vulkanImageAvailableSemaphores.resize(this->maxFramesInFlight);
+        this->vulkanRenderFinishedSemaphores.resize(this->maxFramesInFlight);
+        this->frameSlotTimelineValues.resize(this->maxFramesInFlight, 0); // The timeline starts out at 0, so waiting on that for the first frames doesn't need any special handling
 
         for (std::size_t i = 0; i < this->maxFramesInFlight; ++i)
             if (vkCreateSemaphore(this->vulkanDevice, &semaphoreCreateInfo, nullptr, &this->vulkanImageAvailableSemaphores.at(i)) != VK_SUCCESS ||
-                vkCreateSemaphore(this->vulkanDevice, &semaphoreCreateInfo, nullptr, &this->vulkanRenderFinishedSemaphores.at(i)) != VK_SUCCESS ||
-                vkCreateFence(this->vulkanDevice, &fenceCreateInfo, nullptr, &this->vulkanInFlightFences.at(i)) != VK_SUCCESS)
-                throw std::runtime_error("Failed to create semaphores and fence");
+                vkCreateSemaphore(this->vulkanDevice, &semaphoreCreateInfo, nullptr, &this->vulkanRenderFinishedSemaphores.at(i)) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create semaphores");
+
+        this->graphicsTimeline.emplace(this->vulkanDevice);
     }
 
-    ~vulkanSomethingOnTheScreenApp()
+    void initializeProfiler()
     {
-        for (std::size_t i = 0; i < this->maxFramesInFlight; ++i) {
-            vkDestroyFence(this->vulkanDevice, this->vulkanInFlightFences.at(i), nullptr);
-            vkDestroySemaphore(this->vulkanDevice, this->vulkanRenderFinishedSemaphores.at(i), nullptr);
-            vkDestroySemaphore(this->vulkanDevice, this->vulkanImageAvailableSemaphores.at(i), nullptr);
-        }
-        
-        vkDestroyCommandPool(this->vulkanDevice, this->vulkanCommandPool, nullptr);
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(this->vulkanPhysicalDevice, &physicalDeviceProperties);
 
-        this->destroySwapChain();
-        
-        vkDestroyPipeline(this->vulkanDevice, this->vulkanGraphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(this->vulkanDevice, this->vulkanPipelineLayout, nullptr);
+        // Whether timestamps are supported (and how many of their bits are meaningful) depends on the queue we submit them to
+        std::uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(this->vulkanPhysicalDevice, &queueFamilyCount, nullptr);
 
-        vkDestroyRenderPass(this->vulkanDevice, this->vulkanRenderPass, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies;
+        queueFamilies.resize(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(this->vulkanPhysicalDevice, &queueFamilyCount, queueFamilies.data());
 
-        vkDestroyDevice(this->vulkanDevice, nullptr);
+        auto graphicsFamily = this->findVulkanQueueFamilies(this->vulkanPhysicalDevice).graphicsFamily.value();
+        this->profiler.initializeGpuTimestamps(this->vulkanDevice, physicalDeviceProperties.limits, queueFamilies.at(graphicsFamily));
+    }
 
-        vkDestroySurfaceKHR(this->vulkanInstance, this->vulkanSurface, nullptr);
-        
-        internalVkDestroyDebugUtilsMessengerEXT(this->vulkanInstance, this->vulkanDebugMessenger, nullptr);
+    void initializeUploader()
+    {
+        VkDeviceSize stagingSize = VkDeviceSize(this->options.stagingBufferMegabytes) << 20;
 
-        vkDestroyInstance(this->vulkanInstance, nullptr);
+        // The CPU writes every byte of it exactly once and never reads any of it back, so plain coherent memory is all we need (no flushes, no caching)
+        this->createVulkanBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->vulkanStagingBuffer, this->vulkanStagingAllocation);
 
-        glfwDestroyWindow(this->glfwWindow);
-        glfwTerminate();
+        auto familyIndices = this->findVulkanQueueFamilies(this->vulkanPhysicalDevice);
+        this->uploader.emplace(this->vulkanDevice, stagingUploader::queueInfo{ this->vulkanTransferQueue, familyIndices.transferFamily.value() }, stagingUploader::queueInfo{ this->vulkanGraphicsQueue, familyIndices.graphicsFamily.value() }, this->graphicsTimeline.value(), this->vulkanStagingBuffer, this->vulkanStagingAllocation.mappedData, stagingSize);
+
+        std::cout << "Uploading through " << (this->uploader->isUsingDedicatedTransferQueue() ? "a dedicated transfer queue" : "the graphics queue") << " with a " << this->options.stagingBufferMegabytes << "MB staging ring\n";
     }
 
-    void destroySwapChain()
+    // CPU culling needs the same amount every frame (see allocateCpuSceneFrame), whatever is visible, and every size is a multiple of the alignment, so that's exactly how big they need to be
+    void initializeFrameLinearAllocators()
     {
-        for (auto swapChainFramebuffer : this->vulkanSwapChainFramebuffers)
-            vkDestroyFramebuffer(this->vulkanDevice, swapChainFramebuffer, nullptr);
-        
-        for (auto vulkanSwapChainImageView : this->vulkanSwapChainImageViews)
-            vkDestroyImageView(this->vulkanDevice, vulkanSwapChainImageView, nullptr);
-        
-        vkDestroySwapchainKHR(this->vulkanDevice, this->vulkanSwapChain, nullptr);
+        VkDeviceSize size = this->drawList.size() * sizeof(VkDrawIndexedIndirectCommand);
+        for (auto attributeSize : this->cpuSceneAttributeSizes)
+            size += this->instanceCount * attributeSize;
+
+        this->frameLinearAllocators.reserve(this->maxFramesInFlight);
+        for (std::size_t i = 0; i < this->maxFramesInFlight; ++i)
+            this->frameLinearAllocators.emplace_back(this->vulkanDevice, this->memoryAllocator.value(), size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
     }
 
-    bool areVulkanValidationLayersSupported()
+    void initializeCapture()
     {
-        std::uint32_t layerCount;
-        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+        auto ringSize = this->options.captureRingSize != 0 ? this->options.captureRingSize : this->maxFramesInFlight + 2; // Frames in flight each hold onto a slot until the GPU is done with them, so we need more than that for the writer to have anything to work on
+        this->capture.emplace(this->vulkanDevice, this->memoryAllocator.value(), this->vulkanSwapChainImageFormat, ringSize, this->options.captureDirectory, this->options.captureFormat);
 
-        std::vector<VkLayerProperties> availableLayers;
-        availableLayers.resize(layerCount);
-        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = this->vulkanCommandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = this->maxFramesInFlight;
 
-        // Check whether all of our required validation layers are available
-        for (const char *layerName : this->validationLayers) {
-            bool wasLayerFound = false;
+        this->vulkanCaptureCommandBuffers.resize(this->maxFramesInFlight);
+        if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, this->vulkanCaptureCommandBuffers.data()) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create capture command buffers");
 
-            for (const auto &layerProperties : availableLayers) {
-                if (std::strcmp(layerName, layerProperties.layerName) == 0) {
-                    wasLayerFound = true;
-                    break;
-                }
-            }
+        std::cout << "Capturing frames to " << this->options.captureDirectory << " through a ring of " << ringSize << '\n';
+    }
 
-            if (!wasLayerFound)
-                return false;
+    void initializeMeshBuffers()
+    {
+        auto triangleMesh = makeTriangleMesh();
+
+        // Device-local memory is the fastest for the GPU to read from, but the CPU usually can't get at it, which is why it gets filled through the uploader
+        this->createVulkanBuffer(triangleMesh.vertexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanVertexBuffer, this->vulkanVertexBufferAllocation);
+        this->createVulkanBuffer(triangleMesh.indexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanIndexBuffer, this->vulkanIndexBufferAllocation);
+
+        this->uploader->upload(this->vulkanVertexBuffer, 0, triangleMesh.vertices.data(), triangleMesh.vertexDataSize());
+        this->uploader->upload(this->vulkanIndexBuffer, 0, triangleMesh.indices.data(), triangleMesh.indexDataSize());
+
+        // With millions of instances this is by far the biggest upload we do, but since everything goes through the staging ring, it only ever takes as much host-visible memory as the ring does
+        auto instances = this->options.scene == sceneKind::layers ? makeInstanceLayers(this->options.instanceCount) : makeInstanceGrid(this->options.instanceCount);
+        auto instanceAttributeData = instances.getAttributeData();
+        auto instanceAttributeDataSizes = instances.getAttributeDataSizes();
+        for (std::size_t i = 0; i < instanceData::attributeCount; ++i) {
+            this->createVulkanBuffer(instanceAttributeDataSizes.at(i), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanInstanceBuffers.at(i), this->vulkanInstanceBufferAllocations.at(i));
+            this->uploader->upload(this->vulkanInstanceBuffers.at(i), 0, instanceAttributeData.at(i), instanceAttributeDataSizes.at(i));
+        }
+        this->instanceCount = static_cast<std::uint32_t>(instances.size());
+
+        // Instances are spread as evenly as possible over the draws
+        this->drawList.clear();
+        for (std::uint32_t i = 0; i < this->options.drawCount; ++i) {
+            std::uint32_t firstInstance = static_cast<std::uint32_t>(std::uint64_t(this->instanceCount) * i / this->options.drawCount);
+            std::uint32_t lastInstance = static_cast<std::uint32_t>(std::uint64_t(this->instanceCount) * (i + 1) / this->options.drawCount);
+            this->drawList.push_back({ firstInstance, lastInstance - firstInstance });
         }
 
-        return true;
+        if (this->options.cpuCulling)
+            this->initializeCpuScene(instances, triangleMesh.boundingRadius());
+
+        // Every frame is submitted to the graphics queue after this, so they're all ordered after the uploads without having to wait for anything here
+        this->uploader->flush();
+        this->indexCount = static_cast<std::uint32_t>(triangleMesh.indices.size());
+        this->meshBoundingRadius = triangleMesh.boundingRadius();
     }
 
-    std::vector<const char *> getRequiredVulkanExtensions()
+    // The instances as the scene update kernels want them, which we keep around on the CPU (unlike everything else about the instances, which only lives on the GPU once uploaded)
+    void initializeCpuScene(const instanceData &instances, float boundingRadius)
     {
-        // GLFW requires certain Vulkan extensions
-        std::uint32_t glfwProvidedRequiredExtensionCount;
-        const char **glfwProvidedRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwProvidedRequiredExtensionCount);
-
-        std::vector<const char *> extensions(glfwProvidedRequiredExtensions, glfwProvidedRequiredExtensions + glfwProvidedRequiredExtensionCount);
+        auto count = instances.size();
+        this->cpuSceneObjects.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            this->cpuSceneObjects.positionX[i] = instances.positions[i][0];
+            this->cpuSceneObjects.positionY[i] = instances.positions[i][1];
+            this->cpuSceneObjects.matrix00[i] = instances.transforms[i][0];
+            this->cpuSceneObjects.matrix10[i] = instances.transforms[i][1];
+            this->cpuSceneObjects.matrix01[i] = instances.transforms[i][2];
+            this->cpuSceneObjects.matrix11[i] = instances.transforms[i][3];
+            this->cpuSceneObjects.boundingRadius[i] = boundingRadius;
+        }
+        this->cpuSceneColors = instances.colors;
 
-        // We require the debug messenger extension
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        auto level = getBestSimdLevel();
+        this->cpuSceneKernels = getSceneKernels(level);
+        this->cpuSceneFrameAllocationsByFrame.resize(this->maxFramesInFlight);
+        std::cout << "Updating and culling " << count << " instances on the CPU with the " << getSimdLevelName(level) << " kernels\n";
+    }
+
+    // Everything the culling shader reads and writes, plus the descriptor set pointing it at all of it
+    void initializeCullingBuffers()
+    {
+        std::vector<std::array<std::uint32_t, 2>> drawRanges;
+        drawRanges.reserve(this->drawList.size());
+        for (const auto &draw : this->drawList)
+            drawRanges.push_back({ draw.firstInstance, draw.instanceCount });
+
+        VkDeviceSize drawRangesSize = drawRanges.size() * sizeof(drawRanges.front());
+        this->createVulkanBuffer(drawRangesSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanDrawRangeBuffer, this->vulkanDrawRangeBufferAllocation);
+        this->uploader->upload(this->vulkanDrawRangeBuffer, 0, drawRanges.data(), drawRangesSize);
+        this->uploader->flush();
+
+        // Visible instances are packed within their draw's range, so in the worst case (nothing culled) they take as much space as the instances themselves
+        for (std::size_t i = 0; i < instanceData::attributeCount; ++i)
+            this->createVulkanBuffer(this->vulkanInstanceBufferAllocations.at(i).size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanVisibleInstanceBuffers.at(i), this->vulkanVisibleInstanceBufferAllocations.at(i));
+
+        this->createVulkanBuffer(this->drawList.size() * sizeof(std::uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanDrawVisibleCountBuffer, this->vulkanDrawVisibleCountBufferAllocation);
+        this->createVulkanBuffer(this->drawList.size() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanDrawCommandBuffer, this->vulkanDrawCommandBufferAllocation);
+        this->createVulkanBuffer(sizeof(std::uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vulkanDrawCommandCountBuffer, this->vulkanDrawCommandCountBufferAllocation);
+
+        VkDescriptorPoolSize descriptorPoolSize = {};
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = 10;
+
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.maxSets = 1;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+
+        if (vkCreateDescriptorPool(this->vulkanDevice, &descriptorPoolCreateInfo, nullptr, &this->vulkanCullingDescriptorPool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create culling descriptor pool");
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocateInfo.descriptorPool = this->vulkanCullingDescriptorPool;
+        descriptorSetAllocateInfo.descriptorSetCount = 1;
+        descriptorSetAllocateInfo.pSetLayouts = &this->vulkanCullingDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(this->vulkanDevice, &descriptorSetAllocateInfo, &this->vulkanCullingDescriptorSet) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate culling descriptor set");
+
+        // In binding order
+        std::array<VkBuffer, 10> buffers = {
+            {
+                this->vulkanDrawRangeBuffer,
+                this->vulkanInstanceBuffers.at(0),
+                this->vulkanInstanceBuffers.at(1),
+                this->vulkanInstanceBuffers.at(2),
+                this->vulkanVisibleInstanceBuffers.at(0),
+                this->vulkanVisibleInstanceBuffers.at(1),
+                this->vulkanVisibleInstanceBuffers.at(2),
+                this->vulkanDrawVisibleCountBuffer,
+                this->vulkanDrawCommandBuffer,
+                this->vulkanDrawCommandCountBuffer,
+            }
+        };
+
+        std::array<VkDescriptorBufferInfo, 10> descriptorBufferInfos = {};
+        std::array<VkWriteDescriptorSet, 10> writeDescriptorSets = {};
+        for (std::uint32_t i = 0; i < buffers.size(); ++i) {
+            descriptorBufferInfos.at(i).buffer = buffers.at(i);
+            descriptorBufferInfos.at(i).offset = 0;
+            descriptorBufferInfos.at(i).range = VK_WHOLE_SIZE;
+
+            writeDescriptorSets.at(i).sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets.at(i).dstSet = this->vulkanCullingDescriptorSet;
+            writeDescriptorSets.at(i).dstBinding = i;
+            writeDescriptorSets.at(i).descriptorCount = 1;
+            writeDescriptorSets.at(i).descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSets.at(i).pBufferInfo = &descriptorBufferInfos.at(i);
+        }
+        vkUpdateDescriptorSets(this->vulkanDevice, static_cast<std::uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+        for (std::size_t i = 0; i < instanceData::attributeCount; ++i)
+            this->frameRenderGraph.bindImportedBuffer(this->visibleInstanceResources.at(i), this->vulkanVisibleInstanceBuffers.at(i));
+        this->frameRenderGraph.bindImportedBuffer(this->drawVisibleCountResource, this->vulkanDrawVisibleCountBuffer);
+        this->frameRenderGraph.bindImportedBuffer(this->drawCommandResource, this->vulkanDrawCommandBuffer);
+        this->frameRenderGraph.bindImportedBuffer(this->drawCommandCountResource, this->vulkanDrawCommandCountBuffer);
+    }
+
+    ~vulkanSomethingOnTheScreenApp()
+    {
+        // The watcher thread might be in the middle of building a pipeline with the device
+        this->shaderReloader.reset();
+        for (const auto &swap : this->pendingCullingPipelineSwaps)
+            vkDestroyPipeline(this->vulkanDevice, swap.pipeline, nullptr);
+
+        this->profiler.destroyGpuTimestamps();
+
+        for (std::size_t i = 0; i < this->maxFramesInFlight; ++i) {
+            vkDestroySemaphore(this->vulkanDevice, this->vulkanRenderFinishedSemaphores.at(i), nullptr);
+            vkDestroySemaphore(this->vulkanDevice, this->vulkanImageAvailableSemaphores.at(i), nullptr);
+        }
+        
+        vkDestroyCommandPool(this->vulkanDevice, this->vulkanCommandPool, nullptr);
+
+        // Workers must be gone before their pools are
+        this->recordingJobSystem.reset();
+        for (auto &frameWorkerResources : this->recordingWorkerResourcesByFrame)
+            for (auto &workerResources : frameWorkerResources)
+                vkDestroyCommandPool(this->vulkanDevice, workerResources.commandPool, nullptr);
+
+        this->frameLinearAllocators.clear();
+        this->capture.reset();
+
+        if (this->options.gpuCulling) {
+            vkDestroyDescriptorPool(this->vulkanDevice, this->vulkanCullingDescriptorPool, nullptr);
+            for (auto [buffer, allocation] : { std::pair(this->vulkanDrawRangeBuffer, &this->vulkanDrawRangeBufferAllocation), std::pair(this->vulkanDrawVisibleCountBuffer, &this->vulkanDrawVisibleCountBufferAllocation), std::pair(this->vulkanDrawCommandBuffer, &this->vulkanDrawCommandBufferAllocation), std::pair(this->vulkanDrawCommandCountBuffer, &this->vulkanDrawCommandCountBufferAllocation) }) {
+                vkDestroyBuffer(this->vulkanDevice, buffer, nullptr);
+                this->memoryAllocator->free(*allocation);
+            }
+            for (std::size_t i = 0; i < instanceData::attributeCount; ++i) {
+                vkDestroyBuffer(this->vulkanDevice, this->vulkanVisibleInstanceBuffers.at(i), nullptr);
+                this->memoryAllocator->free(this->vulkanVisibleInstanceBufferAllocations.at(i));
+            }
+        }
+
+        for (std::size_t i = 0; i < instanceData::attributeCount; ++i) {
+            vkDestroyBuffer(this->vulkanDevice, this->vulkanInstanceBuffers.at(i), nullptr);
+            this->memoryAllocator->free(this->vulkanInstanceBufferAllocations.at(i));
+        }
+
+        vkDestroyBuffer(this->vulkanDevice, this->vulkanIndexBuffer, nullptr);
+        this->memoryAllocator->free(this->vulkanIndexBufferAllocation);
+        vkDestroyBuffer(this->vulkanDevice, this->vulkanVertexBuffer, nullptr);
+        this->memoryAllocator->free(this->vulkanVertexBufferAllocation);
+
+        // The uploader still writes to the staging memory until it's gone, so it has to go first
+        this->uploader.reset();
+        vkDestroyBuffer(this->vulkanDevice, this->vulkanStagingBuffer, nullptr);
+        this->memoryAllocator->free(this->vulkanStagingAllocation);
+
+        this->graphicsTimeline.reset();
+
+        // run() waited for the device to go idle, so everything is done with these by now
+        this->vulkanDeletionQueue.flushAll();
+        this->destroySwapChain();
+        
+        this->graphicsPipelines.reset();
+        if (this->options.gpuCulling) {
+            vkDestroyPipeline(this->vulkanDevice, this->vulkanCullingPipeline, nullptr);
+            vkDestroyPipelineLayout(this->vulkanDevice, this->vulkanCullingPipelineLayout, nullptr);
+            vkDestroyDescriptorSetLayout(this->vulkanDevice, this->vulkanCullingDescriptorSetLayout, nullptr);
+        }
+
+        // An exception escaping a destructor would just kill us, and not being able to save the cache isn't worth that
+        try {
+            this->savePipelineCache();
+        } catch (const std::exception &exception) {
+            std::cerr << "Failed to save pipeline cache: " << exception.what() << '\n';
+        }
+        vkDestroyPipelineCache(this->vulkanDevice, this->vulkanPipelineCache, nullptr);
+        vkDestroyPipelineLayout(this->vulkanDevice, this->vulkanPipelineLayout, nullptr);
+
+        this->frameRenderGraph.destroyRenderPasses(this->vulkanDevice);
+
+        // Any memory still allocated at this point gets freed along with its block
+        this->memoryAllocator.reset();
+
+        vkDestroyDevice(this->vulkanDevice, nullptr);
+
+        if (!this->options.headless)
+            vkDestroySurfaceKHR(this->vulkanInstance, this->vulkanSurface, nullptr);
+        
+        internalVkDestroyDebugUtilsMessengerEXT(this->vulkanInstance, this->vulkanDebugMessenger, nullptr);
+
+        vkDestroyInstance(this->vulkanInstance, nullptr);
+
+        if (!this->options.headless) {
+            glfwDestroyWindow(this->glfwWindow);
+            glfwTerminate();
+        }
+    }
+
+    void destroySwapChain()
+    {
+        this->frameRenderGraph.releaseTargets().destroy(this->vulkanDevice, this->memoryAllocator.value());
+        
+        for (auto vulkanSwapChainImageView : this->vulkanSwapChainImageViews)
+            vkDestroyImageView(this->vulkanDevice, vulkanSwapChainImageView, nullptr);
+
+        // When headless, we own the images (and their memory) ourselves, so there's no swap chain to destroy them for us
+        if (this->options.headless) {
+            for (auto vulkanSwapChainImage : this->vulkanSwapChainImages)
+                vkDestroyImage(this->vulkanDevice, vulkanSwapChainImage, nullptr);
+            for (auto &vulkanHeadlessImageAllocation : this->vulkanHeadlessImageAllocations)
+                this->memoryAllocator->free(vulkanHeadlessImageAllocation);
+        } else
+            vkDestroySwapchainKHR(this->vulkanDevice, this->vulkanSwapChain, nullptr);
+    }
+
+    // Destroys something once everything submitted so far is done with it, without stalling anything in the meantime
+    void deferDestruction(std::function<void()> destroy)
+    {
+        this->vulkanDeletionQueue.push(this->graphicsTimeline->getLastSubmittedValue(), std::move(destroy));
+    }
+
+    bool areVulkanValidationLayersSupported()
+    {
+        std::uint32_t layerCount;
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        std::vector<VkLayerProperties> availableLayers;
+        availableLayers.resize(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        // Check whether all of our required validation layers are available
+        for (const char *layerName : this->validationLayers) {
+            bool wasLayerFound = false;
+
+            for (const auto &layerProperties : availableLayers) {
+                if (std::strcmp(layerName, layerProperties.layerName) == 0) {
+                    wasLayerFound = true;
+                    break;
+                }
+            }
+
+            if (!wasLayerFound)
+                return false;
+        }
+
+        return true;
+    }
+
+    std::vector<const char *> getRequiredVulkanExtensions()
+    {
+        std::vector<const char *> extensions;
+
+        // GLFW requires certain Vulkan extensions (though we don't need any of them when headless, since we won't have a surface)
+        if (!this->options.headless) {
+            std::uint32_t glfwProvidedRequiredExtensionCount;
+            const char **glfwProvidedRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwProvidedRequiredExtensionCount);
+
+            extensions.assign(glfwProvidedRequiredExtensions, glfwProvidedRequiredExtensions + glfwProvidedRequiredExtensionCount);
+        }
+
+        // We require the debug messenger extension
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
         return extensions;
     }
@@ -712,15 +1850,21 @@ public:
     }
 
     // Not all physical devices are created equal. This function judges a physical device to determine its worthiness w.r.t. the operations we want to do.
+    // The part of suitability that the probe can't tell us, since it depends on our window, for a device the probe found suitable otherwise
     bool isVulkanPhysicalDeviceSuitableForUs(VkPhysicalDevice physicalDevice)
     {
         auto familyIndices = this->findVulkanQueueFamilies(physicalDevice);
         if (!familyIndices.isComplete())
             return false;
 
-        if (!this->doesVulkanDeviceHaveAdequateExtensionSupport(physicalDevice))
+        // Culling happens in the same command buffer as the draws it feeds, so the graphics queue has to be able to run it (which the probe checked for, but the graphics family we end up picking might be another one)
+        if (this->options.gpuCulling && familyIndices.computeFamily != familyIndices.graphicsFamily)
             return false;
 
+        // We don't care about what the device can present when we won't present anything
+        if (this->options.headless)
+            return true;
+
         auto swapChainSupport = this->queryVulkanSwapChainSupport(physicalDevice);
         if (swapChainSupport.surfaceFormats.empty() || swapChainSupport.presentModes.empty())
             return false;
@@ -732,6 +1876,8 @@ public:
     struct vulkanQueueFamilyIndices {
         std::optional<std::uint32_t> graphicsFamily;
         std::optional<std::uint32_t> presentFamily;
+        std::optional<std::uint32_t> transferFamily; // Always found if graphicsFamily is, since graphics queues can do transfers too
+        std::optional<std::uint32_t> computeFamily; // Only needed for GPU culling
 
         bool isComplete() const
         {
@@ -758,8 +1904,12 @@ public:
                 if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
                     result.graphicsFamily = i;
 
+                // There's nothing to present to when headless, so we just pretend the graphics queue is our present queue, which means the rest of the code doesn't need to care
                 VkBool32 presentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, this->vulkanSurface, &presentSupport);
+                if (this->options.headless)
+                    presentSupport = result.graphicsFamily.has_value() && result.graphicsFamily.value() == i;
+                else
+                    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, this->vulkanSurface, &presentSupport);
 
                 if (presentSupport)
                     result.presentFamily = i;
@@ -770,23 +1920,56 @@ public:
             }
         }
 
+        // For uploads, the best we can get is a family that can only do transfers, since those usually map to the GPU's copy engines which can run alongside everything else
+        // Failing that, a family that can't do graphics (e.g. an async compute one) at least keeps uploads from being queued behind rendering, and as a last resort we just use the graphics family, which any Vulkan device can do transfers with
+        auto findTransferFamily = [&](VkQueueFlags unwantedFlags) -> std::optional<std::uint32_t> {
+            for (std::uint32_t i = 0; i < queueFamilies.size(); ++i)
+                if ((queueFamilies.at(i).queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilies.at(i).queueFlags & unwantedFlags) && queueFamilies.at(i).queueCount != 0)
+                    return i;
+            return std::nullopt;
+        };
+        result.transferFamily = findTransferFamily(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+        if (!result.transferFamily.has_value())
+            result.transferFamily = findTransferFamily(VK_QUEUE_GRAPHICS_BIT);
+        if (!result.transferFamily.has_value())
+            result.transferFamily = result.graphicsFamily;
+
+        // Compute work that feeds the draws of the same frame is best kept on the graphics queue, as anything else would need semaphores and ownership transfers every frame, so we only look elsewhere if we have to
+        if (result.graphicsFamily.has_value() && (queueFamilies.at(result.graphicsFamily.value()).queueFlags & VK_QUEUE_COMPUTE_BIT))
+            result.computeFamily = result.graphicsFamily;
+        else
+            for (std::uint32_t i = 0; i < queueFamilies.size() && !result.computeFamily.has_value(); ++i)
+                if ((queueFamilies.at(i).queueFlags & VK_QUEUE_COMPUTE_BIT) && queueFamilies.at(i).queueCount != 0)
+                    result.computeFamily = i;
+
         return result;
     }
 
-    // We'll need to check whether all our required extensions are supported by the device
-    bool doesVulkanDeviceHaveAdequateExtensionSupport(VkPhysicalDevice physicalDevice)
+    std::vector<const char *> getRequiredVulkanDeviceExtensions()
     {
-        std::uint32_t extensionCount;
-        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        // We only need VK_KHR_swapchain if we're actually going to present stuff
+        if (this->options.headless)
+            return {};
+        return std::vector<const char *>(this->requiredVulkanDeviceExtensions.begin(), this->requiredVulkanDeviceExtensions.end());
+    }
 
-        std::vector<VkExtensionProperties> availableExtensions;
-        availableExtensions.resize(extensionCount);
-        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    // Buffers only ever get used by one queue family at a time (the uploader hands them over to the graphics queue when needed), so they can be exclusive, which is the fastest
+    void createVulkanBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, VkBuffer &buffer, gpuAllocation &bufferAllocation)
+    {
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = usage;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(this->vulkanDevice, &bufferCreateInfo, nullptr, &buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create buffer");
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(this->vulkanDevice, buffer, &memoryRequirements);
 
-        std::unordered_set<std::string> requiredExtensions(this->requiredVulkanDeviceExtensions.begin(), this->requiredVulkanDeviceExtensions.end());
-        for (const auto &extension : availableExtensions)
-            requiredExtensions.erase(extension.extensionName);
-        return requiredExtensions.empty();
+        bufferAllocation = this->memoryAllocator->allocate(memoryRequirements, memoryProperties, gpuResourceKind::linear);
+        vkBindBufferMemory(this->vulkanDevice, buffer, bufferAllocation.memory, bufferAllocation.offset);
     }
 
     struct vulkanSwapChainSupportDetails {
@@ -832,12 +2015,20 @@ public:
 
     VkPresentModeKHR chooseVulkanSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
     {
-        // Triple buffering is nice, so use VK_PRESENT_MODE_MAILBOX_KHR if possible
-        for (const auto &presentMode : availablePresentModes)
-            if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-                return presentMode;
-        
+        // Triple buffering is nice, so VK_PRESENT_MODE_MAILBOX_KHR is what we go for by default, but whoever runs us might care more about not wasting work (fifo) or about latency above everything else (immediate)
+        // In the same order as presentModePreference
+        static constexpr std::array<VkPresentModeKHR, 4> presentModes = { { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR } };
+        static constexpr std::array<const char *, 4> presentModeNames = { { "immediate", "mailbox", "fifo", "fifo_relaxed" } };
+
+        auto preferenceIndex = static_cast<std::size_t>(this->options.presentMode);
+        if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentModes.at(preferenceIndex)) != availablePresentModes.end())
+            return presentModes.at(preferenceIndex);
+
         // Only VK_PRESENT_MODE_FIFO_KHR is guaranteed to be available, so use it as a fallback
+        if (!this->hasReportedPresentModeFallback) {
+            std::cerr << "The surface doesn't support the " << presentModeNames.at(preferenceIndex) << " present mode, using fifo instead\n";
+            this->hasReportedPresentModeFallback = true;
+        }
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
@@ -864,13 +2055,28 @@ public:
         return actualExtent;
     }
 
-    VkShaderModule createVulkanShaderModuleFromCode(std::string_view code)
+    // Shaders normally come from the copies embedded in the binary at build time, but during development it's nicer to be able to point us at freshly compiled .spv files without having to rebuild everything
+    // The code is only valid for the duration of the call, which is all the driver (and the pipeline variant cache, which makes its own copy) needs
+    template <typename function>
+    std::invoke_result_t<function, spirvCodeView> useShaderCode(const std::string &fileName, function &&use)
+    {
+        if (!this->options.shaderDirectory.empty())
+            return use(spirvBlob(this->options.shaderDirectory + '/' + fileName).code());
+        return use(findEmbeddedShaderCode(fileName));
+    }
+
+    VkShaderModule createVulkanShaderModule(const std::string &fileName)
+    {
+        return this->useShaderCode(fileName, [this](spirvCodeView code) { return this->createVulkanShaderModuleFromCode(code); });
+    }
+
+    VkShaderModule createVulkanShaderModuleFromCode(spirvCodeView code)
     {
         VkShaderModuleCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const std::uint32_t *>(code.data());
+        createInfo.codeSize = code.sizeInBytes();
+        createInfo.pCode = code.words;
 
         VkShaderModule result;
         if (vkCreateShaderModule(this->vulkanDevice, &createInfo, nullptr, &result) != VK_SUCCESS)
@@ -886,23 +2092,63 @@ public:
         if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
             throw std::runtime_error("Failed to begin recording command buffer");
 
-        VkRenderPassBeginInfo renderPassBeginInfo = {};
-        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        this->profiler.writeBeginTimestamp(commandBuffer, this->currentFrame);
 
-        renderPassBeginInfo.renderPass = this->vulkanRenderPass;
-        renderPassBeginInfo.framebuffer = this->vulkanSwapChainFramebuffers.at(imageIndex);
+        this->frameRenderGraph.execute(commandBuffer, imageIndex);
 
-        renderPassBeginInfo.renderArea.extent = this->vulkanSwapChainExtent;
+        this->profiler.writeEndTimestamp(commandBuffer, this->currentFrame);
 
-        // We clear the screen with completely black black
-        VkClearValue clearColor = {{{0.f, 0.f, 0.f, 1.f}}};
-        renderPassBeginInfo.clearValueCount = 1;
-        renderPassBeginInfo.pClearValues = &clearColor;
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record command buffer");
+    }
+
+    // The culling counts start from 0 every frame
+    void recordCullingReset(VkCommandBuffer commandBuffer)
+    {
+        vkCmdFillBuffer(commandBuffer, this->vulkanDrawVisibleCountBuffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, this->vulkanDrawCommandCountBuffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    // Pass 0 culls every instance and pass 1 builds the draw commands out of what's left, see cull.comp
+    void recordCullingPass(VkCommandBuffer commandBuffer, std::uint32_t pass)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->vulkanCullingPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->vulkanCullingPipelineLayout, 0, 1, &this->vulkanCullingDescriptorSet, 0, nullptr);
+
+        cullingParameters parameters = {};
+        parameters.zoom = static_cast<float>(this->options.zoom);
+        parameters.meshBoundingRadius = this->meshBoundingRadius;
+        parameters.instanceCount = this->instanceCount;
+        parameters.drawCount = static_cast<std::uint32_t>(this->drawList.size());
+        parameters.indexCount = this->indexCount;
+        parameters.pass = pass;
+        vkCmdPushConstants(commandBuffer, this->vulkanCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters), &parameters);
+        this->dispatchCulling(commandBuffer, pass == 0 ? parameters.instanceCount : parameters.drawCount);
+    }
+
+    // What goes in the draw subpass, either recorded right there or by the recording threads
+    void recordDrawPass(VkCommandBuffer commandBuffer)
+    {
+        if (this->recordingJobSystem.has_value()) {
+            this->recordingJobSystem->wait(this->recordingFrameGraph); // Doesn't wait at all if the frame's secondary command buffers were still up to date, as the graph is then the last frame's, which is long done
+            const auto &recordedSecondaryCommandBuffers = this->recordedSecondaryCommandBuffersByFrame.at(this->currentFrame);
+            vkCmdExecuteCommands(commandBuffer, static_cast<std::uint32_t>(recordedSecondaryCommandBuffers.size()), recordedSecondaryCommandBuffers.data());
+        } else
+            this->recordDraws(commandBuffer, 0, this->drawList.size());
+    }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
-                             VK_SUBPASS_CONTENTS_INLINE // We're not using secondary command buffers
-        );
+    // One invocation per item, in workgroups of 64 (which must match cull.comp), spread over 2 dimensions when there are more workgroups than a single one is guaranteed to take
+    static void dispatchCulling(VkCommandBuffer commandBuffer, std::uint32_t invocationCount)
+    {
+        constexpr std::uint32_t workgroupSize = 64, maxWorkgroupCount = 65535;
+        std::uint32_t workgroupCount = (invocationCount + workgroupSize - 1) / workgroupSize;
+        std::uint32_t workgroupCountX = std::min(workgroupCount, maxWorkgroupCount);
+        vkCmdDispatch(commandBuffer, workgroupCountX, (workgroupCount + workgroupCountX - 1) / workgroupCountX, 1);
+    }
 
+    // Records everything needed to draw part of the draw list, from scratch: secondary command buffers don't inherit any state from the primary one, so each of them has to set it all up again
+    void recordDraws(VkCommandBuffer commandBuffer, std::size_t firstDraw, std::size_t endDraw)
+    {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->vulkanGraphicsPipeline);
 
         // As we set the viewport and scissor state for the pipeline to be dynamic, we need to set them in the command buffer before drawing
@@ -917,68 +2163,671 @@ public:
         scissor.extent = this->vulkanSwapChainExtent;
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-        // Finally !!!!
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        // The CPU scene update already applies the zoom to what it writes out
+        auto zoom = this->options.cpuCulling ? 1.f : static_cast<float>(this->options.zoom);
+        vkCmdPushConstants(commandBuffer, this->vulkanPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(zoom), &zoom);
+
+        // The vertex buffer goes in binding 0, followed by the instance attribute buffers (only the visible instances when culling)
+        const auto &instanceBuffers = this->options.gpuCulling ? this->vulkanVisibleInstanceBuffers : this->vulkanInstanceBuffers;
+        std::array<VkBuffer, 1 + instanceData::attributeCount> vertexBuffers;
+        vertexBuffers.at(0) = this->vulkanVertexBuffer;
+        std::copy(instanceBuffers.begin(), instanceBuffers.end(), vertexBuffers.begin() + 1);
+        std::array<VkDeviceSize, 1 + instanceData::attributeCount> vertexBufferOffsets = {};
+        if (this->options.cpuCulling)
+            for (std::size_t i = 0; i < instanceData::attributeCount; ++i) {
+                const auto &allocation = this->cpuSceneFrameAllocationsByFrame.at(this->currentFrame).visibleInstances.at(i);
+                vertexBuffers.at(1 + i) = allocation.buffer;
+                vertexBufferOffsets.at(1 + i) = allocation.offset;
+            }
+        vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<std::uint32_t>(vertexBuffers.size()), vertexBuffers.data(), vertexBufferOffsets.data());
+        vkCmdBindIndexBuffer(commandBuffer, this->vulkanIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        // The culling shader wrote the draws (and how many of them there are) for us, so there's nothing for the CPU to go through
+        if (this->options.gpuCulling) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, this->vulkanDrawCommandBuffer, 0, this->vulkanDrawCommandCountBuffer, 0, static_cast<std::uint32_t>(this->drawList.size()), sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
+
+        // Same draws as below, except that how many instances each of them draws is only known once the scene update is done, which might well be after we record this
+        if (this->options.cpuCulling) {
+            const auto &drawCommands = this->cpuSceneFrameAllocationsByFrame.at(this->currentFrame).drawCommands;
+            for (std::size_t i = firstDraw; i < endDraw; ++i)
+                vkCmdDrawIndexedIndirect(commandBuffer, drawCommands.buffer, drawCommands.offset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
+
+        // Finally !!!! (each draw covers a whole range of instances, so the CPU cost only depends on how many draws there are)
+        for (std::size_t i = firstDraw; i < endDraw; ++i)
+            vkCmdDrawIndexed(commandBuffer, this->indexCount, this->drawList.at(i).instanceCount, 0, 0, this->drawList.at(i).firstInstance);
+    }
+
+    // Builds this frame's graph (recording the draws into secondary command buffers if they need it, and updating the CPU scene when culling there) and starts the workers on it, without waiting for them
+    // Nothing in there depends on which swap chain image we'll get, so this can run while we're acquiring one, and recordVulkanCommandBuffer (or submitting the frame, for the scene update) waits for it right when it needs the results
+    void startFrameGraph(bool recordSecondaryCommandBuffers)
+    {
+        // The previous frame's graph should be done already, since secondary command buffers are only re-recorded along with the primary command buffer that waits for them (both caches get invalidated together, per frame in flight) and the CPU scene is waited for before submitting, but the graph must not be rebuilt while it's running, whatever happens
+        this->recordingJobSystem->wait(this->recordingFrameGraph);
+        this->recordingFrameGraph.clear();
+        if (recordSecondaryCommandBuffers)
+            this->addSecondaryCommandBufferTasks();
+        if (this->options.cpuCulling)
+            this->addCpuSceneTasks();
+        this->recordingJobSystem->submit(this->recordingFrameGraph);
+    }
+
+    // Resets the frame's pools, then records one slice of the draw list per worker
+    void addSecondaryCommandBufferTasks()
+    {
+        auto &frameWorkerResources = this->recordingWorkerResourcesByFrame.at(this->currentFrame);
+        auto &recordedSecondaryCommandBuffers = this->recordedSecondaryCommandBuffersByFrame.at(this->currentFrame);
+        auto sliceCount = static_cast<std::uint32_t>(std::min<std::size_t>(this->drawList.size(), frameWorkerResources.size()));
+        recordedSecondaryCommandBuffers.assign(sliceCount, VK_NULL_HANDLE);
+
+        // We just waited on this frame's timeline value, so the GPU is done with everything recorded from these pools the last time around (and the frame's primary command buffers that used them are out of date too, or we wouldn't be re-recording)
+        auto resetPoolsTask = this->recordingFrameGraph.addTask([this, &frameWorkerResources](std::uint32_t) {
+            for (auto &workerResources : frameWorkerResources) {
+                vkResetCommandPool(this->vulkanDevice, workerResources.commandPool, 0);
+                workerResources.usedSecondaryCommandBufferCount = 0;
+            }
+        });
+
+        for (std::uint32_t sliceIndex = 0; sliceIndex < sliceCount; ++sliceIndex)
+            this->recordingFrameGraph.addTask([this, &frameWorkerResources, &recordedSecondaryCommandBuffers, sliceIndex, sliceCount](std::uint32_t workerIndex) { recordedSecondaryCommandBuffers.at(sliceIndex) = this->recordSecondaryCommandBuffer(frameWorkerResources, sliceIndex, sliceCount, workerIndex); }, { resetPoolsTask });
+    }
+
+    // Updates one slice of the instances per worker, then packs one slice of the draw list per worker once all of them are done (a draw's instances can span several update slices)
+    // None of it depends on the recording tasks, nor they on it, since the draws only refer to where the results go
+    void addCpuSceneTasks()
+    {
+        auto view = this->getCpuSceneView();
+        auto workerCount = std::size_t(this->options.recordThreadCount);
+        auto objectCount = this->cpuSceneObjects.size();
+
+        std::vector<taskGraph::taskHandle> updateTasks;
+        for (std::size_t sliceIndex = 0; sliceIndex < workerCount; ++sliceIndex) {
+            // 8 objects share each visibility byte, so slices can't share any of them
+            auto first = objectCount * sliceIndex / workerCount / 8 * 8;
+            auto last = sliceIndex + 1 == workerCount ? objectCount : objectCount * (sliceIndex + 1) / workerCount / 8 * 8;
+            if (first != last)
+                updateTasks.push_back(this->recordingFrameGraph.addTask([this, view, first, last](std::uint32_t) { this->updateCpuScene(view, first, last); }));
+        }
+
+        auto sliceCount = std::min(this->drawList.size(), workerCount);
+        for (std::size_t sliceIndex = 0; sliceIndex < sliceCount; ++sliceIndex)
+            this->recordingFrameGraph.addTask([this, sliceIndex, sliceCount](std::uint32_t) { this->packCpuScene(this->drawList.size() * sliceIndex / sliceCount, this->drawList.size() * (sliceIndex + 1) / sliceCount); }, updateTasks);
+    }
+
+    // The zoom scales everything around the center of the screen, and the planes stay the default ones, i.e. the edges of the screen
+    sceneView getCpuSceneView() const
+    {
+        auto zoom = static_cast<float>(this->options.zoom);
+        sceneView view;
+        view.matrix = { { zoom, 0, 0, zoom } };
+        return view;
+    }
+
+    void updateCpuScene(const sceneView &view, std::size_t first, std::size_t last)
+    {
+        this->cpuSceneKernels.composeTransforms(view, this->cpuSceneObjects, first, last);
+        this->cpuSceneKernels.cull(view, this->cpuSceneObjects, first, last);
+    }
+
+    // Packs each draw's visible instances at the start of its range (as the culling shader does), and writes the indirect draw that draws just those
+    void packCpuScene(std::size_t firstDraw, std::size_t endDraw)
+    {
+        const auto &frameAllocations = this->cpuSceneFrameAllocationsByFrame.at(this->currentFrame);
+        auto *positions = reinterpret_cast<std::array<float, 2> *>(frameAllocations.visibleInstances.at(0).data);
+        auto *colors = reinterpret_cast<std::array<float, 3> *>(frameAllocations.visibleInstances.at(1).data);
+        auto *transforms = reinterpret_cast<std::array<float, 4> *>(frameAllocations.visibleInstances.at(2).data);
+        auto *drawCommands = reinterpret_cast<VkDrawIndexedIndirectCommand *>(frameAllocations.drawCommands.data);
+
+        const auto &objects = this->cpuSceneObjects;
+        for (std::size_t i = firstDraw; i < endDraw; ++i) {
+            const auto &draw = this->drawList.at(i);
+            std::uint32_t visibleCount = 0;
+            for (std::uint32_t j = draw.firstInstance; j < draw.firstInstance + draw.instanceCount; ++j) {
+                if (!objects.isVisible(j))
+                    continue;
+
+                // The memory is write-combined more often than not, so we only ever write to it, in order
+                auto k = draw.firstInstance + visibleCount++;
+                positions[k] = { { objects.worldPositionX[j], objects.worldPositionY[j] } };
+                colors[k] = this->cpuSceneColors[j];
+                transforms[k] = { { objects.worldMatrix00[j], objects.worldMatrix10[j], objects.worldMatrix01[j], objects.worldMatrix11[j] } };
+            }
+
+            VkDrawIndexedIndirectCommand drawCommand = {};
+            drawCommand.indexCount = this->indexCount;
+            drawCommand.instanceCount = visibleCount;
+            drawCommand.firstInstance = draw.firstInstance;
+            drawCommands[i] = drawCommand;
+        }
+    }
+
+    // Allocating the same sizes in the same order right after the allocator is reset puts everything at the same offsets every frame, which is what lets the draws be recorded once and for all
+    void allocateCpuSceneFrame()
+    {
+        auto &allocator = this->frameLinearAllocators.at(this->currentFrame);
+        auto &frameAllocations = this->cpuSceneFrameAllocationsByFrame.at(this->currentFrame);
+
+        for (std::size_t i = 0; i < instanceData::attributeCount; ++i) {
+            auto allocation = allocator.allocate(this->instanceCount * this->cpuSceneAttributeSizes.at(i), sizeof(float));
+            if (!allocation.has_value())
+                throw std::runtime_error("Failed to allocate the visible instances for CPU culling");
+            frameAllocations.visibleInstances.at(i) = allocation.value();
+        }
+
+        auto allocation = allocator.allocate(this->drawList.size() * sizeof(VkDrawIndexedIndirectCommand), sizeof(std::uint32_t));
+        if (!allocation.has_value())
+            throw std::runtime_error("Failed to allocate the draws for CPU culling");
+        frameAllocations.drawCommands = allocation.value();
+    }
+
+    VkCommandBuffer recordSecondaryCommandBuffer(std::vector<recordingWorkerResources> &frameWorkerResources, std::uint32_t sliceIndex, std::uint32_t sliceCount, std::uint32_t workerIndex)
+    {
+        // Whichever worker picks up the slice records it with its own pool, so no pool is ever used by two threads at once
+        auto &workerResources = frameWorkerResources.at(workerIndex);
+        if (workerResources.usedSecondaryCommandBufferCount == workerResources.secondaryCommandBuffers.size()) {
+            VkCommandBufferAllocateInfo allocateInfo = {};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocateInfo.commandPool = workerResources.commandPool;
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocateInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, &commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate secondary command buffer");
+            workerResources.secondaryCommandBuffers.push_back(commandBuffer);
+        }
+        auto commandBuffer = workerResources.secondaryCommandBuffers.at(workerResources.usedSecondaryCommandBufferCount++);
+
+        // Secondary command buffers that run inside a render pass need to know which one, but not which framebuffer (which we don't know yet, as the image hasn't been acquired)
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = this->frameRenderGraph.getRenderPass(this->drawPass);
+        inheritanceInfo.subpass = this->frameRenderGraph.getSubpass(this->drawPass);
+        inheritanceInfo.framebuffer = VK_NULL_HANDLE;
 
-        vkCmdEndRenderPass(commandBuffer);
+        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        // They get executed by every primary command buffer of the frame (one per swap chain image), which without simultaneous use would invalidate all but the last one to record them
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin recording secondary command buffer");
+
+        this->recordDraws(commandBuffer, this->drawList.size() * sliceIndex / sliceCount, this->drawList.size() * (sliceIndex + 1) / sliceCount);
 
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-            throw std::runtime_error("Failed to record command buffer");
+            throw std::runtime_error("Failed to record secondary command buffer");
+        return commandBuffer;
     }
 
     void run()
     {
+        if (this->options.uploadBenchmarkMegabytes != 0) {
+            this->runUploadBenchmark();
+            return;
+        }
+
+        if (this->options.headless) {
+            this->runHeadless();
+            return;
+        }
+
+        // The first frame has nothing asking for it otherwise
+        this->redraws.requestRedraw(redrawReason::expose);
+
         while (!glfwWindowShouldClose(this->glfwWindow)) {
+            if (this->options.onDemand && !this->waitForRedraw())
+                break;
+
+            this->paceFrame();
             glfwPollEvents();
+            this->profiler.markInputSampled();
+            this->redraws.beginFrame();
             this->drawFrame();
+
+            if (this->options.redrawIntervalMilliseconds != 0)
+                this->redraws.scheduleRedraw(std::chrono::steady_clock::now() + std::chrono::milliseconds(this->options.redrawIntervalMilliseconds));
         }
 
         // We need to wait for the logical device to finish all its operations since otherwise all of the resources we're using will still be in use when we try to destroy them
         vkDeviceWaitIdle(this->vulkanDevice);
+
+        this->printReports();
+    }
+
+    // Sleeps until something needs the window redrawn, and returns false if it got closed in the meantime
+    // Without a timer, the timeout is only there in case some request doesn't wake us up, which nothing should rely on
+    bool waitForRedraw()
+    {
+        constexpr std::chrono::duration<double> maxSleepTime = std::chrono::seconds(1);
+
+        auto idleStartTime = std::chrono::steady_clock::now();
+        for (;;) {
+            auto sleepTime = this->redraws.update();
+            if (this->redraws.isRedrawPending())
+                break;
+            if (glfwWindowShouldClose(this->glfwWindow))
+                return false;
+            glfwWaitEventsTimeout(std::min(sleepTime.value_or(maxSleepTime), maxSleepTime).count());
+        }
+        this->redraws.addIdleTime(std::chrono::steady_clock::now() - idleStartTime);
+        return true;
+    }
+
+    // Waiting for everything we submitted to be done means each frame starts with an empty queue, so nothing it does waits behind older frames (and none of its input gets old while it does), and the pacer then decides how much later than that we can start
+    void paceFrame()
+    {
+        if (!this->pacer.isEnabled())
+            return;
+
+        this->graphicsTimeline->wait(this->graphicsTimeline->getLastSubmittedValue());
+        auto completionTime = std::chrono::steady_clock::now();
+
+        // We know exactly when the previous frame got done here, which makes for a more accurate latency than waiting for its slot to come around again
+        this->profiler.collectCompletedFrame((this->currentFrame + this->maxFramesInFlight - 1) % this->maxFramesInFlight);
+
+        this->pacer.waitForNextFrameStart(completionTime);
+    }
+
+    void printReports()
+    {
+        // Only once everything we captured is on disk, so that the numbers are final (and whoever runs us can use the files as soon as we exit)
+        if (this->capture.has_value()) {
+            this->capture->finish(this->graphicsTimeline->getCompletedValue());
+            this->capture->printStats(std::cout);
+        }
+
+        if (this->options.onDemand) {
+            // Only used to tell how many frames we skipped, so a guess is fine when the monitor doesn't say
+            const GLFWvidmode *videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            this->redraws.printStats(std::cout, videoMode != nullptr && videoMode->refreshRate > 0 ? videoMode->refreshRate : 60);
+        }
+
+        this->profiler.printReport(std::cout);
+        if (!this->profiler.isEnabled())
+            return;
+
+        this->memoryAllocator->printStats(std::cout);
+        this->frameRenderGraph.printSummary(std::cout);
+        this->graphicsPipelines->printStats(std::cout);
+        this->commandBufferCache.printStats(std::cout, "Command buffers");
+        if (this->recordingJobSystem.has_value()) {
+            this->secondaryCommandBufferCache.printStats(std::cout, "Secondary command buffer sets");
+            this->recordingJobSystem->printUtilisation(std::cout);
+        }
+    }
+
+    // Without a compositor or vsync in the way, this measures how fast we can really push frames out
+    void runHeadless()
+    {
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (std::uint32_t i = 0; i < this->options.headlessFrameCount; ++i) {
+            if (this->options.headlessResizeInterval != 0 && i != 0 && i % this->options.headlessResizeInterval == 0)
+                this->resizeHeadlessRenderTargets(this->headlessResizeExtents.at((i / this->options.headlessResizeInterval - 1) % this->headlessResizeExtents.size()));
+            this->drawFrame();
+        }
+
+        // The frames are only done once the GPU says so, so this needs to be inside the measurement
+        vkDeviceWaitIdle(this->vulkanDevice);
+
+        std::chrono::duration<double> elapsedTime = std::chrono::steady_clock::now() - startTime;
+        std::cout << "Rendered " << this->options.headlessFrameCount << " frames headless with " << this->maxFramesInFlight << " frames in flight and " << this->instanceCount << " instances in " << elapsedTime.count() << "s ("
+                  << this->options.headlessFrameCount / elapsedTime.count() << " frames per second, " << elapsedTime.count() * 1000 / this->options.headlessFrameCount << "ms per frame)\n";
+
+        this->printReports();
+
+        std::optional<imageDifference> goldenImageDifference;
+        if (!this->options.goldenImagePath.empty())
+            goldenImageDifference = this->checkGoldenImage();
+
+        if (!this->options.reportJsonPath.empty())
+            this->writeJsonReport(elapsedTime.count(), goldenImageDifference);
+
+        // Only now, so that the report is there to tell by how much
+        if (goldenImageDifference.has_value() && goldenImageDifference->differingPixelCount > this->getAllowedGoldenImageDifferingPixelCount())
+            throw std::runtime_error("The last frame doesn't match the golden image " + this->options.goldenImagePath);
+    }
+
+    // A few pixels along the edges of triangles can legitimately end up on one side or the other depending on the driver, a whole triangle can't
+    std::size_t getAllowedGoldenImageDifferingPixelCount() const
+    {
+        return std::size_t(this->vulkanSwapChainExtent.width) * this->vulkanSwapChainExtent.height / 1000;
+    }
+
+    // Reads back the image of the last frame we rendered, which must be done by then
+    std::vector<std::byte> readBackLastFrame()
+    {
+        auto imageIndex = (this->currentFrame + this->maxFramesInFlight - 1) % this->maxFramesInFlight; // Headless frames render to the image of their frame in flight, and we've moved past the last one already
+        auto size = VkDeviceSize(this->vulkanSwapChainExtent.width) * this->vulkanSwapChainExtent.height * 4;
+
+        VkBuffer readbackBuffer;
+        gpuAllocation readbackAllocation;
+        this->createVulkanBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackAllocation);
+
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = this->vulkanCommandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, &commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create readback command buffer");
+
+        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin recording readback command buffer");
+        recordImageReadback(commandBuffer, this->vulkanSwapChainImages.at(imageIndex), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->vulkanSwapChainExtent, readbackBuffer);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record readback command buffer");
+
+        // We're done rendering by now, so there's nothing to overlap this with and no point going through the timeline
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(this->vulkanGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit readback command buffer");
+        vkQueueWaitIdle(this->vulkanGraphicsQueue);
+
+        std::vector<std::byte> result(readbackAllocation.mappedData, readbackAllocation.mappedData + size);
+
+        vkFreeCommandBuffers(this->vulkanDevice, this->vulkanCommandPool, 1, &commandBuffer);
+        vkDestroyBuffer(this->vulkanDevice, readbackBuffer, nullptr);
+        this->memoryAllocator->free(readbackAllocation);
+        return result;
+    }
+
+    // Compares the last frame against the golden image (or replaces the golden image with it), and returns how different they are
+    // Returns nothing when there was nothing to compare with, i.e. when the last frame became the golden image
+    std::optional<imageDifference> checkGoldenImage()
+    {
+        auto pixels = this->readBackLastFrame();
+        bool isBgra = this->vulkanSwapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+
+        if (this->options.updateGoldenImage) {
+            auto directory = std::filesystem::path(this->options.goldenImagePath).parent_path();
+            if (!directory.empty())
+                std::filesystem::create_directories(directory);
+            writeFullFileAtomically(this->options.goldenImagePath, encodeQoiImage(pixels.data(), this->vulkanSwapChainExtent.width, this->vulkanSwapChainExtent.height, isBgra));
+            std::cout << "Updated golden image " << this->options.goldenImagePath << '\n';
+            return std::nullopt;
+        }
+
+        // A missing golden image is a failure like any other, since a check that passes whenever there's nothing to compare against would never catch anything on a fresh checkout
+        if (!std::filesystem::exists(this->options.goldenImagePath))
+            throw std::runtime_error("There's no golden image " + this->options.goldenImagePath + ", render it with --update-golden (make bench UPDATE_GOLDEN=1) and check it in");
+
+        auto goldenImage = decodeQoiImage(readFullFile(this->options.goldenImagePath));
+        if (!goldenImage.has_value())
+            throw std::runtime_error("Failed to decode golden image " + this->options.goldenImagePath);
+        if (goldenImage->width != this->vulkanSwapChainExtent.width || goldenImage->height != this->vulkanSwapChainExtent.height)
+            throw std::runtime_error("The golden image " + this->options.goldenImagePath + " is " + std::to_string(goldenImage->width) + "x" + std::to_string(goldenImage->height) + " but the last frame is " + std::to_string(this->vulkanSwapChainExtent.width) + "x" + std::to_string(this->vulkanSwapChainExtent.height));
+
+        auto difference = compareImages(pixels.data(), isBgra, goldenImage.value(), this->options.goldenTolerance);
+        std::cout << "Golden image " << this->options.goldenImagePath << ": " << difference.differingPixelCount << " pixels off by more than " << this->options.goldenTolerance << " (" << this->getAllowedGoldenImageDifferingPixelCount() << " allowed), by at most " << difference.maxChannelDifference << '\n';
+        return difference;
+    }
+
+    // Everything a benchmark run needs to be compared with other runs, in a form tools can read
+    void writeJsonReport(double elapsedSeconds, const std::optional<imageDifference> &goldenImageDifference)
+    {
+        static constexpr std::array<const char *, 2> sceneNames = { { "grid", "layers" } };
+
+        std::ostringstream stream;
+        stream << "{\n";
+        stream << "  \"scene\": \"" << sceneNames.at(static_cast<std::size_t>(this->options.scene)) << "\",\n";
+        stream << "  \"instances\": " << this->instanceCount << ",\n";
+        stream << "  \"draws\": " << this->drawList.size() << ",\n";
+        stream << "  \"gpuCulling\": " << (this->options.gpuCulling ? "true" : "false") << ",\n";
+        stream << "  \"cpuCulling\": " << (this->options.cpuCulling ? "true" : "false") << ",\n";
+        stream << "  \"resizeEvery\": " << this->options.headlessResizeInterval << ",\n";
+        stream << "  \"framesInFlight\": " << this->maxFramesInFlight << ",\n";
+        stream << "  \"frames\": " << this->options.headlessFrameCount << ",\n";
+        stream << "  \"seconds\": " << elapsedSeconds << ",\n";
+        stream << "  \"framesPerSecond\": " << this->options.headlessFrameCount / elapsedSeconds << ",\n";
+        stream << "  \"peakDeviceMemoryBytes\": " << this->memoryAllocator->getPeakAllocatedSize() << ",\n";
+        stream << "  \"profile\": ";
+        this->profiler.printJson(stream);
+        stream << ",\n";
+        stream << "  \"golden\": ";
+        if (goldenImageDifference.has_value())
+            stream << "{\"differingPixels\": " << goldenImageDifference->differingPixelCount << ", \"allowedDifferingPixels\": " << this->getAllowedGoldenImageDifferingPixelCount() << ", \"maxChannelDifference\": " << goldenImageDifference->maxChannelDifference
+                   << ", \"passed\": " << (goldenImageDifference->differingPixelCount <= this->getAllowedGoldenImageDifferingPixelCount() ? "true" : "false") << "}\n";
+        else
+            stream << "null\n";
+        stream << "}\n";
+
+        writeFullFileAtomically(this->options.reportJsonPath, stream.str());
+    }
+
+    // Uploads a grid mesh of roughly the requested size a few times over, from the CPU-side vectors all the way to device-local memory owned by the graphics queue
+    void runUploadBenchmark()
+    {
+        static constexpr std::uint32_t iterationCount = 5;
+
+        // Each quad of the grid takes a vertex and 6 indices
+        VkDeviceSize targetSize = VkDeviceSize(this->options.uploadBenchmarkMegabytes) << 20;
+        auto quadsPerSide = static_cast<std::uint32_t>(std::sqrt(double(targetSize) / (sizeof(vertex) + 6 * sizeof(std::uint32_t))));
+        auto benchmarkMesh = makeGridMesh(std::max(quadsPerSide, 1u));
+        double uploadedMegabytes = double(benchmarkMesh.vertexDataSize() + benchmarkMesh.indexDataSize()) / (1 << 20);
+
+        VkBuffer vertexBuffer, indexBuffer;
+        gpuAllocation vertexBufferAllocation, indexBufferAllocation;
+        this->createVulkanBuffer(benchmarkMesh.vertexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferAllocation);
+        this->createVulkanBuffer(benchmarkMesh.indexDataSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferAllocation);
+
+        std::vector<double> throughputs;
+        for (std::uint32_t i = 0; i < iterationCount; ++i) {
+            auto startTime = std::chrono::steady_clock::now();
+
+            this->uploader->upload(vertexBuffer, 0, benchmarkMesh.vertices.data(), benchmarkMesh.vertexDataSize());
+            this->uploader->upload(indexBuffer, 0, benchmarkMesh.indices.data(), benchmarkMesh.indexDataSize());
+            this->uploader->flush();
+
+            // The data is only there once the GPU says so, so this needs to be inside the measurement
+            this->uploader->waitIdle();
+
+            std::chrono::duration<double> elapsedTime = std::chrono::steady_clock::now() - startTime;
+            throughputs.push_back(uploadedMegabytes / elapsedTime.count());
+        }
+
+        // The first iteration also pays for the driver paging in memory, so the best one is more representative of what the hardware can do
+        std::cout << "Uploaded " << uploadedMegabytes << "MB " << iterationCount << " times through a " << this->options.stagingBufferMegabytes << "MB staging ring ("
+                  << (this->uploader->isUsingDedicatedTransferQueue() ? "dedicated transfer queue" : "graphics queue") << "): "
+                  << "first " << throughputs.front() << "MB/s, best " << *std::max_element(throughputs.begin(), throughputs.end()) << "MB/s\n";
+
+        this->memoryAllocator->printStats(std::cout);
+
+        vkDestroyBuffer(this->vulkanDevice, indexBuffer, nullptr);
+        this->memoryAllocator->free(indexBufferAllocation);
+        vkDestroyBuffer(this->vulkanDevice, vertexBuffer, nullptr);
+        this->memoryAllocator->free(vertexBufferAllocation);
     }
 
     void drawFrame()
     {
-        vkWaitForFences(this->vulkanDevice, 1, &this->vulkanInFlightFences.at(this->currentFrame), VK_TRUE, UINT64_MAX);
+        this->profiler.beginFrame();
+
+        // Waiting for this frame's slot below only tells us about one frame, which might have been done for several frames already, so we check on all of them here for their latencies to be measured when they got done rather than when their slot came around
+        if (this->profiler.isEnabled())
+            for (std::uint32_t i = 0; i < this->maxFramesInFlight; ++i)
+                if (this->graphicsTimeline->isReached(this->frameSlotTimelineValues.at(i)))
+                    this->profiler.collectCompletedFrame(i);
+
+        {
+            auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::frameWait);
+            this->graphicsTimeline->wait(this->frameSlotTimelineValues.at(this->currentFrame));
+        }
+
+        // The GPU is done with this frame, so whatever timestamps it wrote the last time around are ready (and we now know how long it took to get through)
+        this->profiler.collectCompletedFrame(this->currentFrame);
+
+        if (this->options.cpuCulling) {
+            this->frameLinearAllocators.at(this->currentFrame).reset();
+            this->allocateCpuSceneFrame();
+        }
+
+        // Frames in flight other than the one we just waited on might have finished too, and finding out doesn't cost us a wait
+        if (!this->vulkanDeletionQueue.empty())
+            this->vulkanDeletionQueue.flush(this->graphicsTimeline->getCompletedValue());
+
+        // Same goes for captured frames, which the writer can start on right away
+        if (this->capture.has_value())
+            this->capture->collect(this->graphicsTimeline->getCompletedValue());
+
+        this->updatePipelines();
+
+        if (this->options.recordEveryFrame)
+            this->invalidateRecordings(recordingDependency::scene);
+
+        // This is where the CPU work of this frame starts overlapping with the GPU still working on the previous ones (and with us waiting on the swap chain)
+        if (this->recordingJobSystem.has_value()) {
+            bool recordSecondaryCommandBuffers = this->secondaryCommandBufferCache.acquire(this->currentFrame);
+            if (recordSecondaryCommandBuffers || this->options.cpuCulling)
+                this->startFrameGraph(recordSecondaryCommandBuffers);
+        } else if (this->options.cpuCulling) {
+            auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::sceneUpdate);
+            this->updateCpuScene(this->getCpuSceneView(), 0, this->cpuSceneObjects.size());
+            this->packCpuScene(0, this->drawList.size());
+        }
 
         std::uint32_t imageIndex;
-        VkResult vkAcquireNextImageKHRResult = vkAcquireNextImageKHR(this->vulkanDevice, this->vulkanSwapChain, UINT64_MAX, this->vulkanImageAvailableSemaphores.at(this->currentFrame), VK_NULL_HANDLE, &imageIndex);
-
-        // Automatic swap chain recreation when necessary, both through checking the return value of vkAcquireNextImageKHR and the GLFW callback
-        // (Note: This is required for supporting resizing in any way as VK_ERROR_OUT_OF_DATE_KHR means the swap chain cannot be used for rendering anymore) 
-        // The framebufferResized check can't be moved out of here for "optimization" as doing it here ensures the semaphores are in a consistent state
-        if (vkAcquireNextImageKHRResult == VK_ERROR_OUT_OF_DATE_KHR || vkAcquireNextImageKHRResult == VK_SUBOPTIMAL_KHR || this->framebufferResized) {
-            this->framebufferResized = false;
-            this->reinitializeSwapChain();
-            return;
-        } else if (vkAcquireNextImageKHRResult != VK_SUCCESS)
-            throw std::runtime_error("Failed to acquire swap chain image");
+        if (this->options.headless)
+            imageIndex = this->currentFrame; // Each frame in flight has its own image when headless, and we just waited for that frame to be done, so there's nothing to acquire
+        else {
+            auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::acquire);
+            auto acquireStartTime = std::chrono::steady_clock::now();
+            VkResult vkAcquireNextImageKHRResult = vkAcquireNextImageKHR(this->vulkanDevice, this->vulkanSwapChain, UINT64_MAX, this->vulkanImageAvailableSemaphores.at(this->currentFrame), VK_NULL_HANDLE, &imageIndex);
+            this->pacer.addBlockedTime(std::chrono::steady_clock::now() - acquireStartTime); // Waiting for the display to give us an image is exactly the kind of wait pacing moves before the frame
+
+            // Automatic swap chain recreation when necessary (Note: This is required for supporting resizing in any way as VK_ERROR_OUT_OF_DATE_KHR means the swap chain cannot be used for rendering anymore)
+            // We only bail out here if we didn't get an image at all: VK_SUBOPTIMAL_KHR still gives us one (and signals the semaphore), so we render and present it as usual and recreate the swap chain right after, which keeps the semaphores in a consistent state
+            if (vkAcquireNextImageKHRResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                if (this->recordingJobSystem.has_value())
+                    this->recordingJobSystem->wait(this->recordingFrameGraph); // The workers might still be using the current swap chain's extent
+                this->reinitializeSwapChain();
+                return;
+            } else if (vkAcquireNextImageKHRResult != VK_SUCCESS && vkAcquireNextImageKHRResult != VK_SUBOPTIMAL_KHR)
+                throw std::runtime_error("Failed to acquire swap chain image");
+        }
+
+        auto commandBufferIndex = this->getCommandBufferIndex(imageIndex);
+        auto commandBuffer = this->vulkanCommandBuffers.at(commandBufferIndex);
+        if (this->commandBufferCache.acquire(commandBufferIndex)) {
+            auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::record);
+            vkResetCommandBuffer(commandBuffer, 0);
+
+            this->recordVulkanCommandBuffer(commandBuffer, imageIndex);
+        }
+
+        std::optional<std::size_t> captureSlot;
+        if (this->capture.has_value())
+            captureSlot = this->capture->beginCapture(this->vulkanSwapChainExtent);
+        if (captureSlot.has_value())
+            this->recordCaptureCommandBuffer(captureSlot.value(), imageIndex);
+
+        // The frame's draws read what the scene update writes
+        if (this->options.cpuCulling && this->recordingJobSystem.has_value()) {
+            auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::sceneUpdate);
+            this->recordingJobSystem->wait(this->recordingFrameGraph);
+        }
 
-        // We need to manually reset the fence back to the unsignalled state
-        // We only do so if we're submitting work as otherwise it could result in a deadlock
-        vkResetFences(this->vulkanDevice, 1, &this->vulkanInFlightFences.at(this->currentFrame));
- 
-        vkResetCommandBuffer(this->vulkanCommandBuffers.at(this->currentFrame), 0);
+        this->submitFrame(commandBuffer, captureSlot.has_value() ? this->vulkanCaptureCommandBuffers.at(this->currentFrame) : VK_NULL_HANDLE);
+        if (captureSlot.has_value())
+            this->capture->markSubmitted(captureSlot.value(), this->frameSlotTimelineValues.at(this->currentFrame));
 
-        this->recordVulkanCommandBuffer(this->vulkanCommandBuffers.at(this->currentFrame), imageIndex);
+        if (!this->options.headless) {
+            VkResult vkQueuePresentKHRResult;
+            {
+                auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::present);
+                vkQueuePresentKHRResult = this->presentFrame(imageIndex);
+            }
+
+            // The GLFW callback covers platforms that don't tell us about resizes through VK_ERROR_OUT_OF_DATE_KHR
+            if (vkQueuePresentKHRResult == VK_ERROR_OUT_OF_DATE_KHR || vkQueuePresentKHRResult == VK_SUBOPTIMAL_KHR || this->framebufferResized) {
+                this->framebufferResized = false;
+                this->reinitializeSwapChain();
+            } else if (vkQueuePresentKHRResult != VK_SUCCESS)
+                throw std::runtime_error("Failed to present swap chain image");
+        }
+
+        this->profiler.endFrame(this->currentFrame);
+
+        // Advance to the next frame every time, and loop around once maxFramesInFlight has been reached
+        this->currentFrame = (this->currentFrame + 1) % this->maxFramesInFlight;
+    }
+
+    // Copies the frame's image out after everything else, in a command buffer of its own that goes in the same submission as the frame's
+    void recordCaptureCommandBuffer(std::size_t captureSlot, std::uint32_t imageIndex)
+    {
+        auto commandBuffer = this->vulkanCaptureCommandBuffers.at(this->currentFrame);
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin recording capture command buffer");
+
+        // Whatever layout the render graph leaves the image in (see initializeRenderGraph)
+        this->capture->recordCopy(commandBuffer, captureSlot, this->vulkanSwapChainImages.at(imageIndex), this->options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record capture command buffer");
+    }
+
+    // captureCommandBuffer can be VK_NULL_HANDLE, when the frame isn't captured
+    void submitFrame(VkCommandBuffer commandBuffer, VkCommandBuffer captureCommandBuffer)
+    {
+        auto phaseTimer = this->profiler.measurePhase(frameProfilerPhase::submit);
 
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
+        // When headless, there's no acquire to wait for and no present to signal, so the timeline is all the synchronization we need
         VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // We want the execution to wait until writing colors to the image is available
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &this->vulkanImageAvailableSemaphores.at(this->currentFrame);
-        submitInfo.pWaitDstStageMask = &waitStage;
+        if (!this->options.headless) {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &this->vulkanImageAvailableSemaphores.at(this->currentFrame);
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &this->vulkanCommandBuffers.at(this->currentFrame);
+        std::array<VkCommandBuffer, 2> commandBuffers = { { commandBuffer, captureCommandBuffer } };
+        submitInfo.commandBufferCount = captureCommandBuffer != VK_NULL_HANDLE ? 2 : 1;
+        submitInfo.pCommandBuffers = commandBuffers.data();
+
+        // The render finished semaphore is binary, so the value that goes with it is ignored
+        auto &frameTimelineValue = this->frameSlotTimelineValues.at(this->currentFrame);
+        frameTimelineValue = this->graphicsTimeline->advance();
+        std::array<VkSemaphore, 2> signalSemaphores = { { this->graphicsTimeline->getSemaphore(), this->vulkanRenderFinishedSemaphores.at(this->currentFrame) } };
+        std::array<std::uint64_t, 2> signalSemaphoreValues = { { frameTimelineValue, 0 } };
+        std::uint32_t signalSemaphoreCount = this->options.headless ? 1 : 2;
 
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &this->vulkanRenderFinishedSemaphores.at(this->currentFrame);
+        VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo = {};
+        timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSemaphoreSubmitInfo.signalSemaphoreValueCount = signalSemaphoreCount;
+        timelineSemaphoreSubmitInfo.pSignalSemaphoreValues = signalSemaphoreValues.data();
+        submitInfo.pNext = &timelineSemaphoreSubmitInfo;
 
-        if (vkQueueSubmit(this->vulkanGraphicsQueue, 1, &submitInfo, this->vulkanInFlightFences.at(this->currentFrame)) != VK_SUCCESS)
+        submitInfo.signalSemaphoreCount = signalSemaphoreCount;
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        if (vkQueueSubmit(this->vulkanGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
             throw std::runtime_error("Failed to submit draw command buffer");
+        this->profiler.markTimestampsSubmitted(this->currentFrame);
+    }
 
+    VkResult presentFrame(std::uint32_t imageIndex)
+    {
         VkPresentInfoKHR presentInfoKHR = {};
         presentInfoKHR.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -989,10 +2838,7 @@ public:
         presentInfoKHR.pSwapchains = &this->vulkanSwapChain;
         presentInfoKHR.pImageIndices = &imageIndex;
 
-        vkQueuePresentKHR(this->vulkanPresentQueue, &presentInfoKHR);
-
-        // Advance to the next frame every time, and loop around once maxFramesInFlight has been reached
-        this->currentFrame = (this->currentFrame + 1) % this->maxFramesInFlight;
+        return vkQueuePresentKHR(this->vulkanPresentQueue, &presentInfoKHR);
     }
 
     void reinitializeSwapChain()
@@ -1005,24 +2851,59 @@ public:
             glfwGetFramebufferSize(this->glfwWindow, &width, &height);
         }
         
-        // The approach taken here is suboptimal since we stop all rendering before creating the new swap chain, but it's simpler than trying to handle the drawing of commands from the old swap chain
-        
-        // Avoid touching resources that are still in use
-        vkDeviceWaitIdle(this->vulkanDevice);
-
-        this->destroySwapChain();
-        
+        // We don't stop rendering to do this: the frames still in flight keep using the old swap chain's image views and framebuffers, so we only destroy them once those frames are done
+        this->deferDestruction([device = this->vulkanDevice, allocator = &this->memoryAllocator.value(), imageViews = std::move(this->vulkanSwapChainImageViews), renderTargets = this->frameRenderGraph.releaseTargets()]() mutable {
+            renderTargets.destroy(device, *allocator);
+            for (auto imageView : imageViews)
+                vkDestroyImageView(device, imageView, nullptr);
+        });
+
+        // The swap chain itself must also outlive the presents still queued on it, which the timeline doesn't track (we don't rely on VK_EXT_swapchain_maintenance1's present fences, which not every driver has)
+        // Instead, we wait for one more full round of frames in flight after the last present: the frame that next signals the same render finished semaphore can't run before that present has waited on it
+        this->vulkanDeletionQueue.push(this->graphicsTimeline->getLastSubmittedValue() + this->maxFramesInFlight, [device = this->vulkanDevice, swapChain = this->vulkanSwapChain]() {
+            vkDestroySwapchainKHR(device, swapChain, nullptr);
+        });
+
+        // initializeSwapChain hands the old swap chain over as oldSwapchain before replacing it
         this->initializeSwapChain();
         this->initializeSwapChainImageViews();
-        this->initializeFramebuffers();
+        this->initializeRenderTargets();
+
+        // Every command buffer we have refers to the old framebuffers (and extent), and there might be more images than before
+        this->invalidateRecordings(recordingDependency::swapChain);
+        this->initializeCommandBuffers();
+
+        // We either bailed out of a frame to get here or presented one at the old size, so the window needs another one either way
+        this->redraws.requestRedraw(redrawReason::resize);
+    }
+
+    // Stands in for reinitializeSwapChain when running headless, where nothing ever resizes us but --resize-every
+    void resizeHeadlessRenderTargets(VkExtent2D extent)
+    {
+        // Each frame in flight's image is only used by that frame, so we could get away with replacing them one at a time, but going through the deletion queue is how the swap chain does it
+        this->deferDestruction([device = this->vulkanDevice, allocator = &this->memoryAllocator.value(), images = std::move(this->vulkanSwapChainImages), imageAllocations = std::move(this->vulkanHeadlessImageAllocations), imageViews = std::move(this->vulkanSwapChainImageViews), renderTargets = this->frameRenderGraph.releaseTargets()]() mutable {
+            renderTargets.destroy(device, *allocator);
+            for (auto imageView : imageViews)
+                vkDestroyImageView(device, imageView, nullptr);
+            for (auto image : images)
+                vkDestroyImage(device, image, nullptr);
+            for (auto &imageAllocation : imageAllocations)
+                allocator->free(imageAllocation);
+        });
+
+        this->headlessExtent = extent;
+        this->initializeHeadlessRenderTargets();
+        this->initializeSwapChainImageViews();
+        this->initializeRenderTargets();
+        this->invalidateRecordings(recordingDependency::swapChain);
     }
 };
 
 // We'll do our error handling mostly by just throwing exceptions, so leave a top-level wrapper here to catch any exceptions that occur
-int main()
+int main(int argc, char **argv)
 {
     try {
-        vulkanSomethingOnTheScreenApp().run();
+        vulkanSomethingOnTheScreenApp(parseApplicationOptions(argc, argv)).run();
     } catch (const std::exception &exception) {
         std::cerr << "Error (stdexcept): " << exception.what() << '\n';
         return EXIT_FAILURE;
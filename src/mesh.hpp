@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// What every vertex of our geometry looks like, on the CPU side as well as in the vertex buffer
+struct vertex {
+    std::array<float, 2> position;
+    std::array<float, 3> color;
+
+    // Tells Vulkan how to go through the vertex buffer
+    static VkVertexInputBindingDescription getBindingDescription(std::uint32_t binding)
+    {
+        VkVertexInputBindingDescription result = {};
+        result.binding = binding;
+        result.stride = sizeof(vertex);
+        result.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return result;
+    }
+
+    // Tells Vulkan how to get each of the shader's inputs out of a vertex (the locations must match the ones in shader.vert)
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions(std::uint32_t binding)
+    {
+        std::array<VkVertexInputAttributeDescription, 2> result = {};
+
+        result.at(0).location = 0;
+        result.at(0).binding = binding;
+        result.at(0).format = VK_FORMAT_R32G32_SFLOAT;
+        result.at(0).offset = offsetof(vertex, position);
+
+        result.at(1).location = 1;
+        result.at(1).binding = binding;
+        result.at(1).format = VK_FORMAT_R32G32B32_SFLOAT;
+        result.at(1).offset = offsetof(vertex, color);
+
+        return result;
+    }
+};
+
+struct mesh {
+    std::vector<vertex> vertices;
+    std::vector<std::uint32_t> indices;
+
+    std::size_t vertexDataSize() const
+    {
+        return this->vertices.size() * sizeof(vertex);
+    }
+
+    std::size_t indexDataSize() const
+    {
+        return this->indices.size() * sizeof(std::uint32_t);
+    }
+
+    // Radius of the smallest circle around the origin that contains the whole mesh, which is what culling tests instances with
+    float boundingRadius() const
+    {
+        float result = 0;
+        for (const auto &meshVertex : this->vertices)
+            result = std::max(result, std::hypot(meshVertex.position.at(0), meshVertex.position.at(1)));
+        return result;
+    }
+};
+
+// The good old triangle, with a distinct color for each of its 3 vertices
+inline mesh makeTriangleMesh()
+{
+    return {
+        {
+            { { .0f, -.5f }, { 1.f, 0.f, 0.f } },
+            { { .5f, .5f }, { 0.f, 1.f, 0.f } },
+            { { -.5f, .5f }, { 0.f, 0.f, 1.f } },
+        },
+        { 0, 1, 2 },
+    };
+}
+
+// A big grid of quads covering the [-1, 1] square, which is an easy way to get a mesh of any size we want (mostly for benchmarking uploads)
+inline mesh makeGridMesh(std::uint32_t quadsPerSide)
+{
+    mesh result;
+    std::uint32_t verticesPerSide = quadsPerSide + 1;
+    result.vertices.reserve(std::size_t(verticesPerSide) * verticesPerSide);
+    result.indices.reserve(std::size_t(quadsPerSide) * quadsPerSide * 6);
+
+    for (std::uint32_t y = 0; y < verticesPerSide; ++y)
+        for (std::uint32_t x = 0; x < verticesPerSide; ++x) {
+            float u = static_cast<float>(x) / quadsPerSide, v = static_cast<float>(y) / quadsPerSide;
+            result.vertices.push_back({ { u * 2 - 1, v * 2 - 1 }, { u, v, 1 - u } });
+        }
+
+    // Clockwise, to match what the pipeline considers to be front-facing
+    for (std::uint32_t y = 0; y < quadsPerSide; ++y)
+        for (std::uint32_t x = 0; x < quadsPerSide; ++x) {
+            std::uint32_t topLeft = y * verticesPerSide + x;
+            std::uint32_t topRight = topLeft + 1;
+            std::uint32_t bottomLeft = topLeft + verticesPerSide;
+            std::uint32_t bottomRight = bottomLeft + 1;
+            for (std::uint32_t index : { topLeft, topRight, bottomRight, topLeft, bottomRight, bottomLeft })
+                result.indices.push_back(index);
+        }
+
+    return result;
+}
+
+// Per-instance attributes, stored as one tightly packed array per attribute (rather than one array of structs) so that each can live in its own vertex buffer, and so that updating one attribute for every instance only touches that attribute's memory
+// The shader places each vertex at position + transform * vertexPosition, and multiplies its color by the instance's
+struct instanceData {
+    static constexpr std::uint32_t firstBinding = 1; // Binding 0 is the vertex buffer
+    static constexpr std::uint32_t firstLocation = 2; // Locations 0 and 1 are the vertex's own attributes
+    static constexpr std::uint32_t attributeCount = 3;
+
+    std::vector<std::array<float, 2>> positions;
+    std::vector<std::array<float, 3>> colors;
+    std::vector<std::array<float, 4>> transforms; // A 2x2 matrix (rotation and scale), column-major
+
+    std::size_t size() const
+    {
+        return this->positions.size();
+    }
+
+    // Everything we need to know to upload and bind each attribute's buffer, in binding order
+    std::array<const void *, attributeCount> getAttributeData() const
+    {
+        return { { this->positions.data(), this->colors.data(), this->transforms.data() } };
+    }
+
+    std::array<std::size_t, attributeCount> getAttributeDataSizes() const
+    {
+        return { { this->positions.size() * sizeof(this->positions.front()), this->colors.size() * sizeof(this->colors.front()), this->transforms.size() * sizeof(this->transforms.front()) } };
+    }
+
+    // One binding per attribute, advanced once per instance instead of once per vertex
+    static std::array<VkVertexInputBindingDescription, attributeCount> getBindingDescriptions()
+    {
+        std::array<VkVertexInputBindingDescription, attributeCount> result = {};
+        std::array<std::uint32_t, attributeCount> strides = { { sizeof(float) * 2, sizeof(float) * 3, sizeof(float) * 4 } };
+        for (std::uint32_t i = 0; i < attributeCount; ++i) {
+            result.at(i).binding = firstBinding + i;
+            result.at(i).stride = strides.at(i);
+            result.at(i).inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        }
+        return result;
+    }
+
+    // The locations must match the ones in shader.vert
+    static std::array<VkVertexInputAttributeDescription, attributeCount> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, attributeCount> result = {};
+        std::array<VkFormat, attributeCount> formats = { { VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT } };
+        for (std::uint32_t i = 0; i < attributeCount; ++i) {
+            result.at(i).location = firstLocation + i;
+            result.at(i).binding = firstBinding + i;
+            result.at(i).format = formats.at(i);
+            result.at(i).offset = 0;
+        }
+        return result;
+    }
+};
+
+// A single instance leaves the mesh exactly as it is, anything more spreads the instances over a square grid covering the screen, each one shrunk to fit its cell and given its own rotation and tint
+inline instanceData makeInstanceGrid(std::uint32_t instanceCount)
+{
+    instanceData result;
+    result.positions.reserve(instanceCount);
+    result.colors.reserve(instanceCount);
+    result.transforms.reserve(instanceCount);
+
+    if (instanceCount == 1) {
+        result.positions.push_back({ 0.f, 0.f });
+        result.colors.push_back({ 1.f, 1.f, 1.f });
+        result.transforms.push_back({ 1.f, 0.f, 0.f, 1.f });
+        return result;
+    }
+
+    auto instancesPerSide = static_cast<std::uint32_t>(std::ceil(std::sqrt(double(instanceCount))));
+    float cellSize = 2.f / instancesPerSide;
+    for (std::uint32_t i = 0; i < instanceCount; ++i) {
+        std::uint32_t x = i % instancesPerSide, y = i / instancesPerSide;
+        result.positions.push_back({ -1.f + (x + .5f) * cellSize, -1.f + (y + .5f) * cellSize });
+
+        float t = static_cast<float>(i) / instanceCount;
+        result.colors.push_back({ .5f + .5f * std::cos(t * 6.2831853f), .5f + .5f * std::cos((t + 1.f / 3) * 6.2831853f), .5f + .5f * std::cos((t + 2.f / 3) * 6.2831853f) });
+
+        float angle = static_cast<float>(i % 360) * .0174532925f, scale = cellSize;
+        result.transforms.push_back({ std::cos(angle) * scale, std::sin(angle) * scale, -std::sin(angle) * scale, std::cos(angle) * scale });
+    }
+
+    return result;
+}
+
+// Every instance covers the whole screen (the triangle's edges clear the corners from 6 times its size on), all stacked on top of each other, so that every pixel gets shaded once per instance, which is about as much overdraw as it gets
+inline instanceData makeInstanceLayers(std::uint32_t instanceCount)
+{
+    instanceData result;
+    result.positions.assign(instanceCount, { 0.f, 0.f });
+    result.transforms.assign(instanceCount, { 8.f, 0.f, 0.f, 8.f });
+    result.colors.reserve(instanceCount);
+
+    for (std::uint32_t i = 0; i < instanceCount; ++i) {
+        float t = static_cast<float>(i) / instanceCount;
+        result.colors.push_back({ .5f + .5f * std::cos(t * 6.2831853f), .5f + .5f * std::cos((t + 1.f / 3) * 6.2831853f), .5f + .5f * std::cos((t + 2.f / 3) * 6.2831853f) });
+    }
+
+    return result;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+
+// Everything we want to know about a GPU to pick one, short of what depends on the window we present to (which is why it can be cached across launches)
+struct physicalDeviceProbe {
+    // Identity, which is cheap to query and what the cache is keyed by
+    std::string name;
+    std::array<std::uint8_t, VK_UUID_SIZE> deviceUUID = {}; // All zeroes for devices too old to tell us (pre-1.1), which never get cached
+    std::uint32_t vendorID = 0;
+    std::uint32_t deviceID = 0;
+    std::uint32_t driverVersion = 0;
+    std::uint32_t apiVersion = 0;
+    VkPhysicalDeviceType deviceType = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+
+    // Capabilities, which take a bunch of queries per device to find out
+    VkDeviceSize deviceLocalHeapSize = 0; // The largest one, as that's what our data ends up in
+    bool hasGraphicsQueue = false;
+    bool graphicsQueueCanCompute = false;
+    bool hasDedicatedTransferQueue = false; // A family that only does transfers, i.e. copy engines that run alongside rendering
+    bool hasAsyncComputeQueue = false; // A family that does compute but not graphics
+    bool hasSwapchainExtension = false;
+    bool hasTimelineSemaphores = false;
+    bool hasDrawIndirectCount = false;
+
+    bool wasLoadedFromCache = false; // Not saved, just so that we know whether there's anything new to save
+
+    bool hasUUID() const
+    {
+        return std::any_of(this->deviceUUID.begin(), this->deviceUUID.end(), [](std::uint8_t byte) { return byte != 0; });
+    }
+
+    // 32 hex digits, which is also what --device takes
+    std::string getUUIDString() const
+    {
+        std::string result;
+        for (auto byte : this->deviceUUID) {
+            char digits[3];
+            std::snprintf(digits, sizeof(digits), "%02x", byte);
+            result += digits;
+        }
+        return result;
+    }
+
+    // A driver update can change everything but the UUID, so the driver version is part of the key
+    std::string getCacheKey() const
+    {
+        return this->getUUIDString() + ':' + std::to_string(this->driverVersion);
+    }
+
+    const char *getDeviceTypeName() const
+    {
+        static constexpr std::array<const char *, 5> deviceTypeNames = { { "other", "integrated", "discrete", "virtual", "cpu" } };
+        return static_cast<std::size_t>(this->deviceType) < deviceTypeNames.size() ? deviceTypeNames.at(this->deviceType) : "unknown";
+    }
+
+    // Empty if the device can do everything we need (as far as the probe can tell: presenting to our window is checked separately)
+    std::string getUnsuitableReason(bool needsPresentation, bool needsGpuCulling) const
+    {
+        if (this->apiVersion < VK_API_VERSION_1_2)
+            return "needs Vulkan 1.2";
+        if (!this->hasTimelineSemaphores)
+            return "no timeline semaphores";
+        if (!this->hasGraphicsQueue)
+            return "no graphics queue";
+        if (needsPresentation && !this->hasSwapchainExtension)
+            return "no " VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+        if (needsGpuCulling && (!this->hasDrawIndirectCount || !this->graphicsQueueCanCompute))
+            return "can't do GPU culling";
+        return {};
+    }
+
+    // Higher is better, and only means something between suitable devices
+    // The device type always comes first (a discrete GPU beats an integrated one whatever their other merits, as integrated GPUs tend to report a big chunk of system memory as "VRAM"), then the size of the VRAM heap, then the queues and features that make some of our paths faster
+    std::uint32_t getScore() const
+    {
+        static constexpr std::array<std::uint32_t, 5> deviceTypeScores = { { 500, 2000, 3000, 1000, 0 } }; // In VkPhysicalDeviceType order, with the CPU (software rasterizers like lavapipe) last
+        std::uint32_t score = static_cast<std::size_t>(this->deviceType) < deviceTypeScores.size() ? deviceTypeScores.at(this->deviceType) : 0;
+
+        // Past 32GB, the difference stops mattering to us (and the total of everything below stays under the gap between two device types)
+        score += static_cast<std::uint32_t>(std::min<VkDeviceSize>(this->deviceLocalHeapSize >> 30, 32)) * 20;
+
+        if (this->hasDedicatedTransferQueue)
+            score += 100; // Uploads run on the copy engines (see stagingUploader)
+        if (this->hasAsyncComputeQueue)
+            score += 50;
+        if (this->hasDrawIndirectCount)
+            score += 50;
+        return score;
+    }
+};
+
+// Probes from previous launches, saved as text with one device per line
+class physicalDeviceProbeCache {
+    static constexpr std::string_view header = "vulkan-test device probes v1";
+
+    std::unordered_map<std::string, physicalDeviceProbe> probes; // By cache key
+
+public:
+    // Anything that doesn't look like what we'd have saved is ignored, since the worst a bad cache can do is make us probe again
+    static physicalDeviceProbeCache parse(const std::string &text)
+    {
+        physicalDeviceProbeCache result;
+        std::istringstream stream(text);
+
+        std::string line;
+        if (!std::getline(stream, line) || line != header)
+            return result;
+
+        while (std::getline(stream, line)) {
+            std::istringstream lineStream(line);
+            physicalDeviceProbe probe;
+            std::string uuid;
+            std::uint32_t deviceType;
+            std::array<int, 7> flags;
+            lineStream >> uuid >> probe.vendorID >> probe.deviceID >> probe.driverVersion >> probe.apiVersion >> deviceType >> probe.deviceLocalHeapSize;
+            for (auto &flag : flags)
+                lineStream >> flag;
+            lineStream.ignore(1); // The space before the name, which is last since it can have spaces of its own
+            std::getline(lineStream, probe.name);
+            if (lineStream.fail() || uuid.size() != VK_UUID_SIZE * 2 || !std::all_of(uuid.begin(), uuid.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); }))
+                continue;
+
+            for (std::size_t i = 0; i < VK_UUID_SIZE; ++i)
+                probe.deviceUUID.at(i) = static_cast<std::uint8_t>(std::stoul(uuid.substr(i * 2, 2), nullptr, 16));
+            probe.deviceType = static_cast<VkPhysicalDeviceType>(deviceType);
+            probe.hasGraphicsQueue = flags.at(0);
+            probe.graphicsQueueCanCompute = flags.at(1);
+            probe.hasDedicatedTransferQueue = flags.at(2);
+            probe.hasAsyncComputeQueue = flags.at(3);
+            probe.hasSwapchainExtension = flags.at(4);
+            probe.hasTimelineSemaphores = flags.at(5);
+            probe.hasDrawIndirectCount = flags.at(6);
+            probe.wasLoadedFromCache = true;
+            result.probes[probe.getCacheKey()] = probe;
+        }
+
+        return result;
+    }
+
+    std::string serialize() const
+    {
+        std::ostringstream stream;
+        stream << header << '\n';
+        for (const auto &[key, probe] : this->probes)
+            stream << probe.getUUIDString() << ' ' << probe.vendorID << ' ' << probe.deviceID << ' ' << probe.driverVersion << ' ' << probe.apiVersion << ' ' << static_cast<std::uint32_t>(probe.deviceType) << ' ' << probe.deviceLocalHeapSize << ' '
+                   << probe.hasGraphicsQueue << ' ' << probe.graphicsQueueCanCompute << ' ' << probe.hasDedicatedTransferQueue << ' ' << probe.hasAsyncComputeQueue << ' ' << probe.hasSwapchainExtension << ' ' << probe.hasTimelineSemaphores << ' ' << probe.hasDrawIndirectCount << ' '
+                   << probe.name << '\n';
+        return stream.str();
+    }
+
+    // Only devices with the same UUID and driver version match, and the cached probe is returned as is (the identity part included, which is identical anyway)
+    std::optional<physicalDeviceProbe> find(const physicalDeviceProbe &identity) const
+    {
+        if (!identity.hasUUID())
+            return std::nullopt;
+
+        auto it = this->probes.find(identity.getCacheKey());
+        if (it == this->probes.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    void store(const physicalDeviceProbe &probe)
+    {
+        if (probe.hasUUID())
+            this->probes[probe.getCacheKey()] = probe;
+    }
+};
+
+// Whether what was given to --device (either an index in enumeration order or a UUID, with or without dashes, in any case) designates this device
+inline bool doesPhysicalDeviceSelectorMatch(std::string_view selector, std::size_t deviceIndex, const physicalDeviceProbe &probe)
+{
+    if (!selector.empty() && std::all_of(selector.begin(), selector.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+        return selector.size() < 10 && std::stoul(std::string(selector)) == deviceIndex;
+
+    std::string normalizedSelector;
+    for (char c : selector)
+        if (c != '-')
+            normalizedSelector += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return probe.hasUUID() && normalizedSelector == probe.getUUIDString();
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include "applicationOptions.hpp"
+#include "spirvBlob.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+// FNV-1a, which is plenty to tell shaders apart (and we only ever hash a handful of them)
+inline std::uint64_t hashSpirvCode(spirvCodeView code)
+{
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (std::size_t i = 0; i < code.wordCount; ++i) {
+        hash ^= code.words[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Everything one graphics pipeline variant differs from another by (the vertex layout, rasterization and dynamic state are the same for all of them)
+struct graphicsPipelineKey {
+    std::uint64_t vertexShaderHash = 0; // See pipelineVariantCache::addShaderCode
+    std::uint64_t fragmentShaderHash = 0;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::uint32_t subpass = 0;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    pipelineBlendMode blendMode = pipelineBlendMode::opaque;
+
+    bool operator==(const graphicsPipelineKey &other) const
+    {
+        return this->vertexShaderHash == other.vertexShaderHash && this->fragmentShaderHash == other.fragmentShaderHash && this->renderPass == other.renderPass && this->subpass == other.subpass && this->topology == other.topology && this->blendMode == other.blendMode;
+    }
+
+    struct hasher {
+        std::size_t operator()(const graphicsPipelineKey &key) const
+        {
+            // The shader hashes are already well mixed, so the rest just gets folded in
+            std::uint64_t hash = key.vertexShaderHash ^ (key.fragmentShaderHash * 31);
+            hash ^= reinterpret_cast<std::uintptr_t>(key.renderPass) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+            hash ^= (std::uint64_t(key.subpass) << 16) | (std::uint64_t(key.topology) << 8) | static_cast<std::uint64_t>(key.blendMode);
+            return static_cast<std::size_t>(hash);
+        }
+    };
+
+    std::string describe() const
+    {
+        static constexpr std::array<const char *, 11> topologyNames = { { "points", "lines", "line strip", "triangles", "triangle strip", "triangle fan", "lines with adjacency", "line strip with adjacency", "triangles with adjacency", "triangle strip with adjacency", "patches" } };
+
+        auto shortHash = [](std::uint64_t hash) {
+            char digits[9];
+            std::snprintf(digits, sizeof(digits), "%08x", static_cast<std::uint32_t>(hash >> 32));
+            return std::string(digits);
+        };
+        return "vert " + shortHash(this->vertexShaderHash) + ", frag " + shortHash(this->fragmentShaderHash) + ", subpass " + std::to_string(this->subpass) + ", "
+            + (static_cast<std::size_t>(this->topology) < topologyNames.size() ? topologyNames.at(this->topology) : "unknown topology") + ", " + getPipelineBlendModeName(this->blendMode) + " blending";
+    }
+};
+
+// Graphics pipelines by what they're made of, each one created only once however many times it's asked for, and on worker threads so that asking for one never stalls the frame
+// The frame just carries on with whatever pipeline it already has until the one it asked for is ready, which is how shader reloads and state changes get by without a hitch
+class pipelineVariantCache {
+public:
+    // Creates the pipeline on a worker thread, throwing if it can't
+    using buildFunction = std::function<VkPipeline(const graphicsPipelineKey &, spirvCodeView vertexCode, spirvCodeView fragmentCode)>;
+
+private:
+    enum class variantState {
+        compiling, // Queued or being compiled
+        ready,
+        failed,
+    };
+
+    struct variant {
+        std::size_t index; // In order of first request, which is the order we report them in (and never reused, so that a worker can tell whether the variant it compiled got evicted meanwhile)
+        variantState state = variantState::compiling;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        double compileMilliseconds = 0;
+        std::uint64_t hitCount = 0; // Lookups that found it ready
+        std::uint64_t missCount = 0; // Lookups that found it still compiling, i.e. frames that had to make do with another pipeline
+    };
+
+    VkDevice device;
+    buildFunction build;
+    std::function<void()> onCompiled; // Called on a worker thread whenever a variant is done, successfully or not, so that whoever is waiting for it can draw again
+
+    std::mutex mutex;
+    std::condition_variable queueCondition;
+    std::condition_variable compiledCondition;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> shaderCode; // By hash, until evictShader
+    std::unordered_map<graphicsPipelineKey, variant, graphicsPipelineKey::hasher> variants; // Entries never move, and only go away through evictShader
+    std::deque<graphicsPipelineKey> queue;
+    std::size_t nextVariantIndex = 0;
+    std::size_t evictedVariantCount = 0;
+    bool isStopping = false;
+
+    std::vector<std::thread> workers;
+
+    // With the lock held
+    variant &request(const graphicsPipelineKey &key)
+    {
+        auto [it, wasInserted] = this->variants.try_emplace(key, variant { this->nextVariantIndex });
+        if (wasInserted) {
+            ++this->nextVariantIndex;
+            this->queue.push_back(key);
+            this->queueCondition.notify_one();
+        }
+        return it->second;
+    }
+
+    void workerMain()
+    {
+        std::unique_lock lock(this->mutex);
+        for (;;) {
+            this->queueCondition.wait(lock, [&]() { return this->isStopping || !this->queue.empty(); });
+            if (this->isStopping)
+                return;
+
+            // The code gets copied (it's only a few kilobytes), since its shader might get evicted while we're compiling
+            auto key = this->queue.front();
+            this->queue.pop_front();
+            auto index = this->variants.at(key).index;
+            auto vertexCode = this->shaderCode.at(key.vertexShaderHash);
+            auto fragmentCode = this->shaderCode.at(key.fragmentShaderHash);
+            lock.unlock();
+
+            // Pipeline creation is where drivers do most of their compiling, and it's thread-safe (the pipeline cache included), so the workers don't need to coordinate at all
+            auto compileStartTime = std::chrono::steady_clock::now();
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            try {
+                pipeline = this->build(key, { vertexCode.data(), vertexCode.size() }, { fragmentCode.data(), fragmentCode.size() });
+            } catch (const std::exception &exception) {
+                std::cerr << "Failed to compile pipeline variant (" << key.describe() << "): " << exception.what() << '\n';
+            }
+            std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileStartTime;
+
+            lock.lock();
+
+            // Nobody could have used a variant that was still compiling, so there's no need to wait for the GPU before destroying what it was evicted with
+            auto it = this->variants.find(key);
+            if (it == this->variants.end() || it->second.index != index) {
+                if (pipeline != VK_NULL_HANDLE)
+                    vkDestroyPipeline(this->device, pipeline, nullptr);
+                continue;
+            }
+
+            auto &compiledVariant = it->second;
+            compiledVariant.pipeline = pipeline;
+            compiledVariant.state = pipeline != VK_NULL_HANDLE ? variantState::ready : variantState::failed;
+            compiledVariant.compileMilliseconds = compileTime.count();
+            this->compiledCondition.notify_all();
+
+            lock.unlock();
+            this->onCompiled();
+            lock.lock();
+        }
+    }
+
+public:
+    pipelineVariantCache(VkDevice device, std::uint32_t workerCount, buildFunction build, std::function<void()> onCompiled)
+        : device(device), build(std::move(build)), onCompiled(std::move(onCompiled))
+    {
+        for (std::uint32_t i = 0; i < workerCount; ++i)
+            this->workers.emplace_back([this]() { this->workerMain(); });
+    }
+
+    // Whatever is still queued never gets compiled, but we wait for what's being compiled right now
+    ~pipelineVariantCache()
+    {
+        {
+            std::lock_guard lock(this->mutex);
+            this->isStopping = true;
+        }
+        this->queueCondition.notify_all();
+        for (auto &worker : this->workers)
+            worker.join();
+
+        for (auto &[key, cachedVariant] : this->variants)
+            if (cachedVariant.pipeline != VK_NULL_HANDLE)
+                vkDestroyPipeline(this->device, cachedVariant.pipeline, nullptr);
+    }
+
+    pipelineVariantCache(const pipelineVariantCache &) = delete;
+    pipelineVariantCache &operator=(const pipelineVariantCache &) = delete;
+
+    // Keeps a copy of the code, and returns the hash that keys refer to it by
+    std::uint64_t addShaderCode(spirvCodeView code)
+    {
+        auto hash = hashSpirvCode(code);
+        std::lock_guard lock(this->mutex);
+        this->shaderCode.try_emplace(hash, code.words, code.words + code.wordCount);
+        return hash;
+    }
+
+    // Drops the code of a shader that won't be asked for anymore (like one a hot reload replaced), along with every variant built from it, whose pipelines go to retire, which has to keep them alive until the GPU is done with whatever was recorded with them
+    // Variants still being compiled get destroyed by their worker once it's done with them
+    void evictShader(std::uint64_t shaderHash, const std::function<void(VkPipeline)> &retire)
+    {
+        auto isBuiltFromShader = [&](const graphicsPipelineKey &key) { return key.vertexShaderHash == shaderHash || key.fragmentShaderHash == shaderHash; };
+
+        std::lock_guard lock(this->mutex);
+        this->shaderCode.erase(shaderHash);
+        this->queue.erase(std::remove_if(this->queue.begin(), this->queue.end(), isBuiltFromShader), this->queue.end());
+        for (auto it = this->variants.begin(); it != this->variants.end();) {
+            if (!isBuiltFromShader(it->first)) {
+                ++it;
+                continue;
+            }
+            if (it->second.pipeline != VK_NULL_HANDLE)
+                retire(it->second.pipeline);
+            ++this->evictedVariantCount;
+            it = this->variants.erase(it);
+        }
+    }
+
+    // Starts compiling a variant we're likely to need soon, without waiting for it
+    void prepare(const graphicsPipelineKey &key)
+    {
+        std::lock_guard lock(this->mutex);
+        this->request(key);
+    }
+
+    // The variant's pipeline if it's ready, and VK_NULL_HANDLE otherwise (in which case it gets compiled, unless it already failed to)
+    VkPipeline find(const graphicsPipelineKey &key)
+    {
+        std::lock_guard lock(this->mutex);
+        auto &foundVariant = this->request(key);
+        if (foundVariant.state == variantState::ready)
+            ++foundVariant.hitCount;
+        else if (foundVariant.state == variantState::compiling)
+            ++foundVariant.missCount;
+        return foundVariant.pipeline;
+    }
+
+    // Waits for the variant to be compiled, for when there's nothing to fall back to
+    VkPipeline get(const graphicsPipelineKey &key)
+    {
+        std::unique_lock lock(this->mutex);
+        auto &foundVariant = this->request(key);
+        this->compiledCondition.wait(lock, [&]() { return foundVariant.state != variantState::compiling; });
+        if (foundVariant.state == variantState::failed)
+            throw std::runtime_error("Failed to create graphics pipeline");
+        ++foundVariant.hitCount;
+        return foundVariant.pipeline;
+    }
+
+    void printStats(std::ostream &stream)
+    {
+        std::lock_guard lock(this->mutex);
+
+        std::vector<std::pair<const graphicsPipelineKey *, const variant *>> sortedVariants;
+        for (const auto &[key, cachedVariant] : this->variants)
+            sortedVariants.emplace_back(&key, &cachedVariant);
+        std::sort(sortedVariants.begin(), sortedVariants.end(), [](const auto &a, const auto &b) { return a.second->index < b.second->index; });
+
+        stream << "Pipeline variants: " << this->variants.size() << " requested (" << this->evictedVariantCount << " more evicted), compiled on " << this->workers.size() << " threads\n";
+        for (auto [key, cachedVariant] : sortedVariants) {
+            stream << '\t' << key->describe() << ": ";
+            if (cachedVariant->state == variantState::compiling)
+                stream << "still compiling";
+            else
+                stream << (cachedVariant->state == variantState::failed ? "failed after " : "compiled in ") << std::fixed << std::setprecision(2) << cachedVariant->compileMilliseconds << "ms";
+            stream << ", " << cachedVariant->hitCount << " hits, " << cachedVariant->missCount << " misses\n";
+        }
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Everything a recorded command buffer bakes in that can change while we're running
+enum class recordingDependency : std::size_t {
+    scene, // What we draw (buffers, draw list, view)
+    pipeline,
+    swapChain, // Framebuffers and extent
+    count, // Not an actual dependency, just how many of them there are
+};
+
+// Keeps track of which of a set of cached recordings (command buffers, in practice) are out of date, so that we only re-record the ones that are
+// Rather than flagging every recording whenever something changes, changes bump a version number, and each recording remembers the version it was made against: it's out of date as soon as the two differ
+class recordingCache {
+    static constexpr std::array<const char *, static_cast<std::size_t>(recordingDependency::count)> dependencyNames = { { "scene", "pipeline", "swap chain" } };
+
+    std::uint64_t currentVersion = 1;
+    std::vector<std::uint64_t> recordedVersions; // 0 means never recorded
+
+    std::array<std::uint64_t, static_cast<std::size_t>(recordingDependency::count)> invalidationCounts = {};
+    std::uint64_t recordCount = 0;
+    std::uint64_t reuseCount = 0;
+
+public:
+    // New entries start out never recorded, and existing ones keep whatever state they were in
+    void resize(std::size_t entryCount)
+    {
+        this->recordedVersions.resize(entryCount, 0);
+    }
+
+    void invalidate(recordingDependency dependency)
+    {
+        ++this->currentVersion;
+        ++this->invalidationCounts.at(static_cast<std::size_t>(dependency));
+    }
+
+    // Returns whether the entry needs (re-)recording before use, and assumes the caller does it right away if so
+    bool acquire(std::size_t entry)
+    {
+        auto &recordedVersion = this->recordedVersions.at(entry);
+        if (recordedVersion == this->currentVersion) {
+            ++this->reuseCount;
+            return false;
+        }
+
+        recordedVersion = this->currentVersion;
+        ++this->recordCount;
+        return true;
+    }
+
+    void printStats(std::ostream &stream, const char *name) const
+    {
+        stream << name << ": " << this->recordCount << " recorded, " << this->reuseCount << " reused (invalidated by";
+        for (std::size_t i = 0; i < this->invalidationCounts.size(); ++i)
+            stream << (i == 0 ? " " : ", ") << dependencyNames.at(i) << ' ' << this->invalidationCounts.at(i) << 'x';
+        stream << ")\n";
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Why the window needs a new frame
+enum class redrawReason : std::size_t {
+    input, // Keys, mouse buttons, cursor and scrolling
+    resize,
+    expose, // The window system lost what we last presented (e.g. the window got uncovered)
+    animation, // A timer set with scheduleRedraw went off
+    data, // Something changed what we draw
+    count, // Not an actual reason, just how many of them there are
+};
+
+// Decides when to render in on-demand mode, where rather than drawing frames back to back we sleep until something marks the window as needing a redraw
+// Requests can come from any thread (as long as whoever makes them also wakes up the main thread, e.g. with glfwPostEmptyEvent), timers only from the main thread
+class redrawScheduler {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::array<const char *, static_cast<std::size_t>(redrawReason::count)> reasonNames = { { "input", "resize", "expose", "animation", "data" } };
+
+    std::atomic<std::uint32_t> pendingReasons = 0; // One bit per redrawReason
+    std::optional<clock::time_point> nextTimerDeadline;
+
+    clock::time_point startTime = clock::now();
+    clock::duration idleTime = clock::duration::zero();
+    std::uint64_t renderedFrameCount = 0;
+    std::uint64_t wakeUpCount = 0; // Every time we woke up to check, whether or not there was anything to draw
+    std::array<std::uint64_t, static_cast<std::size_t>(redrawReason::count)> redrawCounts = {}; // How many rendered frames each reason asked for (a frame can have several)
+
+public:
+    void requestRedraw(redrawReason reason)
+    {
+        this->pendingReasons.fetch_or(1u << static_cast<std::uint32_t>(reason));
+    }
+
+    // Asks for a redraw at some point in the future (only the earliest deadline is kept, which is all a single animation needs)
+    void scheduleRedraw(clock::time_point deadline)
+    {
+        this->nextTimerDeadline = this->nextTimerDeadline.has_value() ? std::min(this->nextTimerDeadline.value(), deadline) : deadline;
+    }
+
+    // Turns a timer that went off into a pending redraw, and returns how long we can sleep until the next one does (nothing if there's no timer at all)
+    std::optional<std::chrono::duration<double>> update()
+    {
+        ++this->wakeUpCount;
+        if (!this->nextTimerDeadline.has_value())
+            return std::nullopt;
+
+        auto now = clock::now();
+        if (now < this->nextTimerDeadline.value())
+            return this->nextTimerDeadline.value() - now;
+
+        this->nextTimerDeadline.reset();
+        this->requestRedraw(redrawReason::animation);
+        return std::nullopt;
+    }
+
+    bool isRedrawPending() const
+    {
+        return this->pendingReasons != 0;
+    }
+
+    // Must be called right before rendering, so that anything that comes up while we render asks for another frame
+    void beginFrame()
+    {
+        auto reasons = this->pendingReasons.exchange(0);
+        for (std::size_t i = 0; i < this->redrawCounts.size(); ++i)
+            this->redrawCounts.at(i) += (reasons >> i) & 1;
+        ++this->renderedFrameCount;
+    }
+
+    void addIdleTime(clock::duration duration)
+    {
+        this->idleTime += duration;
+    }
+
+    // Skipped frames are the ones a display running at refreshRate would have shown over the time we've been running, minus the ones we rendered, i.e. what rendering continuously would have cost us on top
+    void printStats(std::ostream &stream, double refreshRate) const
+    {
+        std::chrono::duration<double> elapsedTime = clock::now() - this->startTime;
+        auto displayedFrameCount = static_cast<std::uint64_t>(elapsedTime.count() * refreshRate);
+        auto skippedFrameCount = displayedFrameCount - std::min(displayedFrameCount, this->renderedFrameCount);
+
+        stream << "On-demand rendering: " << this->renderedFrameCount << " frames rendered, " << skippedFrameCount << " skipped at " << refreshRate << "Hz over " << std::fixed << std::setprecision(1) << elapsedTime.count() << "s (idle "
+               << 100 * std::chrono::duration<double>(this->idleTime).count() / std::max(elapsedTime.count(), 1e-9) << "% of the time, " << this->wakeUpCount << " wake-ups)\n";
+        stream << "\tredraws asked for by";
+        for (std::size_t i = 0; i < this->redrawCounts.size(); ++i)
+            stream << (i == 0 ? " " : ", ") << reasonNames.at(i) << ' ' << this->redrawCounts.at(i);
+        stream << '\n';
+    }
+};
@@ -0,0 +1,978 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include "gpuMemoryAllocator.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+// How a pass uses a resource, which decides the stages and accesses barriers have to cover and, for images, the layout the pass needs them in
+enum class renderGraphUsage : std::size_t {
+    colorAttachment,
+    depthAttachment, // Read and written, as depth testing does both
+    inputAttachment, // Read at the same pixel it was written at by an earlier subpass, which is what lets merged passes keep attachments in tile memory
+    sampledImage,
+    storageRead, // Buffers or images, read from a shader
+    storageWrite, // Buffers or images, written (and possibly read) from a shader
+    transferSource,
+    transferDestination,
+    indirectBuffer,
+    vertexBuffer,
+    present, // Only as the final usage of an imported image
+    count, // Not an actual usage, just how many of them there are
+};
+
+enum class renderGraphPassKind {
+    graphics, // Runs inside a render pass, possibly as a subpass of one shared with other graphics passes
+    compute,
+    transfer,
+};
+
+// Passes declare which resources they use and how, and the graph works out everything in between: pipeline barriers and layout transitions (only where there's an actual hazard, and batched per pass), render passes with their load and store ops, and the memory of transient images, which images that are never alive at the same time share
+// Consecutive graphics passes get merged into the subpasses of a single render pass whenever the later ones only read what the earlier ones wrote at the same pixel (as input attachments), so that on tile-based GPUs the data never has to leave the tile
+// Passes run in the order they're declared, minus the ones nothing depends on, and everything is decided once by compile: execute just replays it
+class renderGraph {
+public:
+    using resourceId = std::uint32_t;
+    using passId = std::uint32_t;
+
+    // What depends on the extent and the imported images, and so gets recreated along with the swap chain (see createTargets and releaseTargets)
+    struct targets {
+        std::vector<VkImage> images; // Transient images
+        std::vector<VkImageView> imageViews; // Same order as images
+        std::vector<gpuAllocation> allocations; // Shared by the images that alias each other
+        std::vector<VkFramebuffer> framebuffers; // For each render pass, one per imported image index
+        VkExtent2D extent = {};
+        VkDeviceSize memorySize = 0;
+        VkDeviceSize unaliasedMemorySize = 0; // What the transient images would take up if each had memory of its own
+
+        void destroy(VkDevice device, gpuMemoryAllocator &allocator)
+        {
+            for (auto framebuffer : this->framebuffers)
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            for (auto imageView : this->imageViews)
+                vkDestroyImageView(device, imageView, nullptr);
+            for (auto image : this->images)
+                vkDestroyImage(device, image, nullptr);
+            for (auto &allocation : this->allocations)
+                allocator.free(allocation);
+            *this = {};
+        }
+    };
+
+private:
+    static constexpr passId previousFrame = std::numeric_limits<passId>::max(); // Stands for accesses made by the previous frame, which was submitted to the same queue
+
+    struct usageInfo {
+        VkPipelineStageFlags stages; // 0 for shader accesses, whose stages depend on the kind of pass
+        VkAccessFlags access;
+        VkImageLayout layout;
+        VkImageUsageFlags imageUsage;
+        bool isWrite;
+        bool isAttachment;
+        bool isForImages;
+        bool isForBuffers;
+    };
+    static constexpr std::array<usageInfo, static_cast<std::size_t>(renderGraphUsage::count)> usageInfos = {
+        {
+            { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true, true, false },
+            { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, true, true, false },
+            { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, false, true, true, false },
+            { 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false, false, true, false },
+            { 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false, false, true, true },
+            { 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true, false, true, true },
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false, false, true, true },
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true, false, true, true },
+            { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false, false, false, true },
+            { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, false, false, false, true },
+            { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, false, false, false, false }, // Presentation is ordered by a semaphore, so there's nothing to wait for but the layout transition
+        }
+    };
+    static constexpr VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    static constexpr VkPipelineStageFlags framebufferSpaceStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    struct resource {
+        std::string name;
+        bool isImage = false;
+        bool isTransient = false; // Images only: created by the graph, and their contents don't outlive the frame
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        std::optional<renderGraphUsage> finalUsage; // Imported images only: what they have to be ready for once the graph is done with them (their previous contents are dropped at the start of every frame)
+        std::vector<VkImage> importedImages; // By imported image index, e.g. one per swap chain image
+        std::vector<VkImageView> importedImageViews;
+        VkBuffer importedBuffer = VK_NULL_HANDLE; // Imported buffers keep their contents from one frame to the next
+
+        // Worked out by compile
+        bool isUsed = false;
+        std::size_t firstStep = 0, lastStep = 0;
+        VkImageUsageFlags imageUsage = 0;
+        bool isLazilyAllocated = false; // Only ever lives inside a single render pass, so with luck it never gets any actual memory
+        std::uint32_t memory = 0; // What hazards are tracked on: the resource itself, except for transient images that share their memory with others
+        std::size_t targetImage = 0; // In targets::images, for transient images
+    };
+
+    struct passUse {
+        resourceId resource;
+        renderGraphUsage usage; // The first one it was declared with, if there were several
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        bool isWrite;
+        std::optional<VkClearValue> clearValue; // Attachments only
+    };
+
+    struct pass {
+        std::string name;
+        renderGraphPassKind kind;
+        VkSubpassContents contents;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<passUse> uses;
+
+        // Worked out by compile
+        bool isCulled = false;
+        std::size_t step = 0;
+        std::uint32_t subpass = 0;
+    };
+
+    struct barrier {
+        resourceId resource;
+        VkPipelineStageFlags srcStages, dstStages;
+        VkAccessFlags srcAccess, dstAccess;
+        VkImageLayout oldLayout, newLayout;
+    };
+
+    struct attachment {
+        resourceId resource;
+        VkAttachmentLoadOp loadOp;
+        VkAttachmentStoreOp storeOp;
+        VkImageLayout initialLayout, finalLayout;
+    };
+
+    // Either a single pass outside of any render pass, or a run of graphics passes merged into the subpasses of one
+    struct step {
+        std::vector<passId> passes;
+        bool isRenderPass = false;
+        std::vector<barrier> barriers; // Recorded before the step (for render passes, only what can't be expressed as a subpass dependency, i.e. layout transitions of images that aren't attachments)
+        std::vector<attachment> attachments;
+        std::vector<VkClearValue> clearValues; // One per attachment
+        std::vector<VkSubpassDependency> dependencies;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::size_t firstFramebuffer = 0; // In targets::framebuffers
+    };
+
+    // An access some later access might have to wait for
+    struct access {
+        passId pass;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access; // Only the writes, as there's nothing to make visible about a read
+    };
+    struct memoryState {
+        std::optional<access> lastWrite; // Layout transitions count as writes too
+        std::vector<access> readsSinceLastWrite;
+        VkPipelineStageFlags visibleStages = 0; // Where the last write has been made visible already, so that later reads there don't need another barrier
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    std::vector<resource> resources;
+    std::vector<pass> passes;
+    std::vector<step> steps;
+    std::vector<barrier> finalBarriers; // Recorded after the last step, to leave imported images ready for their final usage
+    std::uint32_t memoryCount = 0;
+    bool isCompiled = false;
+    targets currentTargets;
+
+    static VkImageAspectFlags getFormatAspectMask(VkFormat format)
+    {
+        if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT)
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT)
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        if (format == VK_FORMAT_S8_UINT)
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+
+    resourceId addResource(resource &&newResource)
+    {
+        if (this->isCompiled)
+            throw std::runtime_error("Can't add resources to a render graph once it's compiled");
+        this->resources.push_back(std::move(newResource));
+        return static_cast<resourceId>(this->resources.size() - 1);
+    }
+
+    const pass &getPass(passId id) const
+    {
+        return this->passes.at(id);
+    }
+
+    // Walking backwards, a pass is needed if it writes something that outlives the graph or that a needed pass reads (passes that don't write anything at all are kept, as they must be there for some side effect we can't see)
+    void cullPasses()
+    {
+        std::vector<bool> isNeeded(this->resources.size());
+        for (std::size_t i = 0; i < this->resources.size(); ++i)
+            isNeeded.at(i) = !this->resources.at(i).isTransient;
+
+        for (auto it = this->passes.rbegin(); it != this->passes.rend(); ++it) {
+            bool writesAnything = std::any_of(it->uses.begin(), it->uses.end(), [](const passUse &use) { return use.isWrite; });
+            bool writesAnythingNeeded = std::any_of(it->uses.begin(), it->uses.end(), [&](const passUse &use) { return use.isWrite && isNeeded.at(use.resource); });
+            it->isCulled = writesAnything && !writesAnythingNeeded;
+            if (it->isCulled)
+                continue;
+
+            // Anything cleared doesn't depend on what was there before, everything else (attachments that get loaded included) does
+            for (const auto &use : it->uses)
+                if (!use.clearValue.has_value())
+                    isNeeded.at(use.resource) = true;
+        }
+    }
+
+    // A graphics pass can join the render pass of the previous one as long as whatever it shares with the passes already in there is pixel-local, i.e. used as attachments on both sides (anything else, like sampling an image written earlier in the render pass, could read other pixels, which a tile-based GPU might not have rendered yet)
+    bool canMergeIntoRenderPass(const step &renderPass, const pass &newPass) const
+    {
+        for (const auto &use : newPass.uses)
+            for (auto otherPassId : renderPass.passes)
+                for (const auto &otherUse : this->getPass(otherPassId).uses) {
+                    if (otherUse.resource != use.resource)
+                        continue;
+                    bool isAttachment = usageInfos.at(static_cast<std::size_t>(use.usage)).isAttachment, isOtherAttachment = usageInfos.at(static_cast<std::size_t>(otherUse.usage)).isAttachment;
+                    if (isAttachment != isOtherAttachment || (!isAttachment && (use.isWrite || otherUse.isWrite)))
+                        return false;
+                }
+        return true;
+    }
+
+    void groupPasses()
+    {
+        this->steps.clear();
+        for (passId id = 0; id < this->passes.size(); ++id) {
+            auto &newPass = this->passes.at(id);
+            if (newPass.isCulled)
+                continue;
+
+            bool isGraphics = newPass.kind == renderGraphPassKind::graphics;
+            if (!isGraphics || this->steps.empty() || !this->steps.back().isRenderPass || !this->canMergeIntoRenderPass(this->steps.back(), newPass)) {
+                this->steps.emplace_back();
+                this->steps.back().isRenderPass = isGraphics;
+            }
+
+            newPass.step = this->steps.size() - 1;
+            newPass.subpass = static_cast<std::uint32_t>(this->steps.back().passes.size());
+            this->steps.back().passes.push_back(id);
+        }
+    }
+
+    // Transient images that only ever live inside a single render pass don't need memory at all on GPUs that can keep them in tile memory (lazily allocated memory), and the others share memory with any other transient image whose lifetime doesn't overlap with theirs
+    // Lifetimes are in steps rather than passes, since every attachment of a render pass is alive for the whole of it
+    void assignMemory()
+    {
+        for (auto &resource : this->resources) {
+            resource.isUsed = false;
+            resource.imageUsage = 0;
+        }
+        for (const auto &pass : this->passes) {
+            if (pass.isCulled)
+                continue;
+            for (const auto &use : pass.uses) {
+                auto &resource = this->resources.at(use.resource);
+                resource.firstStep = resource.isUsed ? std::min(resource.firstStep, pass.step) : pass.step;
+                resource.lastStep = resource.isUsed ? std::max(resource.lastStep, pass.step) : pass.step;
+                resource.isUsed = true;
+                resource.imageUsage |= usageInfos.at(static_cast<std::size_t>(use.usage)).imageUsage;
+            }
+        }
+
+        std::vector<resourceId> resourcesByFirstStep;
+        for (resourceId id = 0; id < this->resources.size(); ++id)
+            resourcesByFirstStep.push_back(id);
+        std::stable_sort(resourcesByFirstStep.begin(), resourcesByFirstStep.end(), [&](resourceId a, resourceId b) { return this->resources.at(a).firstStep < this->resources.at(b).firstStep; });
+
+        // Depth and color images tend to want different memory types, so they're only aliased with their own kind
+        struct sharedMemory {
+            bool isDepthStencil;
+            std::size_t lastStep;
+            std::uint32_t memory;
+        };
+        std::vector<sharedMemory> sharedMemories;
+
+        this->memoryCount = 0;
+        for (auto id : resourcesByFirstStep) {
+            auto &resource = this->resources.at(id);
+            constexpr VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+            resource.isLazilyAllocated = resource.isTransient && resource.isUsed && resource.firstStep == resource.lastStep && this->steps.at(resource.firstStep).isRenderPass && (resource.imageUsage & ~attachmentUsage) == 0;
+            if (resource.isLazilyAllocated)
+                resource.imageUsage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+            if (!resource.isTransient || !resource.isUsed || resource.isLazilyAllocated) {
+                resource.memory = this->memoryCount++;
+                continue;
+            }
+
+            bool isDepthStencil = getFormatAspectMask(resource.format) != VK_IMAGE_ASPECT_COLOR_BIT;
+            auto it = std::find_if(sharedMemories.begin(), sharedMemories.end(), [&](const sharedMemory &memory) { return memory.isDepthStencil == isDepthStencil && memory.lastStep < resource.firstStep; });
+            if (it == sharedMemories.end()) {
+                sharedMemories.push_back({ isDepthStencil, resource.lastStep, this->memoryCount++ });
+                it = sharedMemories.end() - 1;
+            }
+            it->lastStep = resource.lastStep;
+            resource.memory = it->memory;
+        }
+    }
+
+    static void addDependency(step &renderPass, std::uint32_t srcSubpass, std::uint32_t dstSubpass, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+    {
+        // Dependencies that stay within the same pixel let tile-based GPUs go on with other tiles instead of waiting for the whole framebuffer
+        bool isFramebufferLocal = srcSubpass != VK_SUBPASS_EXTERNAL && dstSubpass != VK_SUBPASS_EXTERNAL && ((srcStages | dstStages) & ~framebufferSpaceStages) == 0;
+        VkDependencyFlags flags = isFramebufferLocal ? VK_DEPENDENCY_BY_REGION_BIT : 0;
+
+        for (auto &dependency : renderPass.dependencies)
+            if (dependency.srcSubpass == srcSubpass && dependency.dstSubpass == dstSubpass) {
+                dependency.srcStageMask |= srcStages;
+                dependency.srcAccessMask |= srcAccess;
+                dependency.dstStageMask |= dstStages;
+                dependency.dstAccessMask |= dstAccess;
+                dependency.dependencyFlags &= flags;
+                return;
+            }
+
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass = srcSubpass;
+        dependency.dstSubpass = dstSubpass;
+        dependency.srcStageMask = srcStages;
+        dependency.srcAccessMask = srcAccess;
+        dependency.dstStageMask = dstStages;
+        dependency.dstAccessMask = dstAccess;
+        dependency.dependencyFlags = flags;
+        renderPass.dependencies.push_back(dependency);
+    }
+
+    // With nothing to wait for, there's still the layout transition, which we have wait for the stages it's needed in (for an imported image, that's also the stage whoever hands it to us must have waited at, e.g. the semaphore wait of a swap chain image)
+    static barrier makeBarrier(resourceId resource, const std::vector<access> &sources, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+    {
+        barrier result = { resource, 0, dstStages, 0, dstAccess, oldLayout, newLayout };
+        for (const auto &source : sources) {
+            result.srcStages |= source.stages;
+            result.srcAccess |= source.access;
+        }
+        if (result.srcStages == 0)
+            result.srcStages = dstStages;
+        return result;
+    }
+
+    static std::vector<access> getWriteSources(const memoryState &state)
+    {
+        std::vector<access> result = state.readsSinceLastWrite;
+        if (state.lastWrite.has_value())
+            result.push_back(state.lastWrite.value());
+        return result;
+    }
+
+    void simulateUse(step &currentStep, passId currentPassId, const passUse &use, std::vector<VkImageLayout> &layouts, std::vector<bool> &hasContents, std::vector<memoryState> &memoryStates)
+    {
+        const auto &currentPass = this->getPass(currentPassId);
+        const auto &resource = this->resources.at(use.resource);
+        auto &state = memoryStates.at(resource.memory);
+        bool isAttachment = currentStep.isRenderPass && usageInfos.at(static_cast<std::size_t>(use.usage)).isAttachment;
+        bool isLayoutChange = resource.isImage && layouts.at(use.resource) != use.layout;
+
+        // Load ops are decided by an attachment's first use in the render pass, and store ops (see finishRenderPass) by whether anything after it needs it
+        if (isAttachment && std::none_of(currentStep.attachments.begin(), currentStep.attachments.end(), [&](const attachment &other) { return other.resource == use.resource; })) {
+            attachment newAttachment = {};
+            newAttachment.resource = use.resource;
+            newAttachment.loadOp = use.clearValue.has_value() ? VK_ATTACHMENT_LOAD_OP_CLEAR : hasContents.at(use.resource) ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            newAttachment.initialLayout = newAttachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? layouts.at(use.resource) : VK_IMAGE_LAYOUT_UNDEFINED;
+            currentStep.attachments.push_back(newAttachment);
+            currentStep.clearValues.push_back(use.clearValue.value_or(VkClearValue {}));
+        }
+
+        // Writes have to wait for every access since the last write (and so do layout transitions, which are writes too), reads only for the last write, and only if it isn't visible to them already
+        std::vector<access> sources;
+        if (use.isWrite || isLayoutChange)
+            sources = getWriteSources(state);
+        else if (state.lastWrite.has_value() && ((use.stages & ~state.visibleStages) != 0 || (use.access & ~state.visibleAccess) != 0))
+            sources.push_back(state.lastWrite.value());
+
+        if (!sources.empty() || isLayoutChange) {
+            // Images that aren't attachments can't change layouts inside a render pass, but canMergeIntoRenderPass made sure nothing else in the render pass touches them, so it can be done before it
+            if (!currentStep.isRenderPass || (isLayoutChange && !isAttachment))
+                currentStep.barriers.push_back(makeBarrier(use.resource, sources, layouts.at(use.resource), use.layout, use.stages, use.access));
+            else if (sources.empty())
+                addDependency(currentStep, VK_SUBPASS_EXTERNAL, currentPass.subpass, use.stages, 0, use.stages, use.access);
+            else
+                for (const auto &source : sources) {
+                    bool isInRenderPass = source.pass != previousFrame && this->getPass(source.pass).step == currentPass.step;
+                    addDependency(currentStep, isInRenderPass ? this->getPass(source.pass).subpass : VK_SUBPASS_EXTERNAL, currentPass.subpass, source.stages, source.access, use.stages, use.access);
+                }
+        }
+
+        if (use.isWrite || isLayoutChange) {
+            state.lastWrite = access { currentPassId, use.stages, use.access & writeAccessMask };
+            state.readsSinceLastWrite.clear();
+            if (!use.isWrite)
+                state.readsSinceLastWrite.push_back({ currentPassId, use.stages, 0 });
+
+            // A write isn't visible anywhere until a later barrier makes it so, but a layout transition is visible to whoever it was made for
+            state.visibleStages = use.isWrite ? 0 : use.stages;
+            state.visibleAccess = use.isWrite ? 0 : use.access;
+        } else {
+            if (!sources.empty()) {
+                state.visibleStages |= use.stages;
+                state.visibleAccess |= use.access;
+            }
+            state.readsSinceLastWrite.push_back({ currentPassId, use.stages, 0 });
+        }
+
+        if (resource.isImage)
+            layouts.at(use.resource) = use.layout;
+        if (use.isWrite)
+            hasContents.at(use.resource) = true;
+    }
+
+    void finishRenderPass(step &renderPass, std::size_t stepIndex, std::vector<VkImageLayout> &layouts, const std::vector<memoryState> &memoryStates)
+    {
+        for (auto &renderPassAttachment : renderPass.attachments) {
+            const auto &resource = this->resources.at(renderPassAttachment.resource);
+            bool isUsedLater = resource.lastStep > stepIndex;
+
+            // Transient attachments nothing reads after the render pass never leave tile memory
+            renderPassAttachment.storeOp = isUsedLater || !resource.isTransient ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            renderPassAttachment.finalLayout = layouts.at(renderPassAttachment.resource);
+
+            // The render pass can leave imported images in the layout they need after the graph itself, rather than us needing another barrier for that
+            if (!isUsedLater && resource.finalUsage.has_value()) {
+                const auto &finalUsage = usageInfos.at(static_cast<std::size_t>(resource.finalUsage.value()));
+                for (const auto &source : getWriteSources(memoryStates.at(resource.memory)))
+                    if (source.pass != previousFrame && this->getPass(source.pass).step == stepIndex)
+                        addDependency(renderPass, this->getPass(source.pass).subpass, VK_SUBPASS_EXTERNAL, source.stages, source.access, finalUsage.stages, finalUsage.access);
+                renderPassAttachment.finalLayout = finalUsage.layout;
+                layouts.at(renderPassAttachment.resource) = finalUsage.layout;
+            }
+        }
+    }
+
+    // Goes through the whole frame, deciding every barrier, dependency and load/store op along the way
+    // memoryStates are how the previous frame left things, and get updated to how this one does
+    void simulateFrame(std::vector<memoryState> &memoryStates)
+    {
+        std::vector<VkImageLayout> layouts(this->resources.size(), VK_IMAGE_LAYOUT_UNDEFINED); // Images never keep their contents from one frame to the next, so we never need to know their previous layout
+        std::vector<bool> hasContents(this->resources.size(), false);
+
+        // Imported images come to us through something we can't see (e.g. acquiring from the swap chain, which comes with a semaphore), so the previous frame has nothing to do with them
+        for (const auto &resource : this->resources)
+            if (resource.isImage && !resource.isTransient)
+                memoryStates.at(resource.memory) = {};
+
+        for (std::size_t stepIndex = 0; stepIndex < this->steps.size(); ++stepIndex) {
+            auto &currentStep = this->steps.at(stepIndex);
+            currentStep.barriers.clear();
+            currentStep.attachments.clear();
+            currentStep.clearValues.clear();
+            currentStep.dependencies.clear();
+
+            for (auto id : currentStep.passes)
+                for (const auto &use : this->getPass(id).uses)
+                    this->simulateUse(currentStep, id, use, layouts, hasContents, memoryStates);
+
+            if (currentStep.isRenderPass)
+                this->finishRenderPass(currentStep, stepIndex, layouts, memoryStates);
+        }
+
+        this->finalBarriers.clear();
+        for (resourceId id = 0; id < this->resources.size(); ++id) {
+            const auto &resource = this->resources.at(id);
+            if (!resource.finalUsage.has_value())
+                continue;
+
+            const auto &finalUsage = usageInfos.at(static_cast<std::size_t>(resource.finalUsage.value()));
+            if (layouts.at(id) != finalUsage.layout)
+                this->finalBarriers.push_back(makeBarrier(id, getWriteSources(memoryStates.at(resource.memory)), layouts.at(id), finalUsage.layout, finalUsage.stages, finalUsage.access));
+        }
+    }
+
+    VkImage getImage(const resource &imageResource, std::uint32_t importedImageIndex) const
+    {
+        return imageResource.isTransient ? this->currentTargets.images.at(imageResource.targetImage) : imageResource.importedImages.at(importedImageIndex);
+    }
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<barrier> &barriers, std::uint32_t importedImageIndex) const
+    {
+        if (barriers.empty())
+            return;
+
+        VkPipelineStageFlags srcStages = 0, dstStages = 0;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        for (const auto &pendingBarrier : barriers) {
+            srcStages |= pendingBarrier.srcStages;
+            dstStages |= pendingBarrier.dstStages;
+
+            const auto &resource = this->resources.at(pendingBarrier.resource);
+            if (resource.isImage) {
+                VkImageMemoryBarrier imageBarrier = {};
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageBarrier.srcAccessMask = pendingBarrier.srcAccess;
+                imageBarrier.dstAccessMask = pendingBarrier.dstAccess;
+                imageBarrier.oldLayout = pendingBarrier.oldLayout;
+                imageBarrier.newLayout = pendingBarrier.newLayout;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.image = this->getImage(resource, importedImageIndex);
+                imageBarrier.subresourceRange = { getFormatAspectMask(resource.format), 0, 1, 0, 1 };
+                imageBarriers.push_back(imageBarrier);
+            } else {
+                VkBufferMemoryBarrier bufferBarrier = {};
+                bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                bufferBarrier.srcAccessMask = pendingBarrier.srcAccess;
+                bufferBarrier.dstAccessMask = pendingBarrier.dstAccess;
+                bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.buffer = resource.importedBuffer;
+                bufferBarrier.offset = 0;
+                bufferBarrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(bufferBarrier);
+            }
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, static_cast<std::uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<std::uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+public:
+    renderGraph() = default;
+
+    renderGraph(const renderGraph &) = delete;
+    renderGraph &operator=(const renderGraph &) = delete;
+
+    // Images that come from outside the graph (like swap chain images), of which there can be several that we get handed one of every frame (see bindImportedImages)
+    resourceId importImage(std::string name, VkFormat format, renderGraphUsage finalUsage)
+    {
+        resource newResource;
+        newResource.name = std::move(name);
+        newResource.isImage = true;
+        newResource.format = format;
+        newResource.finalUsage = finalUsage;
+        return this->addResource(std::move(newResource));
+    }
+
+    resourceId importBuffer(std::string name)
+    {
+        resource newResource;
+        newResource.name = std::move(name);
+        return this->addResource(std::move(newResource));
+    }
+
+    // Images the graph creates (at the size given to createTargets) and owns, for data that only lives within a frame
+    resourceId createTransientImage(std::string name, VkFormat format)
+    {
+        resource newResource;
+        newResource.name = std::move(name);
+        newResource.isImage = true;
+        newResource.isTransient = true;
+        newResource.format = format;
+        return this->addResource(std::move(newResource));
+    }
+
+    // Graphics passes record what goes inside a subpass (the graph begins and ends render passes itself), and can record it into secondary command buffers if contents says so
+    passId addPass(std::string name, renderGraphPassKind kind, std::function<void(VkCommandBuffer)> record, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE)
+    {
+        if (this->isCompiled)
+            throw std::runtime_error("Can't add passes to a render graph once it's compiled");
+
+        pass newPass;
+        newPass.name = std::move(name);
+        newPass.kind = kind;
+        newPass.contents = contents;
+        newPass.record = std::move(record);
+        this->passes.push_back(std::move(newPass));
+        return static_cast<passId>(this->passes.size() - 1);
+    }
+
+    // A clear value means the attachment gets cleared when the render pass starts, instead of being loaded (which only makes sense on its first use in the render pass)
+    void use(passId id, resourceId resourceToUse, renderGraphUsage usage, std::optional<VkClearValue> clearValue = std::nullopt)
+    {
+        auto &usingPass = this->passes.at(id);
+        const auto &resource = this->resources.at(resourceToUse);
+        const auto &info = usageInfos.at(static_cast<std::size_t>(usage));
+        if (!(resource.isImage ? info.isForImages : info.isForBuffers))
+            throw std::runtime_error("Pass '" + usingPass.name + "' uses '" + resource.name + "' in a way that isn't possible for " + (resource.isImage ? "an image" : "a buffer"));
+        if ((info.isAttachment && usingPass.kind != renderGraphPassKind::graphics) || (info.stages == 0 && usingPass.kind == renderGraphPassKind::transfer))
+            throw std::runtime_error("Pass '" + usingPass.name + "' uses '" + resource.name + "' in a way its kind of pass can't");
+        if (clearValue.has_value() && !info.isAttachment)
+            throw std::runtime_error("Pass '" + usingPass.name + "' clears '" + resource.name + "', which only attachments can be");
+
+        VkPipelineStageFlags shaderStages = usingPass.kind == renderGraphPassKind::graphics ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        passUse newUse = { resourceToUse, usage, info.stages != 0 ? info.stages : shaderStages, info.access, resource.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED, info.isWrite, clearValue };
+
+        // Using the same resource several ways in the same pass is fine as long as they agree on the layout, and amounts to using it all of those ways at once
+        for (auto &existingUse : usingPass.uses)
+            if (existingUse.resource == resourceToUse) {
+                if (existingUse.layout != newUse.layout)
+                    throw std::runtime_error("Pass '" + usingPass.name + "' uses '" + resource.name + "' in two different layouts");
+                existingUse.stages |= newUse.stages;
+                existingUse.access |= newUse.access;
+                existingUse.isWrite |= newUse.isWrite;
+                if (newUse.clearValue.has_value())
+                    existingUse.clearValue = newUse.clearValue;
+                return;
+            }
+        usingPass.uses.push_back(newUse);
+    }
+
+    // Works out everything about the frame that doesn't depend on the actual Vulkan objects, after which the graph can't be changed anymore
+    void compile()
+    {
+        this->cullPasses();
+        this->groupPasses();
+        this->assignMemory();
+
+        // Resources that outlive the frame (imported buffers, and the memory transient images share, which the next frame reuses) start out the way the previous frame left them, which we find out by going through the frame once beforehand
+        std::vector<memoryState> memoryStates(this->memoryCount);
+        this->simulateFrame(memoryStates);
+        for (auto &state : memoryStates) {
+            if (state.lastWrite.has_value())
+                state.lastWrite->pass = previousFrame;
+            for (auto &read : state.readsSinceLastWrite)
+                read.pass = previousFrame;
+        }
+        this->simulateFrame(memoryStates);
+
+        this->isCompiled = true;
+    }
+
+    // Render passes only depend on formats, so unlike targets, they stay the same for as long as the graph exists
+    void createRenderPasses(VkDevice device)
+    {
+        if (!this->isCompiled)
+            throw std::runtime_error("Render graphs must be compiled before creating their render passes");
+
+        for (auto &renderPass : this->steps) {
+            if (!renderPass.isRenderPass)
+                continue;
+
+            std::vector<VkAttachmentDescription> attachmentDescriptions;
+            for (const auto &renderPassAttachment : renderPass.attachments) {
+                VkFormat format = this->resources.at(renderPassAttachment.resource).format;
+                bool hasStencil = getFormatAspectMask(format) & VK_IMAGE_ASPECT_STENCIL_BIT;
+
+                VkAttachmentDescription attachmentDescription = {};
+                attachmentDescription.format = format;
+                attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+                attachmentDescription.loadOp = renderPassAttachment.loadOp;
+                attachmentDescription.storeOp = renderPassAttachment.storeOp;
+                attachmentDescription.stencilLoadOp = hasStencil ? renderPassAttachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                attachmentDescription.stencilStoreOp = hasStencil ? renderPassAttachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachmentDescription.initialLayout = renderPassAttachment.initialLayout;
+                attachmentDescription.finalLayout = renderPassAttachment.finalLayout;
+                attachmentDescriptions.push_back(attachmentDescription);
+            }
+
+            // Which attachments each subpass uses and how, and which ones it has to preserve for a later subpass without using them itself
+            std::size_t subpassCount = renderPass.passes.size();
+            std::vector<std::vector<VkAttachmentReference>> colorReferences(subpassCount), inputReferences(subpassCount);
+            std::vector<std::optional<VkAttachmentReference>> depthStencilReferences(subpassCount);
+            std::vector<std::vector<std::uint32_t>> preservedAttachments(subpassCount);
+            for (std::uint32_t attachmentIndex = 0; attachmentIndex < renderPass.attachments.size(); ++attachmentIndex) {
+                std::vector<bool> isUsedBySubpass(subpassCount);
+                for (std::uint32_t subpass = 0; subpass < subpassCount; ++subpass)
+                    for (const auto &use : this->getPass(renderPass.passes.at(subpass)).uses) {
+                        if (use.resource != renderPass.attachments.at(attachmentIndex).resource)
+                            continue;
+
+                        VkAttachmentReference reference = { attachmentIndex, use.layout };
+                        if (use.usage == renderGraphUsage::colorAttachment)
+                            colorReferences.at(subpass).push_back(reference);
+                        else if (use.usage == renderGraphUsage::depthAttachment)
+                            depthStencilReferences.at(subpass) = reference;
+                        else if (use.usage == renderGraphUsage::inputAttachment)
+                            inputReferences.at(subpass).push_back(reference);
+                        isUsedBySubpass.at(subpass) = true;
+                    }
+
+                auto firstUse = std::find(isUsedBySubpass.begin(), isUsedBySubpass.end(), true) - isUsedBySubpass.begin();
+                auto lastUse = isUsedBySubpass.rend() - std::find(isUsedBySubpass.rbegin(), isUsedBySubpass.rend(), true) - 1;
+                for (auto subpass = firstUse + 1; subpass < lastUse; ++subpass)
+                    if (!isUsedBySubpass.at(subpass))
+                        preservedAttachments.at(subpass).push_back(attachmentIndex);
+            }
+
+            std::vector<VkSubpassDescription> subpassDescriptions(subpassCount);
+            for (std::size_t subpass = 0; subpass < subpassCount; ++subpass) {
+                auto &subpassDescription = subpassDescriptions.at(subpass);
+                subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+                subpassDescription.colorAttachmentCount = static_cast<std::uint32_t>(colorReferences.at(subpass).size());
+                subpassDescription.pColorAttachments = colorReferences.at(subpass).data();
+                subpassDescription.inputAttachmentCount = static_cast<std::uint32_t>(inputReferences.at(subpass).size());
+                subpassDescription.pInputAttachments = inputReferences.at(subpass).data();
+                subpassDescription.pDepthStencilAttachment = depthStencilReferences.at(subpass).has_value() ? &depthStencilReferences.at(subpass).value() : nullptr;
+                subpassDescription.preserveAttachmentCount = static_cast<std::uint32_t>(preservedAttachments.at(subpass).size());
+                subpassDescription.pPreserveAttachments = preservedAttachments.at(subpass).data();
+            }
+
+            VkRenderPassCreateInfo renderPassCreateInfo = {};
+            renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            renderPassCreateInfo.attachmentCount = static_cast<std::uint32_t>(attachmentDescriptions.size());
+            renderPassCreateInfo.pAttachments = attachmentDescriptions.data();
+            renderPassCreateInfo.subpassCount = static_cast<std::uint32_t>(subpassDescriptions.size());
+            renderPassCreateInfo.pSubpasses = subpassDescriptions.data();
+            renderPassCreateInfo.dependencyCount = static_cast<std::uint32_t>(renderPass.dependencies.size());
+            renderPassCreateInfo.pDependencies = renderPass.dependencies.data();
+
+            if (vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPass.renderPass) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create render pass");
+        }
+    }
+
+    void destroyRenderPasses(VkDevice device)
+    {
+        for (auto &renderPass : this->steps) {
+            vkDestroyRenderPass(device, renderPass.renderPass, nullptr);
+            renderPass.renderPass = VK_NULL_HANDLE;
+        }
+    }
+
+    // Which render pass and subpass a graphics pass ends up in, which its pipelines (and secondary command buffers) have to know
+    VkRenderPass getRenderPass(passId id) const
+    {
+        return this->steps.at(this->getPass(id).step).renderPass;
+    }
+
+    std::uint32_t getSubpass(passId id) const
+    {
+        return this->getPass(id).subpass;
+    }
+
+    // Every imported image must be given the same number of images, which execute then gets an index into
+    void bindImportedImages(resourceId id, std::vector<VkImage> images, std::vector<VkImageView> imageViews)
+    {
+        this->resources.at(id).importedImages = std::move(images);
+        this->resources.at(id).importedImageViews = std::move(imageViews);
+    }
+
+    void bindImportedBuffer(resourceId id, VkBuffer buffer)
+    {
+        this->resources.at(id).importedBuffer = buffer;
+    }
+
+    // Creates the transient images and framebuffers, for the imported images bound at the time
+    void createTargets(VkDevice device, gpuMemoryAllocator &allocator, VkExtent2D extent)
+    {
+        auto &newTargets = this->currentTargets;
+        newTargets.extent = extent;
+
+        std::vector<std::vector<resourceId>> transientImagesByMemory(this->memoryCount);
+        for (resourceId id = 0; id < this->resources.size(); ++id) {
+            auto &resource = this->resources.at(id);
+            if (!resource.isTransient || !resource.isUsed)
+                continue;
+
+            VkImageCreateInfo imageCreateInfo = {};
+            imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageCreateInfo.format = resource.format;
+            imageCreateInfo.extent = { extent.width, extent.height, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageCreateInfo.usage = resource.imageUsage;
+            imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            resource.targetImage = newTargets.images.size();
+            newTargets.images.emplace_back();
+            if (vkCreateImage(device, &imageCreateInfo, nullptr, &newTargets.images.back()) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transient image '" + resource.name + "'");
+            transientImagesByMemory.at(resource.memory).push_back(id);
+        }
+
+        // Images sharing memory get a single allocation that's big enough for each of them, which needs a memory type they can all live in (should they not have one, which no GPU we know of does, they get split up and just don't alias)
+        for (const auto &imagesSharingMemory : transientImagesByMemory) {
+            std::vector<std::pair<VkMemoryRequirements, std::vector<resourceId>>> allocations;
+            for (auto id : imagesSharingMemory) {
+                VkMemoryRequirements memoryRequirements;
+                vkGetImageMemoryRequirements(device, newTargets.images.at(this->resources.at(id).targetImage), &memoryRequirements);
+                newTargets.unaliasedMemorySize += memoryRequirements.size;
+
+                auto it = std::find_if(allocations.begin(), allocations.end(), [&](const auto &allocation) { return (allocation.first.memoryTypeBits & memoryRequirements.memoryTypeBits) != 0; });
+                if (it == allocations.end()) {
+                    allocations.emplace_back(memoryRequirements, std::vector<resourceId> { id });
+                    continue;
+                }
+                it->first.size = std::max(it->first.size, memoryRequirements.size);
+                it->first.alignment = std::max(it->first.alignment, memoryRequirements.alignment);
+                it->first.memoryTypeBits &= memoryRequirements.memoryTypeBits;
+                it->second.push_back(id);
+            }
+
+            for (const auto &[memoryRequirements, ids] : allocations) {
+                VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+                bool isLazilyAllocated = this->resources.at(ids.front()).isLazilyAllocated && allocator.hasMemoryType(memoryRequirements.memoryTypeBits, memoryProperties);
+                if (!isLazilyAllocated)
+                    memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                newTargets.allocations.push_back(allocator.allocate(memoryRequirements, memoryProperties, gpuResourceKind::optimalImage));
+                newTargets.memorySize += isLazilyAllocated ? 0 : memoryRequirements.size;
+                for (auto id : ids)
+                    vkBindImageMemory(device, newTargets.images.at(this->resources.at(id).targetImage), newTargets.allocations.back().memory, newTargets.allocations.back().offset);
+            }
+        }
+
+        for (const auto &resource : this->resources) {
+            if (!resource.isTransient || !resource.isUsed)
+                continue;
+
+            VkImageViewCreateInfo imageViewCreateInfo = {};
+            imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            imageViewCreateInfo.image = newTargets.images.at(resource.targetImage);
+            imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            imageViewCreateInfo.format = resource.format;
+            imageViewCreateInfo.subresourceRange = { getFormatAspectMask(resource.format), 0, 1, 0, 1 };
+
+            newTargets.imageViews.emplace_back();
+            if (vkCreateImageView(device, &imageViewCreateInfo, nullptr, &newTargets.imageViews.back()) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transient image view for '" + resource.name + "'");
+        }
+
+        std::size_t importedImageCount = 0;
+        for (const auto &resource : this->resources)
+            if (resource.isImage && !resource.isTransient && resource.isUsed) {
+                if (importedImageCount != 0 && resource.importedImageViews.size() != importedImageCount)
+                    throw std::runtime_error("Every imported image of a render graph must be bound to the same number of images");
+                importedImageCount = resource.importedImageViews.size();
+            }
+        importedImageCount = std::max<std::size_t>(importedImageCount, 1);
+
+        for (auto &renderPass : this->steps) {
+            if (!renderPass.isRenderPass)
+                continue;
+
+            renderPass.firstFramebuffer = newTargets.framebuffers.size();
+            for (std::size_t importedImageIndex = 0; importedImageIndex < importedImageCount; ++importedImageIndex) {
+                std::vector<VkImageView> attachmentViews;
+                for (const auto &renderPassAttachment : renderPass.attachments) {
+                    const auto &resource = this->resources.at(renderPassAttachment.resource);
+                    attachmentViews.push_back(resource.isTransient ? newTargets.imageViews.at(resource.targetImage) : resource.importedImageViews.at(importedImageIndex));
+                }
+
+                VkFramebufferCreateInfo framebufferCreateInfo = {};
+                framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+                framebufferCreateInfo.renderPass = renderPass.renderPass;
+                framebufferCreateInfo.attachmentCount = static_cast<std::uint32_t>(attachmentViews.size());
+                framebufferCreateInfo.pAttachments = attachmentViews.data();
+                framebufferCreateInfo.width = extent.width;
+                framebufferCreateInfo.height = extent.height;
+                framebufferCreateInfo.layers = 1;
+
+                newTargets.framebuffers.emplace_back();
+                if (vkCreateFramebuffer(device, &framebufferCreateInfo, nullptr, &newTargets.framebuffers.back()) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create framebuffer");
+            }
+        }
+    }
+
+    // Hands the targets over to whoever knows when the GPU is done with them (see targets::destroy), leaving the graph without any until the next createTargets
+    targets releaseTargets()
+    {
+        targets result = std::move(this->currentTargets);
+        this->currentTargets = {};
+        return result;
+    }
+
+    // Records the whole frame, for the given imported image index
+    void execute(VkCommandBuffer commandBuffer, std::uint32_t importedImageIndex) const
+    {
+        for (const auto &currentStep : this->steps) {
+            this->recordBarriers(commandBuffer, currentStep.barriers, importedImageIndex);
+            if (!currentStep.isRenderPass) {
+                this->getPass(currentStep.passes.front()).record(commandBuffer);
+                continue;
+            }
+
+            VkRenderPassBeginInfo renderPassBeginInfo = {};
+            renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassBeginInfo.renderPass = currentStep.renderPass;
+            renderPassBeginInfo.framebuffer = this->currentTargets.framebuffers.at(currentStep.firstFramebuffer + importedImageIndex);
+            renderPassBeginInfo.renderArea.extent = this->currentTargets.extent;
+            renderPassBeginInfo.clearValueCount = static_cast<std::uint32_t>(currentStep.clearValues.size());
+            renderPassBeginInfo.pClearValues = currentStep.clearValues.data();
+
+            for (std::size_t subpass = 0; subpass < currentStep.passes.size(); ++subpass) {
+                const auto &currentPass = this->getPass(currentStep.passes.at(subpass));
+                if (subpass == 0)
+                    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, currentPass.contents);
+                else
+                    vkCmdNextSubpass(commandBuffer, currentPass.contents);
+                currentPass.record(commandBuffer);
+            }
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        this->recordBarriers(commandBuffer, this->finalBarriers, importedImageIndex);
+    }
+
+    // Compiles a small graph of transient images that needs everything compile does for them (merging passes into subpasses, aliasing memory and lazy allocation), and throws if any of it doesn't come out the way it should
+    // The frame we render doesn't have any transient images, so this is what keeps those paths honest, and it's all CPU work that doesn't need a device
+    static void checkCompilation()
+    {
+        renderGraph graph;
+        auto output = graph.importImage("output", VK_FORMAT_R8G8B8A8_UNORM, renderGraphUsage::transferSource);
+        std::array<resourceId, 4> images;
+        for (std::size_t i = 0; i < images.size(); ++i)
+            images.at(i) = graph.createTransientImage("image " + std::to_string(i), VK_FORMAT_R8G8B8A8_UNORM);
+
+        // Every filter samples what the pass before it wrote, which keeps it out of that pass's render pass, while the resolve only reads its input at the same pixel and so becomes a subpass of the last filter's render pass
+        auto recordNothing = [](VkCommandBuffer) {};
+        auto fillPass = graph.addPass("fill", renderGraphPassKind::graphics, recordNothing);
+        graph.use(fillPass, images.at(0), renderGraphUsage::colorAttachment, VkClearValue {});
+        for (std::size_t i = 1; i < images.size(); ++i) {
+            auto filterPass = graph.addPass("filter " + std::to_string(i), renderGraphPassKind::graphics, recordNothing);
+            graph.use(filterPass, images.at(i - 1), renderGraphUsage::sampledImage);
+            graph.use(filterPass, images.at(i), renderGraphUsage::colorAttachment);
+        }
+        auto resolvePass = graph.addPass("resolve", renderGraphPassKind::graphics, recordNothing);
+        graph.use(resolvePass, images.back(), renderGraphUsage::inputAttachment);
+        graph.use(resolvePass, output, renderGraphUsage::colorAttachment);
+        graph.compile();
+
+        // Image 0 (steps 0 to 1) is gone by the time image 2 (steps 2 to 3) is needed, while image 1 (steps 1 to 2) overlaps both, and image 3 never leaves the last render pass
+        const auto &resources = graph.resources;
+        if (graph.steps.size() != 4 || graph.getPass(resolvePass).step != 3 || graph.getPass(resolvePass).subpass != 1)
+            throw std::runtime_error("Render graph check failed: the resolve pass didn't become a subpass of the render pass before it");
+        if (resources.at(images.at(2)).memory != resources.at(images.at(0)).memory || resources.at(images.at(1)).memory == resources.at(images.at(0)).memory)
+            throw std::runtime_error("Render graph check failed: transient images don't share memory exactly when their lifetimes don't overlap");
+        if (!resources.at(images.at(3)).isLazilyAllocated || resources.at(images.at(0)).isLazilyAllocated)
+            throw std::runtime_error("Render graph check failed: transient images aren't lazily allocated exactly when they only live inside a single render pass");
+    }
+
+    void printSummary(std::ostream &stream) const
+    {
+        std::size_t barrierCount = this->finalBarriers.size(), dependencyCount = 0, culledPassCount = 0;
+        for (const auto &currentStep : this->steps) {
+            barrierCount += currentStep.barriers.size();
+            dependencyCount += currentStep.dependencies.size();
+        }
+        for (const auto &currentPass : this->passes)
+            culledPassCount += currentPass.isCulled;
+
+        stream << "Render graph: " << this->passes.size() << " passes (" << culledPassCount << " culled) in " << this->steps.size() << " steps, " << barrierCount << " barriers and " << dependencyCount << " subpass dependencies\n";
+        for (const auto &currentStep : this->steps) {
+            stream << '\t' << (currentStep.isRenderPass ? "render pass " : "");
+            for (std::size_t i = 0; i < currentStep.passes.size(); ++i)
+                stream << (i == 0 ? "" : " + ") << this->getPass(currentStep.passes.at(i)).name;
+            stream << " (" << currentStep.barriers.size() << " barriers before";
+            if (currentStep.isRenderPass)
+                stream << ", " << currentStep.attachments.size() << " attachments, " << currentStep.dependencies.size() << " dependencies";
+            stream << ")\n";
+        }
+        if (!this->currentTargets.images.empty())
+            stream << "\ttransient images: " << std::fixed << std::setprecision(1) << this->currentTargets.memorySize / 1048576. << "MB (" << this->currentTargets.unaliasedMemorySize / 1048576. << "MB without aliasing)\n";
+    }
+};
@@ -0,0 +1,99 @@
+// Micro-benchmark for the scene update kernels (see sceneUpdate.hpp): runs every kernel of every level this CPU supports over the same scene, checks they agree with the scalar ones, and reports how many objects each gets through per nanosecond
+// Usage: scene-benchmark [object count] (default 1M, which is well past the caches, as it would be for a real scene)
+
+#include "sceneUpdate.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+
+namespace {
+
+// Same layout as makeInstanceGrid, so that the visible fraction is easy to reason about: with the view zoomed in 2x, a quarter of the grid (plus the objects straddling the edges) is visible
+sceneObjects makeBenchmarkScene(std::size_t objectCount)
+{
+    sceneObjects result;
+    result.resize(objectCount);
+
+    auto objectsPerSide = static_cast<std::size_t>(std::ceil(std::sqrt(double(objectCount))));
+    float cellSize = 2.f / objectsPerSide;
+    for (std::size_t i = 0; i < objectCount; ++i) {
+        result.positionX[i] = -1.f + (i % objectsPerSide + .5f) * cellSize;
+        result.positionY[i] = -1.f + (i / objectsPerSide + .5f) * cellSize;
+
+        float angle = static_cast<float>(i % 360) * .0174532925f, scale = cellSize * .5f;
+        result.matrix00[i] = std::cos(angle) * scale;
+        result.matrix10[i] = std::sin(angle) * scale;
+        result.matrix01[i] = -std::sin(angle) * scale;
+        result.matrix11[i] = std::cos(angle) * scale;
+        result.boundingRadius[i] = 1.f;
+    }
+
+    return result;
+}
+
+// Best of a few runs, as the first one also pays for page faults and the odd one gets interrupted
+template <typename F>
+double measureObjectsPerNanosecond(std::size_t objectCount, F &&kernel)
+{
+    constexpr std::uint32_t runCount = 20;
+    double bestSeconds = HUGE_VAL;
+    for (std::uint32_t run = 0; run < runCount; ++run) {
+        auto startTime = std::chrono::steady_clock::now();
+        kernel();
+        std::chrono::duration<double> elapsedTime = std::chrono::steady_clock::now() - startTime;
+        bestSeconds = std::min(bestSeconds, elapsedTime.count());
+    }
+    return objectCount / (bestSeconds * 1e9);
+}
+
+void runSceneBenchmark(std::size_t objectCount)
+{
+    sceneView view;
+    view.matrix = { { 2, 0, 0, 2 } };
+
+    // What every other level must match (exactly, as they all do the same operations in the same order, just several at a time)
+    sceneObjects reference = makeBenchmarkScene(objectCount);
+    composeSceneTransformsScalar(view, reference, 0, objectCount);
+    std::size_t referenceVisibleCount = cullSceneScalar(view, reference, 0, objectCount);
+
+    std::cout << "Scene update of " << objectCount << " objects (" << referenceVisibleCount << " visible), best of 20 runs:\n";
+    for (std::size_t levelIndex = 0; levelIndex < static_cast<std::size_t>(simdLevel::count); ++levelIndex) {
+        auto level = static_cast<simdLevel>(levelIndex);
+        if (!isSimdLevelSupported(level))
+            continue;
+
+        auto kernels = getSceneKernels(level);
+        sceneObjects objects = makeBenchmarkScene(objectCount);
+        std::size_t visibleCount = 0;
+        double composeThroughput = measureObjectsPerNanosecond(objectCount, [&]() { kernels.composeTransforms(view, objects, 0, objectCount); });
+        double cullThroughput = measureObjectsPerNanosecond(objectCount, [&]() { visibleCount = kernels.cull(view, objects, 0, objectCount); });
+
+        if (visibleCount != referenceVisibleCount || objects.worldMatrix00 != reference.worldMatrix00 || objects.worldPositionX != reference.worldPositionX || objects.visibility != reference.visibility)
+            throw std::runtime_error(std::string("The ") + getSimdLevelName(level) + " scene kernels don't agree with the scalar ones");
+
+        std::cout << "\t" << std::left << std::setw(8) << getSimdLevelName(level) << std::right << std::fixed << std::setprecision(3)
+                  << "compose " << composeThroughput << " objects/ns, cull " << cullThroughput << " objects/ns"
+                  << (level == getBestSimdLevel() ? " (picked at runtime)" : "") << '\n';
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    try {
+        runSceneBenchmark(argc > 1 ? std::stoul(argv[1]) : 1 << 20);
+    } catch (const std::exception &exception) {
+        std::cerr << "Error (stdexcept): " << exception.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// CPU-side scene update: composing every object's local transform with the view's, then testing its bounding circle against the view's planes
+// Everything is stored as one array per component (SoA) so that the kernels can load 4 or 8 objects' worth of a component in one go, and each kernel exists in a scalar version plus one per instruction set we care about, picked at runtime (see getSceneKernels)
+
+// Which set of kernels to use, from the plainest to the widest
+enum class simdLevel : std::size_t {
+    scalar,
+    sse4, // 4 floats at a time
+    avx2, // 8 floats at a time
+    neon, // 4 floats at a time, on 64-bit ARM (where it's always there)
+    count, // Not an actual level, just how many of them there are
+};
+
+inline const char *getSimdLevelName(simdLevel level)
+{
+    static constexpr std::array<const char *, static_cast<std::size_t>(simdLevel::count)> names = { { "scalar", "sse4", "avx2", "neon" } };
+    return names.at(static_cast<std::size_t>(level));
+}
+
+struct sceneObjects {
+    // Where each object is, and its 2x2 matrix (rotation and scale), column-major like instanceData's transforms
+    std::vector<float> positionX, positionY;
+    std::vector<float> matrix00, matrix10, matrix01, matrix11;
+    std::vector<float> boundingRadius; // Around the object's position, before its matrix scales it
+
+    // What the kernels produce: the same thing once the view's transform is applied, and whether each object ended up in view
+    std::vector<float> worldPositionX, worldPositionY;
+    std::vector<float> worldMatrix00, worldMatrix10, worldMatrix01, worldMatrix11;
+    std::vector<std::uint8_t> visibility; // One bit per object (object i is bit i % 8 of byte i / 8), so that 8 objects' results come out of a single AVX2 compare
+
+    std::size_t size() const
+    {
+        return this->positionX.size();
+    }
+
+    void resize(std::size_t count)
+    {
+        for (auto *component : { &this->positionX, &this->positionY, &this->matrix00, &this->matrix10, &this->matrix01, &this->matrix11, &this->boundingRadius, &this->worldPositionX, &this->worldPositionY, &this->worldMatrix00, &this->worldMatrix10, &this->worldMatrix01, &this->worldMatrix11 })
+            component->resize(count);
+        this->visibility.resize((count + 7) / 8);
+    }
+
+    bool isVisible(std::size_t index) const
+    {
+        return (this->visibility.at(index / 8) >> (index % 8)) & 1;
+    }
+};
+
+// The transform applied on top of every object's own, plus the planes (well, lines, since we're in 2D) bounding what's in view
+struct sceneView {
+    std::array<float, 4> matrix = { { 1, 0, 0, 1 } }; // Column-major, like the objects'
+    std::array<float, 2> translation = { { 0, 0 } };
+    // A point is on the inside of a plane when normalX * x + normalY * y + distance >= 0, and the default is the [-1, 1] square that ends up on screen
+    std::array<std::array<float, 3>, 4> planes = { {
+        { { 1, 0, 1 } },
+        { { -1, 0, 1 } },
+        { { 0, 1, 1 } },
+        { { 0, -1, 1 } },
+    } };
+};
+
+// Both kernels work on the objects in [first, last), so that the work can be split between threads, in which case every range except the last must start and end on a multiple of 8 (since 8 objects share each visibility byte)
+struct sceneKernels {
+    void (*composeTransforms)(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last);
+    std::size_t (*cull)(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last); // Returns how many objects are visible, and needs composeTransforms to have run first
+};
+
+inline void composeSceneTransformsScalar(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    const auto &v = view.matrix;
+    for (std::size_t i = first; i < last; ++i) {
+        float x = objects.positionX[i], y = objects.positionY[i];
+        objects.worldPositionX[i] = v[0] * x + v[2] * y + view.translation[0];
+        objects.worldPositionY[i] = v[1] * x + v[3] * y + view.translation[1];
+
+        float m00 = objects.matrix00[i], m10 = objects.matrix10[i], m01 = objects.matrix01[i], m11 = objects.matrix11[i];
+        objects.worldMatrix00[i] = v[0] * m00 + v[2] * m10;
+        objects.worldMatrix10[i] = v[1] * m00 + v[3] * m10;
+        objects.worldMatrix01[i] = v[0] * m01 + v[2] * m11;
+        objects.worldMatrix11[i] = v[1] * m01 + v[3] * m11;
+    }
+}
+
+inline std::size_t cullSceneScalar(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    std::size_t visibleCount = 0;
+    for (std::size_t i = first; i < last; ++i) {
+        float x = objects.worldPositionX[i], y = objects.worldPositionY[i];
+        float m00 = objects.worldMatrix00[i], m10 = objects.worldMatrix10[i], m01 = objects.worldMatrix01[i], m11 = objects.worldMatrix11[i];
+
+        // The matrix can stretch the circle into an ellipse, so we use its longest axis, which is at most as long as its longest column
+        float radius = objects.boundingRadius[i] * std::sqrt(std::max(m00 * m00 + m10 * m10, m01 * m01 + m11 * m11));
+
+        bool isVisible = true;
+        for (const auto &plane : view.planes)
+            isVisible &= plane[0] * x + plane[1] * y + plane[2] + radius >= 0;
+
+        auto bit = static_cast<std::uint8_t>(1u << (i % 8));
+        objects.visibility[i / 8] = isVisible ? objects.visibility[i / 8] | bit : objects.visibility[i / 8] & ~bit;
+        visibleCount += isVisible;
+    }
+    return visibleCount;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.1"))) inline void composeSceneTransformsSse4(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    __m128 v00 = _mm_set1_ps(view.matrix[0]), v10 = _mm_set1_ps(view.matrix[1]), v01 = _mm_set1_ps(view.matrix[2]), v11 = _mm_set1_ps(view.matrix[3]);
+    __m128 tx = _mm_set1_ps(view.translation[0]), ty = _mm_set1_ps(view.translation[1]);
+
+    std::size_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        __m128 x = _mm_loadu_ps(objects.positionX.data() + i), y = _mm_loadu_ps(objects.positionY.data() + i);
+        _mm_storeu_ps(objects.worldPositionX.data() + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(v00, x), _mm_mul_ps(v01, y)), tx));
+        _mm_storeu_ps(objects.worldPositionY.data() + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(v10, x), _mm_mul_ps(v11, y)), ty));
+
+        __m128 m00 = _mm_loadu_ps(objects.matrix00.data() + i), m10 = _mm_loadu_ps(objects.matrix10.data() + i);
+        __m128 m01 = _mm_loadu_ps(objects.matrix01.data() + i), m11 = _mm_loadu_ps(objects.matrix11.data() + i);
+        _mm_storeu_ps(objects.worldMatrix00.data() + i, _mm_add_ps(_mm_mul_ps(v00, m00), _mm_mul_ps(v01, m10)));
+        _mm_storeu_ps(objects.worldMatrix10.data() + i, _mm_add_ps(_mm_mul_ps(v10, m00), _mm_mul_ps(v11, m10)));
+        _mm_storeu_ps(objects.worldMatrix01.data() + i, _mm_add_ps(_mm_mul_ps(v00, m01), _mm_mul_ps(v01, m11)));
+        _mm_storeu_ps(objects.worldMatrix11.data() + i, _mm_add_ps(_mm_mul_ps(v10, m01), _mm_mul_ps(v11, m11)));
+    }
+    composeSceneTransformsScalar(view, objects, i, last);
+}
+
+// Returns a 4-bit mask of which of the 4 objects starting at i are visible
+__attribute__((target("sse4.1"))) inline int cullSceneSse4Group(const __m128 (&planes)[4][3], const sceneObjects &objects, std::size_t i)
+{
+    __m128 x = _mm_loadu_ps(objects.worldPositionX.data() + i), y = _mm_loadu_ps(objects.worldPositionY.data() + i);
+    __m128 m00 = _mm_loadu_ps(objects.worldMatrix00.data() + i), m10 = _mm_loadu_ps(objects.worldMatrix10.data() + i);
+    __m128 m01 = _mm_loadu_ps(objects.worldMatrix01.data() + i), m11 = _mm_loadu_ps(objects.worldMatrix11.data() + i);
+
+    __m128 scaleSquared = _mm_max_ps(_mm_add_ps(_mm_mul_ps(m00, m00), _mm_mul_ps(m10, m10)), _mm_add_ps(_mm_mul_ps(m01, m01), _mm_mul_ps(m11, m11)));
+    __m128 radius = _mm_mul_ps(_mm_loadu_ps(objects.boundingRadius.data() + i), _mm_sqrt_ps(scaleSquared));
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : planes) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[0], x), _mm_mul_ps(plane[1], y)), plane[2]), radius);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    return _mm_movemask_ps(inside);
+}
+
+__attribute__((target("sse4.1,popcnt"))) inline std::size_t cullSceneSse4(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    __m128 planes[4][3]; // Broadcast once up front (and a plain array, since std::array drops the vector types' alignment attributes)
+    for (std::size_t p = 0; p < 4; ++p)
+        for (std::size_t c = 0; c < 3; ++c)
+            planes[p][c] = _mm_set1_ps(view.planes[p][c]);
+
+    std::size_t visibleCount = 0;
+    std::size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        int mask = cullSceneSse4Group(planes, objects, i) | (cullSceneSse4Group(planes, objects, i + 4) << 4);
+        objects.visibility[i / 8] = static_cast<std::uint8_t>(mask);
+        visibleCount += _mm_popcnt_u32(static_cast<unsigned int>(mask));
+    }
+    return visibleCount + cullSceneScalar(view, objects, i, last);
+}
+
+__attribute__((target("avx2"))) inline void composeSceneTransformsAvx2(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    __m256 v00 = _mm256_set1_ps(view.matrix[0]), v10 = _mm256_set1_ps(view.matrix[1]), v01 = _mm256_set1_ps(view.matrix[2]), v11 = _mm256_set1_ps(view.matrix[3]);
+    __m256 tx = _mm256_set1_ps(view.translation[0]), ty = _mm256_set1_ps(view.translation[1]);
+
+    std::size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m256 x = _mm256_loadu_ps(objects.positionX.data() + i), y = _mm256_loadu_ps(objects.positionY.data() + i);
+        _mm256_storeu_ps(objects.worldPositionX.data() + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v00, x), _mm256_mul_ps(v01, y)), tx));
+        _mm256_storeu_ps(objects.worldPositionY.data() + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v10, x), _mm256_mul_ps(v11, y)), ty));
+
+        __m256 m00 = _mm256_loadu_ps(objects.matrix00.data() + i), m10 = _mm256_loadu_ps(objects.matrix10.data() + i);
+        __m256 m01 = _mm256_loadu_ps(objects.matrix01.data() + i), m11 = _mm256_loadu_ps(objects.matrix11.data() + i);
+        _mm256_storeu_ps(objects.worldMatrix00.data() + i, _mm256_add_ps(_mm256_mul_ps(v00, m00), _mm256_mul_ps(v01, m10)));
+        _mm256_storeu_ps(objects.worldMatrix10.data() + i, _mm256_add_ps(_mm256_mul_ps(v10, m00), _mm256_mul_ps(v11, m10)));
+        _mm256_storeu_ps(objects.worldMatrix01.data() + i, _mm256_add_ps(_mm256_mul_ps(v00, m01), _mm256_mul_ps(v01, m11)));
+        _mm256_storeu_ps(objects.worldMatrix11.data() + i, _mm256_add_ps(_mm256_mul_ps(v10, m01), _mm256_mul_ps(v11, m11)));
+    }
+    composeSceneTransformsScalar(view, objects, i, last);
+}
+
+__attribute__((target("avx2,popcnt"))) inline std::size_t cullSceneAvx2(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    __m256 planes[4][3];
+    for (std::size_t p = 0; p < 4; ++p)
+        for (std::size_t c = 0; c < 3; ++c)
+            planes[p][c] = _mm256_set1_ps(view.planes[p][c]);
+
+    std::size_t visibleCount = 0;
+    std::size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m256 x = _mm256_loadu_ps(objects.worldPositionX.data() + i), y = _mm256_loadu_ps(objects.worldPositionY.data() + i);
+        __m256 m00 = _mm256_loadu_ps(objects.worldMatrix00.data() + i), m10 = _mm256_loadu_ps(objects.worldMatrix10.data() + i);
+        __m256 m01 = _mm256_loadu_ps(objects.worldMatrix01.data() + i), m11 = _mm256_loadu_ps(objects.worldMatrix11.data() + i);
+
+        __m256 scaleSquared = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(m00, m00), _mm256_mul_ps(m10, m10)), _mm256_add_ps(_mm256_mul_ps(m01, m01), _mm256_mul_ps(m11, m11)));
+        __m256 radius = _mm256_mul_ps(_mm256_loadu_ps(objects.boundingRadius.data() + i), _mm256_sqrt_ps(scaleSquared));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const auto &plane : planes) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[0], x), _mm256_mul_ps(plane[1], y)), plane[2]), radius);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        objects.visibility[i / 8] = static_cast<std::uint8_t>(mask);
+        visibleCount += _mm_popcnt_u32(static_cast<unsigned int>(mask));
+    }
+    return visibleCount + cullSceneScalar(view, objects, i, last);
+}
+
+#elif defined(__aarch64__)
+
+inline void composeSceneTransformsNeon(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    float32x4_t v00 = vdupq_n_f32(view.matrix[0]), v10 = vdupq_n_f32(view.matrix[1]), v01 = vdupq_n_f32(view.matrix[2]), v11 = vdupq_n_f32(view.matrix[3]);
+    float32x4_t tx = vdupq_n_f32(view.translation[0]), ty = vdupq_n_f32(view.translation[1]);
+
+    std::size_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        float32x4_t x = vld1q_f32(objects.positionX.data() + i), y = vld1q_f32(objects.positionY.data() + i);
+        vst1q_f32(objects.worldPositionX.data() + i, vaddq_f32(vaddq_f32(vmulq_f32(v00, x), vmulq_f32(v01, y)), tx));
+        vst1q_f32(objects.worldPositionY.data() + i, vaddq_f32(vaddq_f32(vmulq_f32(v10, x), vmulq_f32(v11, y)), ty));
+
+        float32x4_t m00 = vld1q_f32(objects.matrix00.data() + i), m10 = vld1q_f32(objects.matrix10.data() + i);
+        float32x4_t m01 = vld1q_f32(objects.matrix01.data() + i), m11 = vld1q_f32(objects.matrix11.data() + i);
+        vst1q_f32(objects.worldMatrix00.data() + i, vaddq_f32(vmulq_f32(v00, m00), vmulq_f32(v01, m10)));
+        vst1q_f32(objects.worldMatrix10.data() + i, vaddq_f32(vmulq_f32(v10, m00), vmulq_f32(v11, m10)));
+        vst1q_f32(objects.worldMatrix01.data() + i, vaddq_f32(vmulq_f32(v00, m01), vmulq_f32(v01, m11)));
+        vst1q_f32(objects.worldMatrix11.data() + i, vaddq_f32(vmulq_f32(v10, m01), vmulq_f32(v11, m11)));
+    }
+    composeSceneTransformsScalar(view, objects, i, last);
+}
+
+// Returns a 4-bit mask of which of the 4 objects starting at i are visible
+inline std::uint32_t cullSceneNeonGroup(const float32x4_t (&planes)[4][3], const sceneObjects &objects, std::size_t i)
+{
+    float32x4_t x = vld1q_f32(objects.worldPositionX.data() + i), y = vld1q_f32(objects.worldPositionY.data() + i);
+    float32x4_t m00 = vld1q_f32(objects.worldMatrix00.data() + i), m10 = vld1q_f32(objects.worldMatrix10.data() + i);
+    float32x4_t m01 = vld1q_f32(objects.worldMatrix01.data() + i), m11 = vld1q_f32(objects.worldMatrix11.data() + i);
+
+    float32x4_t scaleSquared = vmaxq_f32(vaddq_f32(vmulq_f32(m00, m00), vmulq_f32(m10, m10)), vaddq_f32(vmulq_f32(m01, m01), vmulq_f32(m11, m11)));
+    float32x4_t radius = vmulq_f32(vld1q_f32(objects.boundingRadius.data() + i), vsqrtq_f32(scaleSquared));
+
+    uint32x4_t inside = vdupq_n_u32(~0u);
+    for (const auto &plane : planes) {
+        float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(plane[0], x), vmulq_f32(plane[1], y)), plane[2]), radius);
+        inside = vandq_u32(inside, vcgeq_f32(distance, vdupq_n_f32(0)));
+    }
+
+    // NEON has no movemask, so we keep one distinct bit per lane and add them up
+    static const std::uint32_t laneBits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(inside, vld1q_u32(laneBits)));
+}
+
+inline std::size_t cullSceneNeon(const sceneView &view, sceneObjects &objects, std::size_t first, std::size_t last)
+{
+    float32x4_t planes[4][3];
+    for (std::size_t p = 0; p < 4; ++p)
+        for (std::size_t c = 0; c < 3; ++c)
+            planes[p][c] = vdupq_n_f32(view.planes[p][c]);
+
+    std::size_t visibleCount = 0;
+    std::size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        std::uint32_t mask = cullSceneNeonGroup(planes, objects, i) | (cullSceneNeonGroup(planes, objects, i + 4) << 4);
+        objects.visibility[i / 8] = static_cast<std::uint8_t>(mask);
+        visibleCount += __builtin_popcount(mask);
+    }
+    return visibleCount + cullSceneScalar(view, objects, i, last);
+}
+
+#endif
+
+inline bool isSimdLevelSupported(simdLevel level)
+{
+    if (level == simdLevel::scalar)
+        return true;
+#if defined(__x86_64__) || defined(__i386__)
+    if (level == simdLevel::sse4)
+        return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+    if (level == simdLevel::avx2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#elif defined(__aarch64__)
+    if (level == simdLevel::neon)
+        return true;
+#endif
+    return false;
+}
+
+// The widest level this CPU can run
+inline simdLevel getBestSimdLevel()
+{
+    for (auto level : { simdLevel::avx2, simdLevel::neon, simdLevel::sse4 })
+        if (isSimdLevelSupported(level))
+            return level;
+    return simdLevel::scalar;
+}
+
+inline sceneKernels getSceneKernels(simdLevel level)
+{
+    if (!isSimdLevelSupported(level))
+        throw std::runtime_error(std::string("The ") + getSimdLevelName(level) + " scene kernels aren't supported on this CPU");
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (level == simdLevel::sse4)
+        return { composeSceneTransformsSse4, cullSceneSse4 };
+    if (level == simdLevel::avx2)
+        return { composeSceneTransformsAvx2, cullSceneAvx2 };
+#elif defined(__aarch64__)
+    if (level == simdLevel::neon)
+        return { composeSceneTransformsNeon, cullSceneNeon };
+#endif
+    return { composeSceneTransformsScalar, cullSceneScalar };
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "spirvBlob.hpp"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <set>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+
+extern char **environ;
+
+// Watches a directory of GLSL sources and recompiles the ones that change with glslc on a thread of its own, handing the resulting SPIR-V to a callback (on that same thread, so that whatever gets built out of it doesn't hold up the caller either)
+// The SPIR-V is written next to the sources under the same names the Makefile uses, so that a later launch with --shader-dir picks up the latest edits too
+class shaderWatcher {
+public:
+    struct source {
+        std::string sourceFileName; // e.g. shader.frag
+        std::string spirvFileName; // e.g. frag.spv
+    };
+
+    // Called with the SPIR-V file name, its code (only valid for the duration of the call) and when the source was last changed
+    using compiledCallback = std::function<void(const std::string &, spirvCodeView, std::chrono::steady_clock::time_point)>;
+
+private:
+    // Editors tend to save in several steps (truncate then write, or write a temporary file then rename it over the original), so we wait for things to settle before compiling anything
+    static constexpr int settleMilliseconds = 30;
+
+    std::string directory;
+    std::vector<source> sources;
+    compiledCallback onCompiled;
+
+    int inotifyFileDescriptor = -1;
+    int stopFileDescriptor = -1; // An eventfd that wakes the thread up when we want it gone
+
+    std::thread thread;
+
+    // Runs glslc, with its messages going wherever ours go, and returns whether it succeeded
+    bool compile(const source &changedSource)
+    {
+        auto sourcePath = this->directory + '/' + changedSource.sourceFileName;
+        auto spirvPath = this->directory + '/' + changedSource.spirvFileName;
+        auto temporarySpirvPath = spirvPath + ".tmp"; // Renamed over spirvPath once complete, so that nobody ever maps a half-written file
+
+        std::vector<std::string> arguments = { "glslc", sourcePath, "-o", temporarySpirvPath };
+        std::vector<char *> argumentPointers;
+        for (auto &argument : arguments)
+            argumentPointers.push_back(argument.data());
+        argumentPointers.push_back(nullptr);
+
+        pid_t processId;
+        if (posix_spawnp(&processId, "glslc", nullptr, nullptr, argumentPointers.data(), environ) != 0) {
+            std::cerr << "Shader hot reload: failed to run glslc (is it in the PATH?)\n";
+            return false;
+        }
+
+        int status = 0;
+        while (waitpid(processId, &status, 0) < 0)
+            if (errno != EINTR)
+                return false;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::remove(temporarySpirvPath.c_str());
+            return false;
+        }
+
+        return std::rename(temporarySpirvPath.c_str(), spirvPath.c_str()) == 0;
+    }
+
+    void compileAndNotify(const source &changedSource, std::chrono::steady_clock::time_point changeTime)
+    {
+        auto compileStartTime = std::chrono::steady_clock::now();
+        if (!this->compile(changedSource)) {
+            std::cerr << "Shader hot reload: " << changedSource.sourceFileName << " failed to compile, keeping the previous version\n";
+            return;
+        }
+        std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileStartTime;
+        std::cout << "Shader hot reload: compiled " << changedSource.sourceFileName << " in " << compileTime.count() << "ms\n";
+
+        // Whatever goes wrong past this point is about this one version of the shader, which is no reason to stop watching
+        try {
+            spirvBlob blob(this->directory + '/' + changedSource.spirvFileName);
+            this->onCompiled(changedSource.spirvFileName, blob.code(), changeTime);
+        } catch (const std::exception &exception) {
+            std::cerr << "Shader hot reload: " << exception.what() << '\n';
+        }
+    }
+
+    void run()
+    {
+        std::array<pollfd, 2> pollFileDescriptors = { { { this->inotifyFileDescriptor, POLLIN, 0 }, { this->stopFileDescriptor, POLLIN, 0 } } };
+        std::set<std::size_t> changedSourceIndices;
+        std::chrono::steady_clock::time_point changeTime;
+
+        for (;;) {
+            // Block until something happens, or only until things have settled if there are changes waiting to be compiled
+            int result = poll(pollFileDescriptors.data(), pollFileDescriptors.size(), changedSourceIndices.empty() ? -1 : settleMilliseconds);
+            if (result < 0 && errno != EINTR)
+                return;
+            if (pollFileDescriptors.at(1).revents & POLLIN)
+                return;
+
+            if (result > 0 && (pollFileDescriptors.at(0).revents & POLLIN)) {
+                alignas(inotify_event) std::array<char, 4096> buffer;
+                auto length = read(this->inotifyFileDescriptor, buffer.data(), buffer.size());
+                for (ssize_t offset = 0; offset < length;) {
+                    const auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + offset);
+                    offset += sizeof(inotify_event) + event->len;
+                    if (event->len == 0)
+                        continue;
+
+                    for (std::size_t i = 0; i < this->sources.size(); ++i)
+                        if (this->sources.at(i).sourceFileName == event->name) {
+                            if (changedSourceIndices.empty())
+                                changeTime = std::chrono::steady_clock::now();
+                            changedSourceIndices.insert(i);
+                        }
+                }
+                continue; // Start settling over
+            }
+
+            if (result == 0) {
+                for (auto index : changedSourceIndices)
+                    this->compileAndNotify(this->sources.at(index), changeTime);
+                changedSourceIndices.clear();
+            }
+        }
+    }
+
+public:
+    shaderWatcher(std::string directory, std::vector<source> sources, compiledCallback onCompiled)
+        : directory(std::move(directory)), sources(std::move(sources)), onCompiled(std::move(onCompiled))
+    {
+        this->inotifyFileDescriptor = inotify_init1(IN_CLOEXEC);
+        this->stopFileDescriptor = eventfd(0, EFD_CLOEXEC);
+        if (this->inotifyFileDescriptor < 0 || this->stopFileDescriptor < 0) {
+            this->closeFileDescriptors();
+            throw std::runtime_error("Failed to set up shader hot reload");
+        }
+
+        // Watching the directory rather than the files themselves means we still see files that get replaced (which is how many editors save)
+        if (inotify_add_watch(this->inotifyFileDescriptor, this->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            this->closeFileDescriptors();
+            throw std::runtime_error("Failure to watch " + this->directory + " for shader changes");
+        }
+
+        this->thread = std::thread([this]() { this->run(); });
+    }
+
+    // Waits for a compile (and whatever the callback does) that might be going on
+    ~shaderWatcher()
+    {
+        std::uint64_t value = 1;
+        if (write(this->stopFileDescriptor, &value, sizeof(value)) != sizeof(value))
+            std::cerr << "Shader hot reload: failed to signal the watcher thread\n";
+        this->thread.join();
+        this->closeFileDescriptors();
+    }
+
+    shaderWatcher(const shaderWatcher &) = delete;
+    shaderWatcher &operator=(const shaderWatcher &) = delete;
+
+private:
+    void closeFileDescriptors()
+    {
+        if (this->inotifyFileDescriptor >= 0)
+            close(this->inotifyFileDescriptor);
+        if (this->stopFileDescriptor >= 0)
+            close(this->stopFileDescriptor);
+    }
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// A non-owning view of some SPIR-V code, which is what vkCreateShaderModule actually wants (i.e. 32-bit words, with the alignment that implies)
+struct spirvCodeView {
+    const std::uint32_t *words = nullptr;
+    std::size_t wordCount = 0;
+
+    std::size_t sizeInBytes() const
+    {
+        return this->wordCount * sizeof(std::uint32_t);
+    }
+};
+
+// Checks that what we've got at least looks like SPIR-V before we hand it to the driver, which isn't required to do any validation itself and might just crash on garbage
+inline void validateSpirvCode(spirvCodeView code, const std::string &name)
+{
+    static constexpr std::uint32_t spirvMagicNumber = 0x07230203;
+    static constexpr std::size_t spirvHeaderWordCount = 5; // Magic number, version, generator, bound and schema
+
+    if (code.wordCount < spirvHeaderWordCount)
+        throw std::runtime_error(name + " is too small to be SPIR-V");
+
+    if (code.words[0] != spirvMagicNumber) {
+        // SPIR-V can in theory be stored with either endianness, but Vulkan only takes it in the host's
+        if (code.words[0] == __builtin_bswap32(spirvMagicNumber))
+            throw std::runtime_error(name + " is SPIR-V with the wrong endianness");
+        throw std::runtime_error(name + " is not SPIR-V (bad magic number)");
+    }
+}
+
+// A SPIR-V binary that's memory-mapped read-only straight from disk, which means no copies at all (the kernel just pages it in as the driver reads it) and page alignment for free, which more than covers the 4-byte alignment Vulkan wants
+class spirvBlob {
+    void *mapping = MAP_FAILED;
+    std::size_t mappingSize = 0;
+
+public:
+    explicit spirvBlob(const std::string &fileName)
+    {
+        int fileDescriptor = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fileDescriptor < 0)
+            throw std::runtime_error("Failure to open " + fileName);
+
+        struct stat fileStatus;
+        if (fstat(fileDescriptor, &fileStatus) != 0) {
+            close(fileDescriptor);
+            throw std::runtime_error("Failure to stat " + fileName);
+        }
+
+        // mmap refuses to map 0 bytes, and a size that isn't a whole number of words can't be valid SPIR-V anyway
+        this->mappingSize = static_cast<std::size_t>(fileStatus.st_size);
+        if (this->mappingSize == 0 || this->mappingSize % sizeof(std::uint32_t) != 0) {
+            close(fileDescriptor);
+            throw std::runtime_error(fileName + " has a size that isn't a multiple of 4 bytes, so it can't be SPIR-V");
+        }
+
+        this->mapping = mmap(nullptr, this->mappingSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        close(fileDescriptor); // The mapping keeps its own reference to the file
+        if (this->mapping == MAP_FAILED)
+            throw std::runtime_error("Failure to map " + fileName);
+
+        // The driver is going to read the whole thing right away, so we might as well have the kernel start reading it in now
+        madvise(this->mapping, this->mappingSize, MADV_WILLNEED);
+
+        try {
+            validateSpirvCode(this->code(), fileName);
+        } catch (...) {
+            munmap(this->mapping, this->mappingSize);
+            throw;
+        }
+    }
+
+    ~spirvBlob()
+    {
+        if (this->mapping != MAP_FAILED)
+            munmap(this->mapping, this->mappingSize);
+    }
+
+    spirvBlob(spirvBlob &&other) noexcept
+        : mapping(std::exchange(other.mapping, MAP_FAILED)), mappingSize(std::exchange(other.mappingSize, 0))
+    {
+    }
+
+    spirvBlob &operator=(spirvBlob &&other) noexcept
+    {
+        std::swap(this->mapping, other.mapping);
+        std::swap(this->mappingSize, other.mappingSize);
+        return *this;
+    }
+
+    spirvBlob(const spirvBlob &) = delete;
+    spirvBlob &operator=(const spirvBlob &) = delete;
+
+    spirvCodeView code() const
+    {
+        return { static_cast<const std::uint32_t *>(this->mapping), this->mappingSize / sizeof(std::uint32_t) };
+    }
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "gpuTimeline.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Gets data into device-local buffers (which the CPU usually can't write to directly) by going through a host-visible staging ring
+// The ring is split into segments which each get their own command buffer and point on a timeline, so that we can fill one segment while the GPU is still copying out of the others, and only ever have to wait when we wrap around onto a segment that's still being copied from
+// Copies go through the transfer queue we're given, which is ideally a dedicated one (those usually map to the GPU's DMA engines, which can run alongside rendering). When that queue isn't from the graphics family, ownership of the destination buffers is handed over to the graphics family once uploads are flushed
+// Flushes complete on the graphics queue's timeline, which lets whoever renders with the uploaded data know when it's there without any extra fence (when the transfer queue is the graphics queue, the segments simply use that same timeline too)
+class stagingUploader {
+public:
+    struct queueInfo {
+        VkQueue queue;
+        std::uint32_t familyIndex;
+    };
+
+private:
+    struct segment {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        std::uint64_t completionValue = 0; // What the segment timeline reaches once the GPU is done copying out of the segment
+        VkDeviceSize usedSize = 0;
+        bool isRecording = false;
+    };
+
+    static constexpr VkDeviceSize copyAlignment = 16; // Copies don't need any particular alignment, but they tend to be faster when source offsets aren't all over the place
+
+    VkDevice vulkanDevice;
+    queueInfo transferQueue;
+    queueInfo graphicsQueue;
+    gpuTimeline &graphicsTimeline;
+    std::optional<gpuTimeline> transferTimeline; // Only when the transfer queue isn't the graphics queue, as values must be signalled in order and the two queues run independently
+
+    VkBuffer vulkanStagingBuffer = VK_NULL_HANDLE;
+    std::byte *stagingMapping = nullptr; // Persistently mapped (and coherent) by whoever gave it to us, there's no point in mapping and unmapping it all the time
+
+    VkDeviceSize segmentSize;
+    std::vector<segment> segments;
+    std::size_t currentSegmentIndex = 0;
+
+    VkCommandPool vulkanTransferCommandPool = VK_NULL_HANDLE;
+
+    // Only used when the transfer queue isn't from the graphics family, to acquire ownership of what we uploaded on the graphics queue
+    VkCommandPool vulkanGraphicsCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer vulkanOwnershipAcquireCommandBuffer = VK_NULL_HANDLE;
+    std::uint64_t ownershipAcquireCompletionValue = 0; // On the graphics timeline
+
+    std::vector<VkBuffer> pendingDestinationBuffers; // Everything written to since the last flush, which needs to be made available to the graphics queue
+    std::uint64_t lastFlushValue = 0;
+    std::uint64_t totalUploadedSize = 0;
+
+    bool needsOwnershipTransfer() const
+    {
+        return this->transferQueue.familyIndex != this->graphicsQueue.familyIndex;
+    }
+
+    // We only ever get one queue per family, so the same family means the very same queue
+    gpuTimeline &getSegmentTimeline()
+    {
+        return this->transferTimeline.has_value() ? this->transferTimeline.value() : this->graphicsTimeline;
+    }
+
+    VkCommandPool createCommandPool(std::uint32_t queueFamilyIndex)
+    {
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Every command buffer gets rerecorded each time it's used
+        commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+        VkCommandPool result;
+        if (vkCreateCommandPool(this->vulkanDevice, &commandPoolCreateInfo, nullptr, &result) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create upload command pool");
+        return result;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkCommandPool commandPool)
+    {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = commandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer result;
+        if (vkAllocateCommandBuffers(this->vulkanDevice, &allocateInfo, &result) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate upload command buffer");
+        return result;
+    }
+
+    static void beginOneTimeCommandBuffer(VkCommandBuffer commandBuffer)
+    {
+        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin recording upload command buffer");
+    }
+
+    // Makes sure the current segment is ready to have copies recorded into it, which might mean waiting for the GPU to be done with it from the last time around the ring
+    segment &beginCurrentSegment()
+    {
+        auto &currentSegment = this->segments.at(this->currentSegmentIndex);
+        if (currentSegment.isRecording)
+            return currentSegment;
+
+        this->getSegmentTimeline().wait(currentSegment.completionValue);
+
+        vkResetCommandBuffer(currentSegment.commandBuffer, 0);
+        beginOneTimeCommandBuffer(currentSegment.commandBuffer);
+        currentSegment.usedSize = 0;
+        currentSegment.isRecording = true;
+        return currentSegment;
+    }
+
+    // Transfer writes must be made visible to whatever the graphics queue does with the buffers, which takes a release/acquire pair of barriers when the two queues are from different families and a plain barrier otherwise
+    void recordPendingBarriers(VkCommandBuffer commandBuffer, bool isAcquire)
+    {
+        std::vector<VkBufferMemoryBarrier> bufferMemoryBarriers;
+        for (auto destinationBuffer : this->pendingDestinationBuffers) {
+            VkBufferMemoryBarrier bufferMemoryBarrier = {};
+            bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+
+            bufferMemoryBarrier.srcAccessMask = isAcquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT; // Acquires don't make anything available, the release already did
+            bufferMemoryBarrier.dstAccessMask = (isAcquire || !this->needsOwnershipTransfer()) ? VK_ACCESS_MEMORY_READ_BIT : 0; // Likewise, releases don't make anything visible
+
+            bufferMemoryBarrier.srcQueueFamilyIndex = this->needsOwnershipTransfer() ? this->transferQueue.familyIndex : VK_QUEUE_FAMILY_IGNORED;
+            bufferMemoryBarrier.dstQueueFamilyIndex = this->needsOwnershipTransfer() ? this->graphicsQueue.familyIndex : VK_QUEUE_FAMILY_IGNORED;
+
+            bufferMemoryBarrier.buffer = destinationBuffer;
+            bufferMemoryBarrier.offset = 0;
+            bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+            bufferMemoryBarriers.push_back(bufferMemoryBarrier);
+        }
+
+        VkPipelineStageFlags srcStageMask = isAcquire ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+        VkPipelineStageFlags dstStageMask = (isAcquire || !this->needsOwnershipTransfer()) ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, static_cast<std::uint32_t>(bufferMemoryBarriers.size()), bufferMemoryBarriers.data(), 0, nullptr);
+    }
+
+    void submitCurrentSegment(bool isLastBeforeFlush)
+    {
+        auto &currentSegment = this->segments.at(this->currentSegmentIndex);
+        if (!currentSegment.isRecording)
+            return;
+
+        if (isLastBeforeFlush)
+            this->recordPendingBarriers(currentSegment.commandBuffer, false);
+
+        if (vkEndCommandBuffer(currentSegment.commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record upload command buffer");
+
+        // This also tells the ownership acquire (if any) when the transfer queue is done releasing ownership
+        auto &segmentTimeline = this->getSegmentTimeline();
+        VkSemaphore signalSemaphore = segmentTimeline.getSemaphore();
+        currentSegment.completionValue = segmentTimeline.advance();
+
+        VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo = {};
+        timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSemaphoreSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSemaphoreSubmitInfo.pSignalSemaphoreValues = &currentSegment.completionValue;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &currentSegment.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+
+        if (vkQueueSubmit(this->transferQueue.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit upload command buffer");
+
+        currentSegment.isRecording = false;
+        this->currentSegmentIndex = (this->currentSegmentIndex + 1) % this->segments.size();
+    }
+
+    void submitOwnershipAcquire(std::uint64_t releaseCompletionValue)
+    {
+        this->graphicsTimeline.wait(this->ownershipAcquireCompletionValue);
+
+        vkResetCommandBuffer(this->vulkanOwnershipAcquireCommandBuffer, 0);
+        beginOneTimeCommandBuffer(this->vulkanOwnershipAcquireCommandBuffer);
+        this->recordPendingBarriers(this->vulkanOwnershipAcquireCommandBuffer, true);
+        if (vkEndCommandBuffer(this->vulkanOwnershipAcquireCommandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to record ownership acquire command buffer");
+
+        // The graphics queue must not acquire ownership before the transfer queue is done releasing it
+        VkSemaphore waitSemaphore = this->transferTimeline->getSemaphore();
+        VkSemaphore signalSemaphore = this->graphicsTimeline.getSemaphore();
+        this->ownershipAcquireCompletionValue = this->graphicsTimeline.advance();
+
+        VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo = {};
+        timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSemaphoreSubmitInfo.waitSemaphoreValueCount = 1;
+        timelineSemaphoreSubmitInfo.pWaitSemaphoreValues = &releaseCompletionValue;
+        timelineSemaphoreSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSemaphoreSubmitInfo.pSignalSemaphoreValues = &this->ownershipAcquireCompletionValue;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &waitSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &this->vulkanOwnershipAcquireCommandBuffer;
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+
+        // Anything submitted to the graphics queue after this is ordered after the acquire, so nobody else needs to wait on it
+        if (vkQueueSubmit(this->graphicsQueue.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit ownership acquire command buffer");
+    }
+
+public:
+    stagingUploader(VkDevice device, queueInfo transferQueue, queueInfo graphicsQueue, gpuTimeline &graphicsTimeline, VkBuffer stagingBuffer, std::byte *stagingMapping, VkDeviceSize stagingSize, std::size_t segmentCount = 4)
+        : vulkanDevice(device), transferQueue(transferQueue), graphicsQueue(graphicsQueue), graphicsTimeline(graphicsTimeline), vulkanStagingBuffer(stagingBuffer), stagingMapping(stagingMapping), segmentSize(stagingSize / segmentCount / copyAlignment * copyAlignment), segments(segmentCount)
+    {
+        if (this->segmentSize == 0)
+            throw std::runtime_error("Staging ring is too small");
+
+        this->vulkanTransferCommandPool = this->createCommandPool(this->transferQueue.familyIndex);
+        for (auto &segment : this->segments)
+            segment.commandBuffer = this->allocateCommandBuffer(this->vulkanTransferCommandPool);
+
+        if (this->needsOwnershipTransfer()) {
+            this->transferTimeline.emplace(this->vulkanDevice);
+            this->vulkanGraphicsCommandPool = this->createCommandPool(this->graphicsQueue.familyIndex);
+            this->vulkanOwnershipAcquireCommandBuffer = this->allocateCommandBuffer(this->vulkanGraphicsCommandPool);
+        }
+    }
+
+    // The staging buffer and its memory belong to whoever gave them to us
+    ~stagingUploader()
+    {
+        this->waitIdle();
+
+        if (this->needsOwnershipTransfer())
+            vkDestroyCommandPool(this->vulkanDevice, this->vulkanGraphicsCommandPool, nullptr);
+        vkDestroyCommandPool(this->vulkanDevice, this->vulkanTransferCommandPool, nullptr);
+    }
+
+    stagingUploader(const stagingUploader &) = delete;
+    stagingUploader &operator=(const stagingUploader &) = delete;
+
+    // Copies the data into the staging ring right away (so the caller is free to do whatever it wants with it afterwards), but the actual copy to the destination only happens on the GPU at some point after the next flush
+    // This is meant for filling buffers: an exclusively-owned buffer that the graphics queue already used loses its contents when the transfer queue writes to it without getting ownership back first
+    void upload(VkBuffer destinationBuffer, VkDeviceSize destinationOffset, const void *data, VkDeviceSize size)
+    {
+        auto source = static_cast<const std::byte *>(data);
+
+        if (std::find(this->pendingDestinationBuffers.begin(), this->pendingDestinationBuffers.end(), destinationBuffer) == this->pendingDestinationBuffers.end())
+            this->pendingDestinationBuffers.push_back(destinationBuffer);
+
+        // Anything bigger than a segment just gets split over as many as it needs
+        while (size != 0) {
+            auto &currentSegment = this->beginCurrentSegment();
+            if (currentSegment.usedSize == this->segmentSize) {
+                this->submitCurrentSegment(false);
+                continue;
+            }
+
+            VkDeviceSize chunkSize = std::min(size, this->segmentSize - currentSegment.usedSize);
+            VkDeviceSize stagingOffset = this->currentSegmentIndex * this->segmentSize + currentSegment.usedSize;
+            std::memcpy(this->stagingMapping + stagingOffset, source, chunkSize);
+
+            VkBufferCopy bufferCopy = {};
+            bufferCopy.srcOffset = stagingOffset;
+            bufferCopy.dstOffset = destinationOffset;
+            bufferCopy.size = chunkSize;
+            vkCmdCopyBuffer(currentSegment.commandBuffer, this->vulkanStagingBuffer, destinationBuffer, 1, &bufferCopy);
+
+            currentSegment.usedSize = std::min(this->segmentSize, (currentSegment.usedSize + chunkSize + copyAlignment - 1) / copyAlignment * copyAlignment);
+            source += chunkSize;
+            destinationOffset += chunkSize;
+            size -= chunkSize;
+            this->totalUploadedSize += chunkSize;
+        }
+    }
+
+    // Submits everything uploaded so far, such that anything submitted to the graphics queue afterwards sees the uploaded data
+    // This doesn't wait for the copies to actually happen, the GPU takes care of the ordering, but the returned value is where the graphics timeline is at once they're done (for whoever wants to know when the staging data is no longer needed, or to use the data from another queue)
+    std::uint64_t flush()
+    {
+        if (this->pendingDestinationBuffers.empty())
+            return this->lastFlushValue;
+
+        // We need somewhere to put the barriers even if the current segment has nothing in it yet
+        auto &lastSegment = this->beginCurrentSegment();
+        this->submitCurrentSegment(true);
+        if (this->needsOwnershipTransfer()) {
+            this->submitOwnershipAcquire(lastSegment.completionValue);
+            this->lastFlushValue = this->ownershipAcquireCompletionValue;
+        } else
+            this->lastFlushValue = lastSegment.completionValue;
+
+        this->pendingDestinationBuffers.clear();
+        return this->lastFlushValue;
+    }
+
+    // Waits for every upload submitted so far to be done (this doesn't flush, so whatever hasn't been flushed yet stays pending)
+    void waitIdle()
+    {
+        for (auto &segment : this->segments)
+            if (!segment.isRecording)
+                this->getSegmentTimeline().wait(segment.completionValue);
+
+        if (this->needsOwnershipTransfer())
+            this->graphicsTimeline.wait(this->ownershipAcquireCompletionValue);
+    }
+
+    std::uint64_t getTotalUploadedSize() const
+    {
+        return this->totalUploadedSize;
+    }
+
+    bool isUsingDedicatedTransferQueue() const
+    {
+        return this->needsOwnershipTransfer();
+    }
+};